@@ -0,0 +1,276 @@
+/*
+ * A stress test of the addon under chain churn.  For each of the given churn
+ * rates, this runs a reader in a child process against the synthetic kstat
+ * chain of kssim.so (see README), with that many chain changes per second
+ * (or, as "call", one on every chain update), and times each of chainupdate()
+ * (that is, update()), read(), list() and getkstat() in a loop.  It reports
+ * their p50 and p99 latencies, and how much the process's RSS and heap and
+ * the reader's native memory grew while it ran:  as the chain stays the same
+ * size under churn, any sustained growth is memory that isn't being given
+ * back when kstats leave the chain.
+ *
+ * Usage: node bench/churn.js [-r rate[,rate...]] [-n kstats] [-d seconds]
+ *	[-w seconds] [-a addon] [-s kssim.so] [-j]
+ */
+
+var child_process = require('child_process');
+var path = require('path');
+
+var release = path.join(__dirname, '..', 'build', 'Release');
+var ops = [ 'update', 'read', 'list', 'getkstat' ];
+
+function
+usage(msg)
+{
+	console.error('churn: ' + msg);
+	console.error('usage: node bench/churn.js [-r rate[,rate...]] ' +
+	    '[-n kstats] [-d seconds]\n\t[-w seconds] [-a addon] ' +
+	    '[-s kssim.so] [-j]');
+	process.exit(2);
+}
+
+function
+options(argv)
+{
+	var opts = {
+		rates: [ '0', '1', '10', '100', 'call' ],
+		size: 8,
+		duration: 5,
+		warmup: 1,
+		addon: path.join(release, 'kstat.node'),
+		sim: path.join(release, 'kssim.so'),
+		json: false
+	};
+
+	for (var i = 0; i < argv.length; i++) {
+		var arg = argv[i], val = argv[i + 1];
+
+		if (arg == '-j') {
+			opts.json = true;
+			continue;
+		}
+
+		if (val === undefined)
+			usage('missing value for ' + arg);
+
+		i++;
+
+		switch (arg) {
+		case '-r':
+			opts.rates = val.split(',');
+			break;
+		case '-n':
+			opts.size = parseInt(val, 10);
+			break;
+		case '-d':
+			opts.duration = parseFloat(val);
+			break;
+		case '-w':
+			opts.warmup = parseFloat(val);
+			break;
+		case '-a':
+			opts.addon = path.resolve(val);
+			break;
+		case '-s':
+			opts.sim = path.resolve(val);
+			break;
+		default:
+			usage('unknown option ' + arg);
+		}
+	}
+
+	if (!(opts.size > 0) || !(opts.duration > 0) || !(opts.warmup >= 0))
+		usage('kstats and duration must be positive');
+
+	opts.rates.forEach(function (r) {
+		if (r != 'call' && !(parseFloat(r) >= 0))
+			usage('invalid rate ' + r);
+	});
+
+	return (opts);
+}
+
+function
+percentile(sorted, p)
+{
+	if (sorted.length === 0)
+		return (null);
+
+	return (sorted[Math.min(sorted.length - 1,
+	    Math.floor(sorted.length * p / 100))]);
+}
+
+/*
+ * The measuring side:  read the chain in a loop, timing each call, for the
+ * warmup and then the measured duration, and send the results to our parent.
+ * Memory is measured after collecting garbage, so that what remains is what
+ * is still held.
+ */
+function
+measure(addon, warmup, duration)
+{
+	var kstat = require(addon);
+	var reader = new kstat.Reader();
+	var target = reader.list()[0];
+	var latencies = {}, start = null, end, iterations = 0;
+	var begin = process.hrtime.bigint(), before, changes;
+
+	ops.forEach(function (op) { latencies[op] = []; });
+
+	function memory() {
+		var mem;
+
+		global.gc();
+		mem = process.memoryUsage();
+
+		return ({ rss: mem.rss, heapUsed: mem.heapUsed,
+		    native: reader.memoryUsage().total });
+	}
+
+	function time(op, f) {
+		var t0 = process.hrtime.bigint();
+
+		f();
+
+		if (start !== null)
+			latencies[op].push(Number(process.hrtime.bigint() -
+			    t0) / 1e3);
+	}
+
+	function iterate() {
+		var now = process.hrtime.bigint();
+
+		if (start === null && now - begin >= warmup * 1e9) {
+			before = memory();
+			changes = reader.stats().chainchanges;
+			start = process.hrtime.bigint();
+		}
+
+		if (start !== null && now - start >= duration * 1e9) {
+			end = now;
+			finish();
+			return;
+		}
+
+		time('update', function () { reader.chainupdate(); });
+		time('read', function () { reader.read(); });
+		time('list', function () { reader.list(); });
+		time('getkstat', function () {
+			reader.getkstat({ module: target.module,
+			    instance: target.instance, name: target.name });
+		});
+
+		if (start !== null)
+			iterations++;
+
+		setImmediate(iterate);
+	}
+
+	function finish() {
+		var after = memory(), result = {
+			duration: Number(end - start) / 1e9,
+			iterations: iterations,
+			changes: reader.stats().chainchanges - changes,
+			ops: {},
+			memory: { before: before, after: after }
+		};
+
+		ops.forEach(function (op) {
+			var lat = latencies[op].sort(function (a, b) {
+				return (a - b);
+			});
+
+			result.ops[op] = { p50: percentile(lat, 50),
+			    p99: percentile(lat, 99) };
+		});
+
+		process.send(result, function () { process.exit(0); });
+	}
+
+	iterate();
+}
+
+function
+report(opts, results)
+{
+	if (opts.json) {
+		console.log(JSON.stringify(results));
+		return;
+	}
+
+	function us(v) { return (v === null ? '-' : v.toFixed(1)); }
+	function mb(v) { return ((v / 1048576).toFixed(2)); }
+	function pad(s, n) {
+		s = String(s);
+
+		while (s.length < n)
+			s = ' ' + s;
+
+		return (s);
+	}
+
+	console.log('%d kstats per change; latencies in microseconds (p50/p99), ' +
+	    'growth in MB', opts.size);
+	console.log('%s %s %s %s %s %s %s %s %s %s', pad('CHURN/S', 7),
+	    pad('ITERS', 7), pad('CHANGES', 7), pad('UPDATE', 15),
+	    pad('READ', 15), pad('LIST', 15), pad('GETKSTAT', 15),
+	    pad('RSS', 7), pad('HEAP', 7), pad('NATIVE', 7));
+
+	results.forEach(function (r) {
+		var m = r.memory, cols = ops.map(function (op) {
+			return (pad(us(r.ops[op].p50) + '/' +
+			    us(r.ops[op].p99), 15));
+		});
+
+		console.log('%s %s %s %s %s %s %s', pad(r.rate, 7),
+		    pad(r.iterations, 7), pad(r.changes, 7), cols.join(' '),
+		    pad(mb(m.after.rss - m.before.rss), 7),
+		    pad(mb(m.after.heapUsed - m.before.heapUsed), 7),
+		    pad(mb(m.after.native - m.before.native), 7));
+	});
+}
+
+/*
+ * Run each churn rate in a process of its own, so that memory measured at
+ * one rate isn't left over from another.
+ */
+function
+run(opts)
+{
+	var results = [];
+
+	(function next(i) {
+		if (i == opts.rates.length) {
+			report(opts, results);
+			return;
+		}
+
+		var env = Object.assign({}, process.env, {
+		    LD_PRELOAD: opts.sim,
+		    KSSIM_CHURN: opts.rates[i],
+		    KSSIM_CHURN_SIZE: String(opts.size) });
+		var child = child_process.fork(__filename, [ '--measure',
+		    opts.addon, opts.warmup, opts.duration ],
+		    { env: env, execArgv: [ '--expose-gc' ] });
+		var result = null;
+
+		child.on('message', function (msg) { result = msg; });
+		child.on('exit', function (code) {
+			if (result === null) {
+				console.error('churn: measurement at %s ' +
+				    'failed (%s)', opts.rates[i], code);
+				process.exit(1);
+			}
+
+			result.rate = opts.rates[i];
+			results.push(result);
+			next(i + 1);
+		});
+	})(0);
+}
+
+if (process.argv[2] == '--measure')
+	measure(process.argv[3], parseFloat(process.argv[4]),
+	    parseFloat(process.argv[5]));
+else
+	run(options(process.argv.slice(2)));
@@ -0,0 +1,372 @@
+/*
+ * A load test of the jkstat server (examples/jkstat.js).  This runs the server
+ * in a child process against the synthetic kstat chain of kssim.so (see
+ * README), drives its routes from many concurrent keep-alive clients, and
+ * reports the requests per second, latencies and server memory usage seen
+ * for each route.  By running it against different builds of the addon, a
+ * change to the addon can be measured as a jkstat client would see it.
+ *
+ * Usage: node bench/jkstat.js [-c clients] [-d seconds] [-w seconds]
+ *	[-r route[,route...]] [-a addon] [-s kssim.so] [-j]
+ *
+ * The size of the synthetic chain is set with KSSIM_CPUS, KSSIM_DISKS and
+ * KSSIM_NICS, or a recording of one can be replayed with KSSIM_RECORDING;
+ * these are passed on to the server.
+ */
+
+var child_process = require('child_process');
+var http = require('http');
+var path = require('path');
+
+var release = path.join(__dirname, '..', 'build', 'Release');
+
+var routes = {
+	list: function () { return ('/kstat/list'); },
+	get: function (t) {
+		var k = t.kstats[t.next++ % t.kstats.length];
+
+		return ('/kstat/get/' + encodeURIComponent(k.module) + '/' +
+		    k.instance + '/' + encodeURIComponent(k.name));
+	},
+	mget: function (t) {
+		var g = t.groups[t.next++ % t.groups.length];
+
+		return ('/kstat/mget/' + encodeURIComponent(g.module) + '/' +
+		    g.instance + '/' + encodeURIComponent(g.names.join(';')));
+	},
+	chainupdate: function () { return ('/kstat/chainupdate'); },
+	getkcid: function () { return ('/kstat/getkcid'); }
+};
+
+function
+usage(msg)
+{
+	console.error('jkstat: ' + msg);
+	console.error('usage: node bench/jkstat.js [-c clients] [-d seconds] ' +
+	    '[-w seconds]\n\t[-r route[,route...]] [-a addon] [-s kssim.so] ' +
+	    '[-j]');
+	console.error('routes: ' + Object.keys(routes).join(', '));
+	process.exit(2);
+}
+
+function
+options(argv)
+{
+	var opts = {
+		clients: 32,
+		duration: 10,
+		warmup: 2,
+		routes: Object.keys(routes),
+		addon: path.join(release, 'kstat.node'),
+		sim: path.join(release, 'kssim.so'),
+		json: false
+	};
+
+	for (var i = 0; i < argv.length; i++) {
+		var arg = argv[i], val = argv[i + 1];
+
+		if (arg == '-j') {
+			opts.json = true;
+			continue;
+		}
+
+		if (val === undefined)
+			usage('missing value for ' + arg);
+
+		i++;
+
+		switch (arg) {
+		case '-c':
+			opts.clients = parseInt(val, 10);
+			break;
+		case '-d':
+			opts.duration = parseFloat(val);
+			break;
+		case '-w':
+			opts.warmup = parseFloat(val);
+			break;
+		case '-r':
+			opts.routes = val.split(',');
+			break;
+		case '-a':
+			opts.addon = path.resolve(val);
+			break;
+		case '-s':
+			opts.sim = path.resolve(val);
+			break;
+		default:
+			usage('unknown option ' + arg);
+		}
+	}
+
+	if (!(opts.clients > 0) || !(opts.duration > 0) || !(opts.warmup >= 0))
+		usage('clients and duration must be positive');
+
+	opts.routes.forEach(function (r) {
+		if (!routes.hasOwnProperty(r))
+			usage('unknown route ' + r);
+	});
+
+	return (opts);
+}
+
+/*
+ * The server side:  load the jkstat server with the addon under test standing
+ * in for the kstat module, and report its port, then its memory usage every
+ * 100ms, to our parent.
+ */
+function
+server(addon)
+{
+	var Module = require('module');
+	var resolve = Module._resolveFilename;
+
+	Module._resolveFilename = function (request) {
+		if (request == 'kstat')
+			return (addon);
+
+		return (resolve.apply(this, arguments));
+	};
+
+	var app = require(path.join(__dirname, '..', 'examples', 'jkstat.js'));
+	var listener = app.listen(0, '127.0.0.1', function () {
+		process.send({ port: listener.address().port });
+	});
+
+	setInterval(function () {
+		process.send({ memory: process.memoryUsage() });
+	}, 100);
+
+	process.on('disconnect', function () { process.exit(0); });
+}
+
+function
+percentile(sorted, p)
+{
+	if (sorted.length === 0)
+		return (null);
+
+	return (sorted[Math.min(sorted.length - 1,
+	    Math.floor(sorted.length * p / 100))]);
+}
+
+function
+fetch(agent, port, url, cb)
+{
+	var req = http.get({ agent: agent, host: '127.0.0.1', port: port,
+	    path: url }, function (res) {
+		var body = [];
+
+		res.on('data', function (chunk) { body.push(chunk); });
+		res.on('end', function () {
+			cb(res.statusCode == 200 ? null :
+			    new Error('status ' + res.statusCode),
+			    Buffer.concat(body));
+		});
+	});
+
+	req.on('error', function (err) { cb(err); });
+}
+
+/*
+ * Work out what get and mget will ask for from the chain that the server
+ * lists:  each of its kstats in turn for get, and the names of each module
+ * and instance in turn for mget.
+ */
+function
+targets(kstats)
+{
+	var groups = {}, t = { kstats: kstats, groups: [], next: 0 };
+
+	kstats.forEach(function (k) {
+		var key = k.module + ':' + k.instance;
+
+		if (!groups.hasOwnProperty(key)) {
+			groups[key] = { module: k.module, instance: k.instance,
+			    names: [] };
+			t.groups.push(groups[key]);
+		}
+
+		groups[key].names.push(k.name);
+	});
+
+	return (t);
+}
+
+function
+report(opts, stats, memory, elapsed)
+{
+	var result = { clients: opts.clients, duration: elapsed,
+	    routes: {}, memory: memory };
+	var all = [], requests = 0, errors = 0;
+
+	function summarize(lat, n, e) {
+		lat.sort(function (a, b) { return (a - b); });
+
+		return ({ requests: n, errors: e, rate: n / elapsed,
+		    p50: percentile(lat, 50), p99: percentile(lat, 99),
+		    max: lat.length ? lat[lat.length - 1] : null });
+	}
+
+	opts.routes.forEach(function (r) {
+		var s = stats[r];
+
+		all = all.concat(s.latencies);
+		requests += s.requests;
+		errors += s.errors;
+		result.routes[r] = summarize(s.latencies, s.requests, s.errors);
+	});
+
+	result.total = summarize(all, requests, errors);
+
+	if (opts.json) {
+		console.log(JSON.stringify(result));
+		return;
+	}
+
+	function ms(v) { return (v === null ? '-' : v.toFixed(3)); }
+	function pad(s, n) {
+		s = String(s);
+
+		while (s.length < n)
+			s = ' ' + s;
+
+		return (s);
+	}
+
+	console.log('%d clients for %ss', opts.clients, elapsed.toFixed(1));
+	console.log('%s %s %s %s %s %s %s', pad('ROUTE', 12), pad('REQS', 9),
+	    pad('ERRS', 6), pad('REQ/S', 10), pad('P50(ms)', 9),
+	    pad('P99(ms)', 9), pad('MAX(ms)', 9));
+
+	Object.keys(result.routes).concat([ 'total' ]).forEach(function (r) {
+		var s = r == 'total' ? result.total : result.routes[r];
+
+		console.log('%s %s %s %s %s %s %s', pad(r, 12),
+		    pad(s.requests, 9), pad(s.errors, 6),
+		    pad(s.rate.toFixed(1), 10), pad(ms(s.p50), 9),
+		    pad(ms(s.p99), 9), pad(ms(s.max), 9));
+	});
+
+	console.log('server rss (MB): %s start, %s peak, %s end',
+	    (memory.start.rss / 1048576).toFixed(1),
+	    (memory.peak.rss / 1048576).toFixed(1),
+	    (memory.end.rss / 1048576).toFixed(1));
+	console.log('server heap used (MB): %s start, %s peak, %s end',
+	    (memory.start.heapUsed / 1048576).toFixed(1),
+	    (memory.peak.heapUsed / 1048576).toFixed(1),
+	    (memory.end.heapUsed / 1048576).toFixed(1));
+}
+
+/*
+ * The client side:  once the server is up, fetch the list of kstats (untimed)
+ * to pick targets from, then run each client as a loop over the routes, each
+ * starting at a different one, for the warmup and then the measured duration.
+ */
+function
+client(opts)
+{
+	var env = Object.assign({}, process.env, { LD_PRELOAD: opts.sim });
+	var child = child_process.fork(__filename, [ '--server', opts.addon ],
+	    { env: env });
+	var agent = new http.Agent({ keepAlive: true,
+	    maxSockets: opts.clients });
+	var stats = {}, memory = { start: null, peak: null, end: null };
+	var measuring = false, done = false, start, elapsed, running;
+	var t;
+
+	opts.routes.forEach(function (r) {
+		stats[r] = { requests: 0, errors: 0, latencies: [] };
+	});
+
+	child.on('exit', function (code) {
+		if (!done) {
+			console.error('jkstat: server exited (%s)', code);
+			process.exit(1);
+		}
+	});
+
+	child.on('message', function (msg) {
+		if (msg.memory) {
+			if (!measuring)
+				return;
+
+			if (memory.start === null)
+				memory.start = msg.memory;
+
+			if (memory.peak === null ||
+			    msg.memory.rss > memory.peak.rss)
+				memory.peak = msg.memory;
+
+			memory.end = msg.memory;
+			return;
+		}
+
+		fetch(agent, msg.port, '/kstat/list', function (err, body) {
+			if (err) {
+				console.error('jkstat: could not list kstats: ' +
+				    err.message);
+				process.exit(1);
+			}
+
+			t = targets(JSON.parse(body));
+			running = opts.clients;
+
+			for (var i = 0; i < opts.clients; i++)
+				loop(msg.port, i);
+
+			setTimeout(function () {
+				measuring = true;
+				start = process.hrtime.bigint();
+
+				setTimeout(function () {
+					done = true;
+					elapsed = Number(process.hrtime.bigint() -
+					    start) / 1e9;
+				}, opts.duration * 1000);
+			}, opts.warmup * 1000);
+		});
+	});
+
+	function loop(port, n) {
+		var r = opts.routes[n % opts.routes.length];
+		var t0 = process.hrtime.bigint();
+
+		fetch(agent, port, routes[r](t), function (err) {
+			var s = stats[r];
+
+			if (measuring && !done) {
+				s.requests++;
+
+				if (err)
+					s.errors++;
+				else
+					s.latencies.push(Number(
+					    process.hrtime.bigint() - t0) / 1e6);
+			}
+
+			if (!done)
+				return (loop(port, n + 1));
+
+			if (--running === 0)
+				finish();
+		});
+	}
+
+	function finish() {
+		agent.destroy();
+		child.disconnect();
+
+		if (memory.start === null) {
+			console.error('jkstat: no memory samples from server');
+			process.exit(1);
+		}
+
+		report(opts, stats, memory, elapsed);
+	}
+}
+
+if (process.argv[2] == '--server')
+	server(process.argv[3]);
+else
+	client(options(process.argv.slice(2)));
@@ -0,0 +1,765 @@
+/*
+ * A synthetic libkstat, for benchmarking the addon (and what's built on it)
+ * without a live kernel.  Preloaded into node (LD_PRELOAD=.../kssim.so), it
+ * interposes on the libkstat functions that the addon calls and serves a
+ * chain of its own:  either one generated from KSSIM_CPUS CPUs, KSSIM_DISKS
+ * disks and KSSIM_NICS network interfaces, or one loaded from a recording in
+ * the format of "kstat -p" (or "ksdump -p") named by KSSIM_RECORDING.
+ * Generated counters advance at steady rates, so that successive reads see
+ * them change; recorded statistics are replayed as they were recorded.
+ *
+ * To model the churn of zones booting, VNICs coming and going and disks being
+ * hot-plugged, KSSIM_CHURN sets a rate of chain changes per second (or, as
+ * "call", a change on every kstat_chain_update() call).  At each change, the
+ * KSSIM_CHURN_SIZE (default 8) oldest VNIC kstats are removed and as many new
+ * ones added, so that the chain changes but its size stays the same.
+ *
+ * For tests that need the counters to be where they expect, KSSIM_TIME (which
+ * may be changed as the process runs) stops the clock that they advance by
+ * at that many seconds after the chain was made; each read then has that
+ * snaptime, so rates over an interval are exact.
+ *
+ * KSSIM_FAIL (which may also be changed as the process runs) names kstats, as
+ * a comma-separated list of "module:instance:name", whose reads fail with EIO.
+ *
+ * Each kstat_open() handle has its own copy of the chain, as with libkstat,
+ * and kstat IDs are shared by all of them.  The chain watcher of a reader with
+ * refresh "watch" asks /dev/kstat for the chain ID itself, so we interpose on
+ * ioctl() too, and answer that request with the ID of our chain.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/sysinfo.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+
+/*
+ * Our prototypes for these are our own:  libkstat's headers have declared
+ * their string arguments with and without const at different times.
+ */
+#define	kstat_lookup		kssim_kstat_lookup_decl
+#define	kstat_data_lookup	kssim_kstat_data_lookup_decl
+#include <kstat.h>
+#undef	kstat_lookup
+#undef	kstat_data_lookup
+
+using std::string;
+using std::vector;
+using std::map;
+using std::deque;
+
+typedef struct kssim_stat {
+	string kss_name;
+	uchar_t kss_type;		/* KSTAT_DATA_* */
+	uint64_t kss_base;
+	double kss_rate;		/* per second */
+	string kss_str;
+} kssim_stat_t;
+
+typedef struct kssim_kstat {
+	kid_t kk_kid;
+	string kk_module;
+	int kk_instance;
+	string kk_name;
+	string kk_class;
+	hrtime_t kk_crtime;
+	uchar_t kk_type;
+	vector<kssim_stat_t> kk_stats;	/* for named kstats */
+	double kk_rate;			/* scale of raw and I/O kstats */
+} kssim_kstat_t;
+
+static pthread_mutex_t kssim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t kssim_once = PTHREAD_ONCE_INIT;
+static map<kid_t, kssim_kstat_t> kssim_chain;	/* by ID; protected by lock */
+static kid_t kssim_chainid = 1;
+static kid_t kssim_nextkid = 1;
+static hrtime_t kssim_epoch;
+
+static double kssim_churnrate;			/* changes per second */
+static bool kssim_churncall;			/* change on every update */
+static int kssim_churnsize;			/* kstats per change */
+static uint64_t kssim_churnsteps;		/* changes made so far */
+static int kssim_nextvnic;
+static deque<kid_t> kssim_churned;		/* VNIC kstats, oldest first */
+
+static int
+kssim_env(const char *name, int deflt)
+{
+	const char *val = getenv(name);
+
+	return (val != NULL ? atoi(val) : deflt);
+}
+
+static kssim_kstat_t *
+kssim_add(const char *module, int instance, const char *name,
+    const char *classname, uchar_t type)
+{
+	kssim_kstat_t kk;
+
+	kk.kk_kid = kssim_nextkid++;
+	kk.kk_module = module;
+	kk.kk_instance = instance;
+	kk.kk_name = name;
+	kk.kk_class = classname;
+	kk.kk_crtime = gethrtime();
+	kk.kk_type = type;
+	kk.kk_rate = 1 + instance % 5;
+
+	return (&(kssim_chain[kk.kk_kid] = kk));
+}
+
+static void
+kssim_stat(kssim_kstat_t *kk, const char *name, uint64_t base, double rate)
+{
+	kssim_stat_t kss = { name, KSTAT_DATA_UINT64, base,
+	    rate * kk->kk_rate, "" };
+
+	kk->kk_stats.push_back(kss);
+}
+
+static void
+kssim_text(kssim_kstat_t *kk, const char *name, const char *value)
+{
+	kssim_stat_t kss = { name, KSTAT_DATA_STRING, 0, 0, value };
+
+	kk->kk_stats.push_back(kss);
+}
+
+/*
+ * Add the kstats of one generated CPU, disk or NIC.  Many of their counters
+ * stay at zero, as error counters mostly do.
+ */
+static void
+kssim_cpu(int i)
+{
+	static const char *zero[] = { "bawrite", "cpumigrate", "inv_swtch",
+	    "modload", "modunload", "mutex_adenters", "rw_rdfails",
+	    "rw_wrfails", "sysfork", "sysvfork", "sysexec", "wait_ticks_io",
+	    "xcalls", NULL };
+	char name[KSTAT_STRLEN];
+	kssim_kstat_t *kk;
+
+	kk = kssim_add("cpu", i, "sys", "misc", KSTAT_TYPE_NAMED);
+	kssim_stat(kk, "cpu_nsec_idle", 0, 6e8);
+	kssim_stat(kk, "cpu_nsec_user", 0, 3e8);
+	kssim_stat(kk, "cpu_nsec_kernel", 0, 1e8);
+	kssim_stat(kk, "cpu_ticks_idle", 0, 60);
+	kssim_stat(kk, "cpu_ticks_user", 0, 30);
+	kssim_stat(kk, "cpu_ticks_kernel", 0, 10);
+	kssim_stat(kk, "intr", 0, 1000);
+	kssim_stat(kk, "intrthread", 0, 400);
+	kssim_stat(kk, "pswitch", 0, 2000);
+	kssim_stat(kk, "readch", 0, 1e6);
+	kssim_stat(kk, "syscall", 0, 5000);
+	kssim_stat(kk, "sysread", 0, 1500);
+	kssim_stat(kk, "syswrite", 0, 500);
+	kssim_stat(kk, "trap", 0, 300);
+	kssim_stat(kk, "writech", 0, 4e5);
+
+	for (int z = 0; zero[z] != NULL; z++)
+		kssim_stat(kk, zero[z], 0, 0);
+
+	kk = kssim_add("cpu", i, "vm", "misc", KSTAT_TYPE_NAMED);
+	kssim_stat(kk, "as_fault", 0, 200);
+	kssim_stat(kk, "hat_fault", 0, 20);
+	kssim_stat(kk, "maj_fault", 0, 0);
+	kssim_stat(kk, "pgin", 0, 1);
+	kssim_stat(kk, "pgout", 0, 0);
+	kssim_stat(kk, "zfod", 0, 50);
+
+	(void) snprintf(name, sizeof (name), "cpu_info%d", i);
+	kk = kssim_add("cpu_info", i, name, "misc", KSTAT_TYPE_NAMED);
+	kssim_text(kk, "brand", "Synthetic CPU");
+	kssim_text(kk, "state", "on-line");
+	kssim_stat(kk, "clock_MHz", 2400, 0);
+	kssim_stat(kk, "chip_id", i / 8, 0);
+	kssim_stat(kk, "core_id", i, 0);
+
+	(void) snprintf(name, sizeof (name), "cpu_stat%d", i);
+	kk = kssim_add("cpu_stat", i, name, "misc", KSTAT_TYPE_RAW);
+}
+
+static void
+kssim_disk(int i)
+{
+	char name[KSTAT_STRLEN];
+	kssim_kstat_t *kk;
+
+	(void) snprintf(name, sizeof (name), "sd%d", i);
+	(void) kssim_add("sd", i, name, "disk", KSTAT_TYPE_IO);
+
+	(void) snprintf(name, sizeof (name), "sd%d,err", i);
+	kk = kssim_add("sderr", i, name, "device_error", KSTAT_TYPE_NAMED);
+	kssim_stat(kk, "Soft Errors", 0, 0);
+	kssim_stat(kk, "Hard Errors", 0, 0);
+	kssim_stat(kk, "Transport Errors", 0, 0);
+	kssim_text(kk, "Vendor", "SYNTH");
+	kssim_text(kk, "Product", "Synthetic Disk");
+	kssim_stat(kk, "Size", 1ULL << 40, 0);
+	kssim_stat(kk, "Media Error", 0, 0);
+	kssim_stat(kk, "Device Not Ready", 0, 0);
+	kssim_stat(kk, "No Device", 0, 0);
+	kssim_stat(kk, "Recoverable", 0, 0);
+	kssim_stat(kk, "Illegal Request", 0, 0);
+	kssim_stat(kk, "Predictive Failure Analysis", 0, 0);
+}
+
+static kid_t
+kssim_nic(const char *module, int instance, const char *name, int i)
+{
+	static const char *zero[] = { "collisions", "ierrors", "oerrors",
+	    "norcvbuf", "noxmtbuf", "multircv", "multixmt", "brdcstrcv",
+	    "brdcstxmt", "unknowns", "align_errors", "fcs_errors",
+	    "first_collisions", "multi_collisions", "sqe_errors",
+	    "defer_xmts", "tx_late_collisions", "ex_collisions",
+	    "macxmt_errors", "carrier_errors", "toolong_errors",
+	    "macrcv_errors", NULL };
+	kssim_kstat_t *kk;
+
+	kk = kssim_add(module, instance, name, "net", KSTAT_TYPE_NAMED);
+	kk->kk_rate = 1 + i % 5;
+	kssim_stat(kk, "ifspeed", 10000000000ULL, 0);
+	kssim_stat(kk, "ipackets64", 0, 8e4);
+	kssim_stat(kk, "opackets64", 0, 6e4);
+	kssim_stat(kk, "rbytes64", 0, 1e8);
+	kssim_stat(kk, "obytes64", 0, 7e7);
+	kssim_stat(kk, "link_state", 1, 0);
+	kssim_stat(kk, "link_up", 1, 0);
+
+	for (int z = 0; zero[z] != NULL; z++)
+		kssim_stat(kk, zero[z], 0, 0);
+
+	return (kk->kk_kid);
+}
+
+static void
+kssim_vnic(void)
+{
+	char name[KSTAT_STRLEN];
+	int i = kssim_nextvnic++;
+
+	(void) snprintf(name, sizeof (name), "vnic%d", i);
+	kssim_churned.push_back(kssim_nic("vnic", i, name, i));
+}
+
+/*
+ * Make the chain changes that are due, if any; the lock must be held.
+ */
+static void
+kssim_churn(void)
+{
+	uint64_t due;
+
+	if (kssim_churncall) {
+		due = kssim_churnsteps + 1;
+	} else if (kssim_churnrate > 0) {
+		due = (uint64_t)((gethrtime() - kssim_epoch) / 1e9 *
+		    kssim_churnrate);
+	} else {
+		return;
+	}
+
+	for (; kssim_churnsteps < due; kssim_churnsteps++) {
+		for (int i = 0; i < kssim_churnsize; i++) {
+			kssim_chain.erase(kssim_churned.front());
+			kssim_churned.pop_front();
+			kssim_vnic();
+		}
+
+		kssim_chainid++;
+	}
+}
+
+/*
+ * Load a recording of "module:instance:name:statistic<tab>value" lines, as
+ * printed by kstat -p or ksdump -p.  Each kstat is named; its "class" line
+ * gives its class, and its crtime and snaptime are ignored.
+ */
+static int
+kssim_load(const char *path)
+{
+	map<string, kid_t> kids;
+	char line[2048], *tab, *stat, *end;
+	kssim_kstat_t *kk;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		(void) fprintf(stderr, "kssim: could not open %s: %s\n",
+		    path, strerror(errno));
+		return (-1);
+	}
+
+	while (fgets(line, sizeof (line), fp) != NULL) {
+		char module[KSTAT_STRLEN], name[KSTAT_STRLEN];
+		int instance;
+
+		line[strcspn(line, "\n")] = '\0';
+
+		if ((tab = strchr(line, '\t')) == NULL ||
+		    (stat = strrchr(line, ':')) == NULL || stat > tab)
+			continue;
+
+		*tab++ = '\0';
+		*stat++ = '\0';
+
+		if (sscanf(line, "%30[^:]:%d:%30[^\n]",
+		    module, &instance, name) != 3)
+			continue;
+
+		map<string, kid_t>::iterator it = kids.find(line);
+
+		if (it == kids.end()) {
+			kk = kssim_add(module, instance, name, "misc",
+			    KSTAT_TYPE_NAMED);
+			kk->kk_rate = 0;
+			kids[line] = kk->kk_kid;
+		} else {
+			kk = &kssim_chain[it->second];
+		}
+
+		if (strcmp(stat, "class") == 0) {
+			kk->kk_class = tab;
+			continue;
+		}
+
+		if (strcmp(stat, "crtime") == 0 ||
+		    strcmp(stat, "snaptime") == 0)
+			continue;
+
+		/*
+		 * Integers are read back as integers, and everything else
+		 * (including the fractional numbers of the few kstats that
+		 * have them) as text.
+		 */
+		if (*tab == '-') {
+			long long value = strtoll(tab, &end, 10);
+
+			if (end != tab + 1 && *end == '\0') {
+				kssim_stat(kk, stat, (uint64_t)value, 0);
+				kk->kk_stats.back().kss_type = KSTAT_DATA_INT64;
+				continue;
+			}
+		} else {
+			unsigned long long value = strtoull(tab, &end, 10);
+
+			if (end != tab && *end == '\0') {
+				kssim_stat(kk, stat, value, 0);
+				continue;
+			}
+		}
+
+		kssim_text(kk, stat, tab);
+	}
+
+	(void) fclose(fp);
+
+	return (0);
+}
+
+static void
+kssim_init(void)
+{
+	const char *recording = getenv("KSSIM_RECORDING");
+	const char *churn = getenv("KSSIM_CHURN");
+	char name[KSTAT_STRLEN];
+	int i;
+
+	kssim_epoch = gethrtime();
+
+	if (recording != NULL) {
+		if (kssim_load(recording) == -1)
+			exit(1);
+	} else {
+		for (i = 0; i < kssim_env("KSSIM_CPUS", 8); i++)
+			kssim_cpu(i);
+
+		for (i = 0; i < kssim_env("KSSIM_DISKS", 32); i++)
+			kssim_disk(i);
+
+		for (i = 0; i < kssim_env("KSSIM_NICS", 4); i++) {
+			(void) snprintf(name, sizeof (name), "net%d", i);
+			(void) kssim_nic("link", 0, name, i);
+		}
+	}
+
+	if (churn == NULL)
+		return;
+
+	if (strcmp(churn, "call") == 0)
+		kssim_churncall = true;
+	else
+		kssim_churnrate = atof(churn);
+
+	if ((kssim_churnsize = kssim_env("KSSIM_CHURN_SIZE", 8)) <= 0)
+		kssim_churncall = false, kssim_churnrate = 0;
+
+	for (i = 0; i < kssim_churnsize; i++)
+		kssim_vnic();
+}
+
+static size_t
+kssim_datasize(const kssim_kstat_t *kk, uint_t *ndatap)
+{
+	size_t size = 0;
+
+	*ndatap = 1;
+
+	switch (kk->kk_type) {
+	case KSTAT_TYPE_NAMED:
+		*ndatap = kk->kk_stats.size();
+		size = kk->kk_stats.size() * sizeof (kstat_named_t);
+
+		for (size_t i = 0; i < kk->kk_stats.size(); i++)
+			size += kk->kk_stats[i].kss_str.size() + 1;
+
+		return (size);
+
+	case KSTAT_TYPE_IO:
+		return (sizeof (kstat_io_t));
+
+	default:
+		return (sizeof (cpu_stat_t));
+	}
+}
+
+static void
+kssim_release(kstat_t *ksp)
+{
+	delete (kssim_kstat_t *)ksp->ks_private;
+	free(ksp->ks_data);
+	free(ksp);
+}
+
+/*
+ * Bring a handle's copy of the chain up to date, as libkstat does:  kstats
+ * that have gone are removed, and new ones (which have higher IDs than any
+ * already there) are added at the end.  Each kstat's private pointer is our
+ * copy of its definition.  The lock must be held.
+ */
+static void
+kssim_update(kstat_ctl_t *kc)
+{
+	map<kid_t, kssim_kstat_t>::iterator it;
+	kstat_t **kspp, *ksp;
+	kid_t last = -1;
+
+	for (kspp = &kc->kc_chain; (ksp = *kspp) != NULL; ) {
+		if (kssim_chain.count(ksp->ks_kid) == 0) {
+			*kspp = ksp->ks_next;
+			kssim_release(ksp);
+			continue;
+		}
+
+		last = ksp->ks_kid;
+		kspp = &ksp->ks_next;
+	}
+
+	for (it = kssim_chain.upper_bound(last); it != kssim_chain.end();
+	    it++) {
+		kssim_kstat_t *kk = new kssim_kstat_t(it->second);
+
+		ksp = (kstat_t *)calloc(1, sizeof (kstat_t));
+		ksp->ks_kid = kk->kk_kid;
+		ksp->ks_crtime = kk->kk_crtime;
+		(void) strlcpy(ksp->ks_module, kk->kk_module.c_str(),
+		    KSTAT_STRLEN);
+		ksp->ks_instance = kk->kk_instance;
+		(void) strlcpy(ksp->ks_name, kk->kk_name.c_str(), KSTAT_STRLEN);
+		(void) strlcpy(ksp->ks_class, kk->kk_class.c_str(),
+		    KSTAT_STRLEN);
+		ksp->ks_type = kk->kk_type;
+		ksp->ks_data_size = kssim_datasize(kk, &ksp->ks_ndata);
+		ksp->ks_private = kk;
+		*kspp = ksp;
+		kspp = &ksp->ks_next;
+	}
+
+	kc->kc_chain_id = kssim_chainid;
+}
+
+static void
+kssim_fill(kstat_t *ksp, void *buf, double secs)
+{
+	kssim_kstat_t *kk = (kssim_kstat_t *)ksp->ks_private;
+	uint_t ticks = (uint_t)(secs * 100);
+
+	switch (kk->kk_type) {
+	case KSTAT_TYPE_NAMED: {
+		kstat_named_t *knp = (kstat_named_t *)buf;
+		char *str = (char *)(knp + kk->kk_stats.size());
+
+		for (size_t i = 0; i < kk->kk_stats.size(); i++, knp++) {
+			kssim_stat_t *kss = &kk->kk_stats[i];
+
+			(void) memset(knp, 0, sizeof (kstat_named_t));
+			(void) strlcpy(knp->name, kss->kss_name.c_str(),
+			    KSTAT_STRLEN);
+			knp->data_type = kss->kss_type;
+
+			if (kss->kss_type == KSTAT_DATA_STRING) {
+				(void) strcpy(str, kss->kss_str.c_str());
+				KSTAT_NAMED_STR_PTR(knp) = str;
+				KSTAT_NAMED_STR_BUFLEN(knp) =
+				    kss->kss_str.size() + 1;
+				str += kss->kss_str.size() + 1;
+			} else {
+				knp->value.ui64 = kss->kss_base +
+				    (uint64_t)(kss->kss_rate * secs);
+			}
+		}
+		break;
+	}
+
+	case KSTAT_TYPE_IO: {
+		kstat_io_t *kio = (kstat_io_t *)buf;
+
+		(void) memset(kio, 0, sizeof (kstat_io_t));
+		kio->nread = (u_longlong_t)(secs * kk->kk_rate * 4e6);
+		kio->nwritten = (u_longlong_t)(secs * kk->kk_rate * 2e6);
+		kio->reads = (uint_t)(secs * kk->kk_rate * 100);
+		kio->writes = (uint_t)(secs * kk->kk_rate * 50);
+		kio->rtime = (hrtime_t)(secs * kk->kk_rate * 1e8);
+		kio->wtime = (hrtime_t)(secs * 1e7);
+		kio->rlentime = kio->rtime * 2;
+		kio->wlentime = kio->wtime;
+		kio->rlastupdate = kio->wlastupdate = ksp->ks_snaptime;
+		break;
+	}
+
+	default: {
+		cpu_stat_t *cs = (cpu_stat_t *)buf;
+
+		(void) memset(cs, 0, sizeof (cpu_stat_t));
+		cs->cpu_sysinfo.cpu[CPU_IDLE] = ticks * 6 / 10;
+		cs->cpu_sysinfo.cpu[CPU_USER] = ticks * 3 / 10;
+		cs->cpu_sysinfo.cpu[CPU_KERNEL] = ticks / 10;
+		cs->cpu_sysinfo.pswitch = (uint_t)(secs * 2000);
+		cs->cpu_sysinfo.syscall = (uint_t)(secs * 5000);
+		cs->cpu_sysinfo.sysread = (uint_t)(secs * 1500);
+		cs->cpu_sysinfo.syswrite = (uint_t)(secs * 500);
+		cs->cpu_sysinfo.intr = (uint_t)(secs * 1000);
+		cs->cpu_vminfo.as_fault = (uint_t)(secs * 200);
+		break;
+	}
+	}
+}
+
+/*
+ * Whether KSSIM_FAIL says that reads of this kstat are to fail.
+ */
+static bool
+kssim_failing(const kstat_t *ksp)
+{
+	const char *fail = getenv("KSSIM_FAIL");
+	char name[3 * KSTAT_STRLEN + 16];
+	size_t len;
+
+	if (fail == NULL)
+		return (false);
+
+	len = snprintf(name, sizeof (name), "%s:%d:%s", ksp->ks_module,
+	    ksp->ks_instance, ksp->ks_name);
+
+	for (const char *p = fail; (p = strstr(p, name)) != NULL; p += len) {
+		if ((p == fail || p[-1] == ',') &&
+		    (p[len] == '\0' || p[len] == ','))
+			return (true);
+	}
+
+	return (false);
+}
+
+/*
+ * The time at which to read, as a snaptime and as seconds since the chain was
+ * made:  now, unless KSSIM_TIME has stopped the clock.
+ */
+static double
+kssim_clock(hrtime_t *snaptime)
+{
+	const char *time = getenv("KSSIM_TIME");
+	double secs;
+
+	if (time == NULL) {
+		*snaptime = gethrtime();
+		return ((*snaptime - kssim_epoch) / 1e9);
+	}
+
+	secs = atof(time);
+	*snaptime = kssim_epoch + (hrtime_t)(secs * 1e9);
+
+	return (secs);
+}
+
+extern "C" kstat_ctl_t *
+kstat_open(void)
+{
+	kstat_ctl_t *kc;
+
+	(void) pthread_once(&kssim_once, kssim_init);
+
+	if ((kc = (kstat_ctl_t *)calloc(1, sizeof (kstat_ctl_t))) == NULL)
+		return (NULL);
+
+	kc->kc_kd = -1;
+	(void) pthread_mutex_lock(&kssim_lock);
+	kssim_update(kc);
+	(void) pthread_mutex_unlock(&kssim_lock);
+
+	return (kc);
+}
+
+extern "C" int
+kstat_close(kstat_ctl_t *kc)
+{
+	kstat_t *ksp, *next;
+
+	for (ksp = kc->kc_chain; ksp != NULL; ksp = next) {
+		next = ksp->ks_next;
+		kssim_release(ksp);
+	}
+
+	free(kc);
+
+	return (0);
+}
+
+extern "C" kid_t
+kstat_chain_update(kstat_ctl_t *kc)
+{
+	kid_t kid = 0;
+
+	(void) pthread_mutex_lock(&kssim_lock);
+	kssim_churn();
+
+	if (kc->kc_chain_id != kssim_chainid) {
+		kssim_update(kc);
+		kid = kc->kc_chain_id;
+	}
+
+	(void) pthread_mutex_unlock(&kssim_lock);
+
+	return (kid);
+}
+
+/*
+ * Answer KSTAT_IOC_CHAIN_ID with our chain ID, making any changes that are
+ * due by the clock (but not those that are made by each update), and pass
+ * every other request on.
+ */
+extern "C" int
+ioctl(int fd, int request, ...)
+{
+	static int (*next)(int, int, ...);
+	va_list ap;
+	void *arg;
+	kid_t kid;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	/*
+	 * <sys/kstat.h> doesn't parenthesize the request's definition.
+	 */
+	if (request == (KSTAT_IOC_CHAIN_ID)) {
+		(void) pthread_once(&kssim_once, kssim_init);
+		(void) pthread_mutex_lock(&kssim_lock);
+
+		if (!kssim_churncall)
+			kssim_churn();
+
+		kid = kssim_chainid;
+		(void) pthread_mutex_unlock(&kssim_lock);
+
+		return (kid);
+	}
+
+	if (next == NULL &&
+	    (next = (int (*)(int, int, ...))dlsym(RTLD_NEXT, "ioctl")) == NULL) {
+		errno = ENOSYS;
+		return (-1);
+	}
+
+	return (next(fd, request, arg));
+}
+
+extern "C" kid_t
+kstat_read(kstat_ctl_t *kc, kstat_t *ksp, void *buf)
+{
+	kid_t kid;
+
+	(void) pthread_mutex_lock(&kssim_lock);
+	kid = kssim_chainid;
+
+	if (kssim_chain.count(ksp->ks_kid) == 0) {
+		(void) pthread_mutex_unlock(&kssim_lock);
+		errno = ENXIO;
+		return (-1);
+	}
+
+	(void) pthread_mutex_unlock(&kssim_lock);
+
+	if (kssim_failing(ksp)) {
+		errno = EIO;
+		return (-1);
+	}
+
+	if (buf == NULL) {
+		if (ksp->ks_data == NULL &&
+		    (ksp->ks_data = malloc(ksp->ks_data_size)) == NULL) {
+			errno = ENOMEM;
+			return (-1);
+		}
+
+		buf = ksp->ks_data;
+	}
+
+	kssim_fill(ksp, buf, kssim_clock(&ksp->ks_snaptime));
+
+	return (kid);
+}
+
+extern "C" kstat_t *
+kstat_lookup(kstat_ctl_t *kc, char *module, int instance, char *name)
+{
+	kstat_t *ksp;
+
+	for (ksp = kc->kc_chain; ksp != NULL; ksp = ksp->ks_next) {
+		if ((module == NULL || strcmp(ksp->ks_module, module) == 0) &&
+		    (instance == -1 || ksp->ks_instance == instance) &&
+		    (name == NULL || strcmp(ksp->ks_name, name) == 0))
+			return (ksp);
+	}
+
+	errno = ENOENT;
+
+	return (NULL);
+}
+
+extern "C" void *
+kstat_data_lookup(kstat_t *ksp, char *name)
+{
+	kstat_named_t *knp = (kstat_named_t *)ksp->ks_data;
+
+	if (ksp->ks_type != KSTAT_TYPE_NAMED || knp == NULL) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	for (uint_t i = 0; i < ksp->ks_ndata; i++, knp++) {
+		if (strcmp(knp->name, name) == 0)
+			return (knp);
+	}
+
+	errno = ENOENT;
+
+	return (NULL);
+}
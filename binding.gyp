@@ -2,10 +2,27 @@
   'targets': [
     {
       'target_name': 'kstat',
-      'sources': [ 'kstat.cc' ],
+      'sources': [ 'kstat.cc', 'ksdecode.cc', 'ksarrow.cc' ],
+      'libraries': [ '-lkstat', '-lrt' ],
+      'cflags_cc': [ '-Wno-write-strings' ],
+      'cflags_cc!': [ '-fno-exceptions' ],
+    },
+    {
+      'target_name': 'ksdump',
+      'type': 'executable',
+      'sources': [ 'ksdump.cc', 'ksdecode.cc' ],
       'libraries': [ '-lkstat' ],
       'cflags_cc': [ '-Wno-write-strings' ],
       'cflags_cc!': [ '-fno-exceptions' ],
+    },
+    {
+      'target_name': 'kssim',
+      'type': 'loadable_module',
+      'product_extension': 'so',
+      'sources': [ 'bench/kssim.cc' ],
+      'libraries': [ '-lpthread' ],
+      'cflags_cc': [ '-Wno-write-strings' ],
+      'cflags_cc!': [ '-fno-exceptions' ],
     }
   ]
 }
@@ -11,18 +11,43 @@ var app = express();
 var staticfilter = {};
 var staticreader = new kstat.Reader(staticfilter);
 
+// prepared handles for the kstats asked for by getKstat(), so that repeated
+// requests for the same kstat don't have to look it up again; only handles
+// for kstats that exist are kept, and only the most recently used of them
+var handles = new Map();
+var maxhandles = 512;
+
 // Routes
 
 // new jkstat getKstat() interface
 app.get('/kstat/get/:module/:instance/:name', function(req, res){
 
-        var filter = {};
+        var key = req.params.module + ':' + req.params.instance + ':' +
+            req.params.name;
+        var handle = handles.get(key);
 
-        filter["module"] = req.params.module;
-        filter["name"] = req.params.name;
-	filter["instance"] = parseInt(req.params.instance, 10);
+        if (handle === undefined) {
+                var filter = {};
+
+                filter["module"] = req.params.module;
+                filter["name"] = req.params.name;
+                filter["instance"] = parseInt(req.params.instance, 10);
+
+                handle = staticreader.prepare(filter);
+        }
+
+	var results = handle.read();
+
+        // keep the handle as the most recently used, or drop it if its
+        // kstat doesn't exist (or no longer does)
+        handles.delete(key);
 
-	var results = staticreader.getkstat(filter);
+        if (!results.hasOwnProperty('error')) {
+                handles.set(key, handle);
+
+                if (handles.size > maxhandles)
+                        handles.delete(handles.keys().next().value);
+        }
 
         // Set response header to enable cross-site requests
         res.header('Access-Control-Allow-Origin', '*');
@@ -100,7 +125,10 @@ app.get('/kstat/getkcid', function(req, res){
 
 });
 
-// Only listen on $ node app.js
+// Export the app for those that run it themselves (such as bench/jkstat.js);
+// only listen on $ node app.js
+
+module.exports = app;
 
 if (!module.parent) {
   var server = app.listen(3000);
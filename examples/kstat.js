@@ -48,7 +48,11 @@ var fixed = function (str, len) {
 
 var reader = new kstat.Reader(stats);
 
-var data = reader.read();
+/*
+ * The data of each kstat is only decoded if we look at it, which we don't
+ * unless "-v" was given.
+ */
+var data = reader.read({}, { lazy: true });
 
 var fields = {
 	module: 20,
@@ -0,0 +1,556 @@
+/*
+ * Arrow IPC export; see ksarrow.h.  The format is Arrow's streaming format:
+ * each message is a continuation marker, the length of its metadata, the
+ * metadata itself (a FlatBuffer) and the message body, and the stream ends
+ * with a marker and a length of zero.  Nothing here may depend on Node.
+ */
+#include <string.h>
+#include "ksdecode.h"
+#include "ksarrow.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+#define	KSR_ARROW_CONTINUE	0xffffffffU
+#define	KSR_ARROW_V5		4	/* MetadataVersion.V5 */
+
+/*
+ * Members of the unions in Arrow's Message.fbs and Schema.fbs.
+ */
+#define	KSR_ARROW_SCHEMA	1	/* MessageHeader.Schema */
+#define	KSR_ARROW_RECORDBATCH	3	/* MessageHeader.RecordBatch */
+#define	KSR_ARROW_INT		2	/* Type.Int */
+#define	KSR_ARROW_FLOAT		3	/* Type.FloatingPoint */
+#define	KSR_ARROW_STRING	5	/* Type.Utf8 */
+#define	KSR_ARROW_DOUBLEPREC	2	/* Precision.DOUBLE */
+
+/*
+ * A minimal FlatBuffer writer, enough for Arrow's metadata.  FlatBuffers are
+ * usually built back to front, but offsets to other objects need only point
+ * forward, so we build front to back instead:  each table is written before
+ * the objects that it refers to, and its offsets to them are patched in as
+ * they are written.  FlatBuffers are little-endian whatever the host.
+ */
+#define	KSR_FB_NONE		((size_t)-1)
+
+typedef struct ksr_fbfield {
+	int kff_id;
+	size_t kff_size;		/* 1, 2, 4 or 8 bytes */
+	uint64_t kff_value;		/* ignored for an offset */
+	bool kff_offset;		/* an offset, patched when linked */
+	size_t kff_at;			/* where the field was written */
+} ksr_fbfield_t;
+
+class ksr_fbb {
+public:
+	vector<char> fb_buf;
+
+	size_t
+	pos() const
+	{
+		return (fb_buf.size());
+	}
+
+	/*
+	 * Pad until the position is "off" bytes short of a multiple of "n".
+	 */
+	void
+	align(size_t n, size_t off = 0)
+	{
+		while ((fb_buf.size() + off) % n != 0)
+			fb_buf.push_back(0);
+	}
+
+	size_t
+	put(uint64_t value, size_t size)
+	{
+		size_t at = pos();
+
+		for (size_t i = 0; i < size; i++)
+			fb_buf.push_back((char)(value >> (8 * i)));
+
+		return (at);
+	}
+
+	/*
+	 * Point the offset at "from" to the current position.
+	 */
+	void
+	link(size_t from)
+	{
+		uint32_t off;
+
+		if (from == KSR_FB_NONE)
+			return;
+
+		off = pos() - from;
+
+		for (size_t i = 0; i < 4; i++)
+			fb_buf[from + i] = (char)(off >> (8 * i));
+	}
+
+	size_t table(ksr_fbfield_t *, size_t, size_t);
+	void str(const char *, size_t);
+	size_t offsets(size_t, size_t);
+	void structs(const vector<uint64_t>&, size_t);
+};
+
+/*
+ * Write a table, linking it from "from", and return where it starts.  The
+ * table's vtable precedes it; its fields are laid out largest first, so that
+ * each is aligned with no more padding than the first needs.
+ */
+size_t
+ksr_fbb::table(ksr_fbfield_t *fields, size_t nfields, size_t from)
+{
+	vector<size_t> order, offset(nfields);
+	size_t i, j, off = 4, slots = 0, maxalign = 4, start, vtable;
+
+	for (i = 0; i < nfields; i++) {
+		for (j = 0; j < order.size() &&
+		    fields[order[j]].kff_size >= fields[i].kff_size; j++)
+			continue;
+
+		order.insert(order.begin() + j, i);
+
+		if (fields[i].kff_id + 1 > (int)slots)
+			slots = fields[i].kff_id + 1;
+
+		if (fields[i].kff_size > maxalign)
+			maxalign = fields[i].kff_size;
+	}
+
+	for (i = 0; i < order.size(); i++) {
+		ksr_fbfield_t *f = &fields[order[i]];
+
+		off = (off + f->kff_size - 1) & ~(f->kff_size - 1);
+		offset[order[i]] = off;
+		off += f->kff_size;
+	}
+
+	align(2);
+	vtable = put(4 + 2 * slots, 2);
+	put(off, 2);
+
+	for (i = 0; i < slots; i++) {
+		for (j = 0; j < nfields && fields[j].kff_id != (int)i; j++)
+			continue;
+
+		put(j < nfields ? offset[j] : 0, 2);
+	}
+
+	align(maxalign);
+	start = pos();
+	link(from);
+	put(start - vtable, 4);
+
+	for (i = 0; i < order.size(); i++) {
+		ksr_fbfield_t *f = &fields[order[i]];
+
+		while (pos() - start < offset[order[i]])
+			fb_buf.push_back(0);
+
+		f->kff_at = put(f->kff_offset ? 0 : f->kff_value, f->kff_size);
+	}
+
+	return (start);
+}
+
+void
+ksr_fbb::str(const char *s, size_t from)
+{
+	size_t len = strlen(s);
+
+	align(4);
+	link(from);
+	put(len, 4);
+	fb_buf.insert(fb_buf.end(), s, s + len + 1);
+}
+
+/*
+ * Write a vector of offsets, linking it from "from", and return where the
+ * first of them is; each is linked in turn as its object is written.
+ */
+size_t
+ksr_fbb::offsets(size_t n, size_t from)
+{
+	size_t first;
+
+	align(4);
+	link(from);
+	put(n, 4);
+	first = pos();
+
+	for (size_t i = 0; i < n; i++)
+		put(0, 4);
+
+	return (first);
+}
+
+/*
+ * Write a vector of structs of two longs (all that Arrow's metadata needs),
+ * given as a flat vector of the longs.
+ */
+void
+ksr_fbb::structs(const vector<uint64_t>& longs, size_t from)
+{
+	align(8, 4);
+	link(from);
+	put(longs.size() / 2, 4);
+
+	for (size_t i = 0; i < longs.size(); i++)
+		put(longs[i], 8);
+}
+
+/*
+ * Frame a message:  the continuation marker, the length of the metadata
+ * (padded so that the body is 8-byte aligned), the metadata and the body.
+ */
+static void
+ksr_arrow_message(vector<char> *out, const ksr_fbb& fbb,
+    const vector<char>& body)
+{
+	size_t len = (fbb.fb_buf.size() + 7) & ~(size_t)7;
+	ksr_fbb prefix;
+
+	prefix.put(KSR_ARROW_CONTINUE, 4);
+	prefix.put(len, 4);
+	out->insert(out->end(), prefix.fb_buf.begin(), prefix.fb_buf.end());
+	out->insert(out->end(), fbb.fb_buf.begin(), fbb.fb_buf.end());
+	out->resize(out->size() + len - fbb.fb_buf.size(), 0);
+	out->insert(out->end(), body.begin(), body.end());
+}
+
+/*
+ * Start a message with the given header; the offset to the header is
+ * returned through the fields, and the caller writes the header itself.
+ */
+static void
+ksr_arrow_start(ksr_fbb *fbb, ksr_fbfield_t *msg, int type, uint64_t bodylen)
+{
+	ksr_fbfield_t fields[] = {
+		{ 0, 2, KSR_ARROW_V5, false, 0 },	/* version */
+		{ 1, 1, (uint64_t)type, false, 0 },	/* header_type */
+		{ 2, 4, 0, true, 0 },			/* header */
+		{ 3, 8, bodylen, false, 0 },		/* bodyLength */
+	};
+
+	fbb->put(0, 4);
+	fbb->table(fields, 4, 0);
+	*msg = fields[2];
+}
+
+/*
+ * Add a buffer to a message body, padded to 8 bytes, and note its offset and
+ * length.
+ */
+static void
+ksr_arrow_buffer(vector<char> *body, vector<uint64_t> *buffers,
+    const void *data, size_t len)
+{
+	buffers->push_back(body->size());
+	buffers->push_back(len);
+	body->insert(body->end(), (const char *)data, (const char *)data + len);
+	body->resize((body->size() + 7) & ~(size_t)7, 0);
+}
+
+/*
+ * Statistics are collected before they are added to the columns, so that a
+ * kstat that fails to decode part way through adds nothing.
+ */
+typedef struct ksr_arrowstat {
+	string kas_name;
+	bool kas_text;
+	double kas_value;
+	string kas_str;
+} ksr_arrowstat_t;
+
+class ksr_arrowrow : public ksr_visitor {
+public:
+	vector<ksr_arrowstat_t> kar_stats;
+
+	void
+	number(const char *name, double value)
+	{
+		ksr_arrowstat_t kas = { name, false, value, "" };
+
+		kar_stats.push_back(kas);
+	}
+
+	void
+	text(const char *name, const char *value)
+	{
+		ksr_arrowstat_t kas = { name, true, 0, value };
+
+		kar_stats.push_back(kas);
+	}
+};
+
+static void
+ksr_arrow_null(ksr_arrowcol_t *col)
+{
+	col->kac_valid.push_back(0);
+	col->kac_nulls++;
+
+	if (col->kac_type == KSR_ARROW_UTF8)
+		col->kac_offsets.push_back(col->kac_data.size());
+	else if (col->kac_type == KSR_ARROW_DOUBLE)
+		col->kac_numbers.push_back(0);
+	else
+		col->kac_ints.push_back(0);
+}
+
+static void
+ksr_arrow_text(ksr_arrowcol_t *col, const string& value)
+{
+	col->kac_valid.push_back(1);
+	col->kac_data += value;
+	col->kac_offsets.push_back(col->kac_data.size());
+}
+
+ksr_arrowbatch::ksr_arrowbatch() : kab_rows(0)
+{
+	(void) this->column("module", KSR_ARROW_UTF8);
+	(void) this->column("instance", KSR_ARROW_INT32);
+	(void) this->column("snaptime", KSR_ARROW_INT64);
+}
+
+/*
+ * Return the named column, adding it (with a null for each row so far) if
+ * this is the first we've seen of it.
+ */
+ksr_arrowcol_t *
+ksr_arrowbatch::column(const char *name, ksr_arrowtype_t type)
+{
+	map<string, size_t>::iterator it = kab_index.find(name);
+	ksr_arrowcol_t *col;
+
+	if (it != kab_index.end())
+		return (&kab_cols[it->second]);
+
+	kab_index[name] = kab_cols.size();
+	kab_cols.push_back(ksr_arrowcol_t());
+	col = &kab_cols.back();
+	col->kac_name = name;
+	col->kac_type = type;
+	col->kac_nulls = 0;
+	col->kac_offsets.push_back(0);
+
+	for (size_t i = 0; i < kab_rows; i++)
+		ksr_arrow_null(col);
+
+	return (col);
+}
+
+/*
+ * Add a kstat that has been read as a row.  This returns -1, having added
+ * nothing, if the kstat can't be decoded; as for ksr_decode(), *bad is then
+ * the named statistic whose type isn't recognized, if that's why.
+ */
+int
+ksr_arrowbatch::add(kstat_t *ksp, kstat_named_t **bad)
+{
+	ksr_arrowrow row;
+	ksr_arrowcol_t *col;
+	size_t i;
+
+	if (ksr_decode(ksp, &row, bad) == -1)
+		return (-1);
+
+	ksr_arrow_text(this->column("module", KSR_ARROW_UTF8), ksp->ks_module);
+
+	col = this->column("instance", KSR_ARROW_INT32);
+	col->kac_valid.push_back(1);
+	col->kac_ints.push_back(ksp->ks_instance);
+
+	col = this->column("snaptime", KSR_ARROW_INT64);
+	col->kac_valid.push_back(1);
+	col->kac_ints.push_back(ksp->ks_snaptime);
+
+	for (i = 0; i < row.kar_stats.size(); i++) {
+		ksr_arrowstat_t *kas = &row.kar_stats[i];
+
+		col = this->column(kas->kas_name.c_str(),
+		    kas->kas_text ? KSR_ARROW_UTF8 : KSR_ARROW_DOUBLE);
+
+		/*
+		 * If we've already filled this column for this row (as we
+		 * will have for a statistic that repeats a name), or if the
+		 * column holds the other kind of value, leave it be.
+		 */
+		if (col->kac_valid.size() > kab_rows ||
+		    (col->kac_type == KSR_ARROW_UTF8) != kas->kas_text)
+			continue;
+
+		if (kas->kas_text) {
+			ksr_arrow_text(col, kas->kas_str);
+		} else {
+			col->kac_valid.push_back(1);
+			col->kac_numbers.push_back(kas->kas_value);
+		}
+	}
+
+	for (i = 0; i < kab_cols.size(); i++) {
+		if (kab_cols[i].kac_valid.size() == kab_rows)
+			ksr_arrow_null(&kab_cols[i]);
+	}
+
+	kab_rows++;
+
+	return (0);
+}
+
+void
+ksr_arrowbatch::schema(vector<char> *out) const
+{
+	uint16_t order = 1;
+	ksr_fbfield_t msg;
+	size_t first, i;
+	ksr_fbb fbb;
+
+	ksr_arrow_start(&fbb, &msg, KSR_ARROW_SCHEMA, 0);
+
+	ksr_fbfield_t schema[] = {
+		/* endianness:  Little (0) or Big (1) */
+		{ 0, 2, *(uint8_t *)&order == 1 ? 0ULL : 1ULL, false, 0 },
+		{ 1, 4, 0, true, 0 },			/* fields */
+	};
+
+	fbb.table(schema, 2, msg.kff_at);
+	first = fbb.offsets(kab_cols.size(), schema[1].kff_at);
+
+	for (i = 0; i < kab_cols.size(); i++) {
+		const ksr_arrowcol_t *col = &kab_cols[i];
+		size_t ntype;
+		int t;
+
+		ksr_fbfield_t type[] = {
+			{ 0, 4, 0, false, 0 },		/* bitWidth, precision */
+			{ 1, 1, 1, false, 0 },		/* is_signed */
+		};
+
+		switch (col->kac_type) {
+		case KSR_ARROW_INT32:
+		case KSR_ARROW_INT64:
+			t = KSR_ARROW_INT;
+			type[0].kff_value =
+			    col->kac_type == KSR_ARROW_INT32 ? 32 : 64;
+			ntype = 2;
+			break;
+
+		case KSR_ARROW_DOUBLE:
+			t = KSR_ARROW_FLOAT;
+			type[0].kff_size = 2;
+			type[0].kff_value = KSR_ARROW_DOUBLEPREC;
+			ntype = 1;
+			break;
+
+		default:
+			t = KSR_ARROW_STRING;
+			ntype = 0;
+			break;
+		}
+
+		ksr_fbfield_t field[] = {
+			{ 0, 4, 0, true, 0 },			/* name */
+			{ 1, 1, 1, false, 0 },			/* nullable */
+			{ 2, 1, (uint64_t)t, false, 0 },	/* type_type */
+			{ 3, 4, 0, true, 0 },			/* type */
+			{ 5, 4, 0, true, 0 },			/* children */
+		};
+
+		fbb.table(field, 5, first + 4 * i);
+		fbb.str(col->kac_name.c_str(), field[0].kff_at);
+		fbb.table(type, ntype, field[3].kff_at);
+		(void) fbb.offsets(0, field[4].kff_at);
+	}
+
+	ksr_arrow_message(out, fbb, vector<char>());
+}
+
+void
+ksr_arrowbatch::batch(vector<char> *out) const
+{
+	vector<uint64_t> nodes, buffers;
+	vector<char> body;
+	ksr_fbfield_t msg;
+	ksr_fbb fbb;
+	size_t i, r;
+
+	for (i = 0; i < kab_cols.size(); i++) {
+		const ksr_arrowcol_t *col = &kab_cols[i];
+		vector<uint8_t> valid((kab_rows + 7) / 8, 0);
+
+		nodes.push_back(kab_rows);
+		nodes.push_back(col->kac_nulls);
+
+		for (r = 0; r < kab_rows; r++) {
+			if (col->kac_valid[r])
+				valid[r / 8] |= 1 << (r % 8);
+		}
+
+		ksr_arrow_buffer(&body, &buffers, valid.data(), valid.size());
+
+		switch (col->kac_type) {
+		case KSR_ARROW_INT32: {
+			vector<int32_t> ints(col->kac_ints.begin(),
+			    col->kac_ints.end());
+
+			ksr_arrow_buffer(&body, &buffers, ints.data(),
+			    ints.size() * sizeof (int32_t));
+			break;
+		}
+
+		case KSR_ARROW_INT64:
+			ksr_arrow_buffer(&body, &buffers, col->kac_ints.data(),
+			    col->kac_ints.size() * sizeof (int64_t));
+			break;
+
+		case KSR_ARROW_DOUBLE:
+			ksr_arrow_buffer(&body, &buffers,
+			    col->kac_numbers.data(),
+			    col->kac_numbers.size() * sizeof (double));
+			break;
+
+		default:
+			ksr_arrow_buffer(&body, &buffers,
+			    col->kac_offsets.data(),
+			    col->kac_offsets.size() * sizeof (int32_t));
+			ksr_arrow_buffer(&body, &buffers, col->kac_data.data(),
+			    col->kac_data.size());
+			break;
+		}
+	}
+
+	ksr_arrow_start(&fbb, &msg, KSR_ARROW_RECORDBATCH, body.size());
+
+	ksr_fbfield_t batch[] = {
+		{ 0, 8, kab_rows, false, 0 },		/* length */
+		{ 1, 4, 0, true, 0 },			/* nodes */
+		{ 2, 4, 0, true, 0 },			/* buffers */
+	};
+
+	fbb.table(batch, 3, msg.kff_at);
+	fbb.structs(nodes, batch[1].kff_at);
+	fbb.structs(buffers, batch[2].kff_at);
+
+	ksr_arrow_message(out, fbb, body);
+}
+
+/*
+ * Write the batch as an IPC stream:  its schema, a record batch holding all of
+ * its rows, and the end-of-stream marker.
+ */
+void
+ksr_arrowbatch::write(vector<char> *out) const
+{
+	ksr_fbb eos;
+
+	this->schema(out);
+	this->batch(out);
+
+	eos.put(KSR_ARROW_CONTINUE, 4);
+	eos.put(0, 4);
+	out->insert(out->end(), eos.fb_buf.begin(), eos.fb_buf.end());
+}
@@ -0,0 +1,59 @@
+/*
+ * Export of kstats as Apache Arrow IPC streams.  A batch collects kstats that
+ * have been read (in practice, those of one name) as the rows of a table, and
+ * writes them out as a stream of one schema and one record batch, which
+ * columnar tools can load without converting anything row by row.  Like the
+ * decoding core that it's built on, this doesn't depend on Node.
+ */
+#ifndef _KSARROW_H
+#define	_KSARROW_H
+
+#include <kstat.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Every table begins with the kstat's module, instance and snaptime; the
+ * statistics follow, in the order in which they were first seen.  Numbers
+ * are doubles, as read() returns them, and strings are UTF-8.  A kstat that
+ * lacks a statistic that another one has (or that has a string where the
+ * other has a number) has a null there.
+ */
+typedef enum ksr_arrowtype {
+	KSR_ARROW_INT32,
+	KSR_ARROW_INT64,
+	KSR_ARROW_DOUBLE,
+	KSR_ARROW_UTF8
+} ksr_arrowtype_t;
+
+typedef struct ksr_arrowcol {
+	std::string kac_name;
+	ksr_arrowtype_t kac_type;
+	size_t kac_nulls;
+	std::vector<uint8_t> kac_valid;		/* one per row */
+	std::vector<int64_t> kac_ints;
+	std::vector<double> kac_numbers;
+	std::vector<int32_t> kac_offsets;	/* one more than the rows */
+	std::string kac_data;
+} ksr_arrowcol_t;
+
+class ksr_arrowbatch {
+public:
+	ksr_arrowbatch();
+	int add(kstat_t *, kstat_named_t **);
+	void write(std::vector<char> *) const;
+	size_t rows() const { return (kab_rows); }
+
+private:
+	ksr_arrowcol_t *column(const char *, ksr_arrowtype_t);
+	void schema(std::vector<char> *) const;
+	void batch(std::vector<char> *) const;
+
+	size_t kab_rows;
+	std::vector<ksr_arrowcol_t> kab_cols;
+	std::map<std::string, size_t> kab_index;
+};
+
+#endif	/* _KSARROW_H */
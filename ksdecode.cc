@@ -0,0 +1,672 @@
+/*
+ * The kstat decoding core; see ksdecode.h.  Nothing here may depend on Node,
+ * as it's also linked into ksdump(1).
+ */
+#include <string.h>
+#include <assert.h>
+#include <nfs/nfs_clnt.h>
+#include <sys/dnlc.h>
+#include <sys/sysinfo.h>
+#include <sys/var.h>
+#ifdef	__sparc
+#include <sys/vmmeter.h>
+#endif
+#include <type_traits>
+#include "ksdecode.h"
+
+using std::string;
+using std::vector;
+
+const char *ksr_fieldtypes[] = {
+	"int32", "uint32", "int64", "uint64", "string"
+};
+
+/*
+ * The field tables are constant expressions, built at compile time from the
+ * structures themselves:  each field's offset, size and type are deduced from
+ * its member, and a member of any other width won't compile.
+ */
+template <typename T> struct ksr_typeof {
+	static_assert(sizeof (T) == 4 || sizeof (T) == 8,
+	    "raw kstat fields must be 32 or 64 bits wide");
+	static constexpr ksr_fieldtype_t type = std::is_signed<T>::value ?
+	    (sizeof (T) == 8 ? KSR_INT64 : KSR_INT32) :
+	    (sizeof (T) == 8 ? KSR_UINT64 : KSR_UINT32);
+};
+
+template <size_t N> struct ksr_typeof<char[N]> {
+	static constexpr ksr_fieldtype_t type = KSR_STRING;
+};
+
+#define	KSR_FIELD(s, name, member) { name, offsetof(s, member),		\
+	sizeof (((s *)0)->member), ksr_typeof<std::remove_reference<	\
+	decltype(((s *)0)->member)>::type>::type }
+
+static constexpr ksr_field_t ksr_cpu_stat_fields[] = {
+	KSR_FIELD(cpu_stat_t, "idle", cpu_sysinfo.cpu[CPU_IDLE]),
+	KSR_FIELD(cpu_stat_t, "user", cpu_sysinfo.cpu[CPU_USER]),
+	KSR_FIELD(cpu_stat_t, "kernel", cpu_sysinfo.cpu[CPU_KERNEL]),
+	KSR_FIELD(cpu_stat_t, "wait", cpu_sysinfo.cpu[CPU_WAIT]),
+	KSR_FIELD(cpu_stat_t, "wait_io", cpu_sysinfo.wait[W_IO]),
+	KSR_FIELD(cpu_stat_t, "wait_swap", cpu_sysinfo.wait[W_SWAP]),
+	KSR_FIELD(cpu_stat_t, "wait_pio", cpu_sysinfo.wait[W_PIO]),
+	KSR_FIELD(cpu_stat_t, "bread", cpu_sysinfo.bread),
+	KSR_FIELD(cpu_stat_t, "bwrite", cpu_sysinfo.bwrite),
+	KSR_FIELD(cpu_stat_t, "lread", cpu_sysinfo.lread),
+	KSR_FIELD(cpu_stat_t, "lwrite", cpu_sysinfo.lwrite),
+	KSR_FIELD(cpu_stat_t, "phread", cpu_sysinfo.phread),
+	KSR_FIELD(cpu_stat_t, "phwrite", cpu_sysinfo.phwrite),
+	KSR_FIELD(cpu_stat_t, "pswitch", cpu_sysinfo.pswitch),
+	KSR_FIELD(cpu_stat_t, "trap", cpu_sysinfo.trap),
+	KSR_FIELD(cpu_stat_t, "intr", cpu_sysinfo.intr),
+	KSR_FIELD(cpu_stat_t, "syscall", cpu_sysinfo.syscall),
+	KSR_FIELD(cpu_stat_t, "sysread", cpu_sysinfo.sysread),
+	KSR_FIELD(cpu_stat_t, "syswrite", cpu_sysinfo.syswrite),
+	KSR_FIELD(cpu_stat_t, "sysfork", cpu_sysinfo.sysfork),
+	KSR_FIELD(cpu_stat_t, "sysvfork", cpu_sysinfo.sysvfork),
+	KSR_FIELD(cpu_stat_t, "sysexec", cpu_sysinfo.sysexec),
+	KSR_FIELD(cpu_stat_t, "readch", cpu_sysinfo.readch),
+	KSR_FIELD(cpu_stat_t, "writech", cpu_sysinfo.writech),
+	KSR_FIELD(cpu_stat_t, "rcvint", cpu_sysinfo.rcvint),
+	KSR_FIELD(cpu_stat_t, "xmtint", cpu_sysinfo.xmtint),
+	KSR_FIELD(cpu_stat_t, "mdmint", cpu_sysinfo.mdmint),
+	KSR_FIELD(cpu_stat_t, "rawch", cpu_sysinfo.rawch),
+	KSR_FIELD(cpu_stat_t, "canch", cpu_sysinfo.canch),
+	KSR_FIELD(cpu_stat_t, "outch", cpu_sysinfo.outch),
+	KSR_FIELD(cpu_stat_t, "msg", cpu_sysinfo.msg),
+	KSR_FIELD(cpu_stat_t, "sema", cpu_sysinfo.sema),
+	KSR_FIELD(cpu_stat_t, "namei", cpu_sysinfo.namei),
+	KSR_FIELD(cpu_stat_t, "ufsiget", cpu_sysinfo.ufsiget),
+	KSR_FIELD(cpu_stat_t, "ufsdirblk", cpu_sysinfo.ufsdirblk),
+	KSR_FIELD(cpu_stat_t, "ufsipage", cpu_sysinfo.ufsipage),
+	KSR_FIELD(cpu_stat_t, "ufsinopage", cpu_sysinfo.ufsinopage),
+	KSR_FIELD(cpu_stat_t, "inodeovf", cpu_sysinfo.inodeovf),
+	KSR_FIELD(cpu_stat_t, "fileovf", cpu_sysinfo.fileovf),
+	KSR_FIELD(cpu_stat_t, "procovf", cpu_sysinfo.procovf),
+	KSR_FIELD(cpu_stat_t, "intrthread", cpu_sysinfo.intrthread),
+	KSR_FIELD(cpu_stat_t, "intrblk", cpu_sysinfo.intrblk),
+	KSR_FIELD(cpu_stat_t, "idlethread", cpu_sysinfo.idlethread),
+	KSR_FIELD(cpu_stat_t, "inv_swtch", cpu_sysinfo.inv_swtch),
+	KSR_FIELD(cpu_stat_t, "nthreads", cpu_sysinfo.nthreads),
+	KSR_FIELD(cpu_stat_t, "cpumigrate", cpu_sysinfo.cpumigrate),
+	KSR_FIELD(cpu_stat_t, "xcalls", cpu_sysinfo.xcalls),
+	KSR_FIELD(cpu_stat_t, "mutex_adenters", cpu_sysinfo.mutex_adenters),
+	KSR_FIELD(cpu_stat_t, "rw_rdfails", cpu_sysinfo.rw_rdfails),
+	KSR_FIELD(cpu_stat_t, "rw_wrfails", cpu_sysinfo.rw_wrfails),
+	KSR_FIELD(cpu_stat_t, "modload", cpu_sysinfo.modload),
+	KSR_FIELD(cpu_stat_t, "modunload", cpu_sysinfo.modunload),
+	KSR_FIELD(cpu_stat_t, "bawrite", cpu_sysinfo.bawrite),
+#ifdef	STATISTICS	/* see header file */
+	KSR_FIELD(cpu_stat_t, "rw_enters", cpu_sysinfo.rw_enters),
+	KSR_FIELD(cpu_stat_t, "win_uo_cnt", cpu_sysinfo.win_uo_cnt),
+	KSR_FIELD(cpu_stat_t, "win_uu_cnt", cpu_sysinfo.win_uu_cnt),
+	KSR_FIELD(cpu_stat_t, "win_so_cnt", cpu_sysinfo.win_so_cnt),
+	KSR_FIELD(cpu_stat_t, "win_su_cnt", cpu_sysinfo.win_su_cnt),
+	KSR_FIELD(cpu_stat_t, "win_suo_cnt", cpu_sysinfo.win_suo_cnt),
+#endif
+	KSR_FIELD(cpu_stat_t, "iowait", cpu_syswait.iowait),
+	KSR_FIELD(cpu_stat_t, "swap", cpu_syswait.swap),
+	KSR_FIELD(cpu_stat_t, "physio", cpu_syswait.physio),
+	KSR_FIELD(cpu_stat_t, "pgrec", cpu_vminfo.pgrec),
+	KSR_FIELD(cpu_stat_t, "pgfrec", cpu_vminfo.pgfrec),
+	KSR_FIELD(cpu_stat_t, "pgin", cpu_vminfo.pgin),
+	KSR_FIELD(cpu_stat_t, "pgpgin", cpu_vminfo.pgpgin),
+	KSR_FIELD(cpu_stat_t, "pgout", cpu_vminfo.pgout),
+	KSR_FIELD(cpu_stat_t, "pgpgout", cpu_vminfo.pgpgout),
+	KSR_FIELD(cpu_stat_t, "swapin", cpu_vminfo.swapin),
+	KSR_FIELD(cpu_stat_t, "pgswapin", cpu_vminfo.pgswapin),
+	KSR_FIELD(cpu_stat_t, "swapout", cpu_vminfo.swapout),
+	KSR_FIELD(cpu_stat_t, "pgswapout", cpu_vminfo.pgswapout),
+	KSR_FIELD(cpu_stat_t, "zfod", cpu_vminfo.zfod),
+	KSR_FIELD(cpu_stat_t, "dfree", cpu_vminfo.dfree),
+	KSR_FIELD(cpu_stat_t, "scan", cpu_vminfo.scan),
+	KSR_FIELD(cpu_stat_t, "rev", cpu_vminfo.rev),
+	KSR_FIELD(cpu_stat_t, "hat_fault", cpu_vminfo.hat_fault),
+	KSR_FIELD(cpu_stat_t, "as_fault", cpu_vminfo.as_fault),
+	KSR_FIELD(cpu_stat_t, "maj_fault", cpu_vminfo.maj_fault),
+	KSR_FIELD(cpu_stat_t, "cow_fault", cpu_vminfo.cow_fault),
+	KSR_FIELD(cpu_stat_t, "prot_fault", cpu_vminfo.prot_fault),
+	KSR_FIELD(cpu_stat_t, "softlock", cpu_vminfo.softlock),
+	KSR_FIELD(cpu_stat_t, "kernel_asflt", cpu_vminfo.kernel_asflt),
+	KSR_FIELD(cpu_stat_t, "pgrrun", cpu_vminfo.pgrrun),
+	KSR_FIELD(cpu_stat_t, "execpgin", cpu_vminfo.execpgin),
+	KSR_FIELD(cpu_stat_t, "execpgout", cpu_vminfo.execpgout),
+	KSR_FIELD(cpu_stat_t, "execfree", cpu_vminfo.execfree),
+	KSR_FIELD(cpu_stat_t, "anonpgin", cpu_vminfo.anonpgin),
+	KSR_FIELD(cpu_stat_t, "anonpgout", cpu_vminfo.anonpgout),
+	KSR_FIELD(cpu_stat_t, "anonfree", cpu_vminfo.anonfree),
+	KSR_FIELD(cpu_stat_t, "fspgin", cpu_vminfo.fspgin),
+	KSR_FIELD(cpu_stat_t, "fspgout", cpu_vminfo.fspgout),
+	KSR_FIELD(cpu_stat_t, "fsfree", cpu_vminfo.fsfree),
+};
+
+static constexpr ksr_field_t ksr_var_fields[] = {
+	KSR_FIELD(struct var, "v_buf", v_buf),
+	KSR_FIELD(struct var, "v_call", v_call),
+	KSR_FIELD(struct var, "v_proc", v_proc),
+	KSR_FIELD(struct var, "v_maxupttl", v_maxupttl),
+	KSR_FIELD(struct var, "v_nglobpris", v_nglobpris),
+	KSR_FIELD(struct var, "v_maxsyspri", v_maxsyspri),
+	KSR_FIELD(struct var, "v_clist", v_clist),
+	KSR_FIELD(struct var, "v_maxup", v_maxup),
+	KSR_FIELD(struct var, "v_hbuf", v_hbuf),
+	KSR_FIELD(struct var, "v_hmask", v_hmask),
+	KSR_FIELD(struct var, "v_pbuf", v_pbuf),
+	KSR_FIELD(struct var, "v_sptmap", v_sptmap),
+	KSR_FIELD(struct var, "v_maxpmem", v_maxpmem),
+	KSR_FIELD(struct var, "v_autoup", v_autoup),
+	KSR_FIELD(struct var, "v_bufhwm", v_bufhwm),
+};
+
+static constexpr ksr_field_t ksr_ncstats_fields[] = {
+	KSR_FIELD(struct ncstats, "hits", hits),
+	KSR_FIELD(struct ncstats, "misses", misses),
+	KSR_FIELD(struct ncstats, "enters", enters),
+	KSR_FIELD(struct ncstats, "dbl_enters", dbl_enters),
+	KSR_FIELD(struct ncstats, "long_enter", long_enter),
+	KSR_FIELD(struct ncstats, "long_look", long_look),
+	KSR_FIELD(struct ncstats, "move_to_front", move_to_front),
+	KSR_FIELD(struct ncstats, "purges", purges),
+};
+
+static constexpr ksr_field_t ksr_sysinfo_fields[] = {
+	KSR_FIELD(sysinfo_t, "updates", updates),
+	KSR_FIELD(sysinfo_t, "runque", runque),
+	KSR_FIELD(sysinfo_t, "runocc", runocc),
+	KSR_FIELD(sysinfo_t, "swpque", swpque),
+	KSR_FIELD(sysinfo_t, "swpocc", swpocc),
+	KSR_FIELD(sysinfo_t, "waiting", waiting),
+};
+
+static constexpr ksr_field_t ksr_vminfo_fields[] = {
+	KSR_FIELD(vminfo_t, "freemem", freemem),
+	KSR_FIELD(vminfo_t, "swap_resv", swap_resv),
+	KSR_FIELD(vminfo_t, "swap_alloc", swap_alloc),
+	KSR_FIELD(vminfo_t, "swap_avail", swap_avail),
+	KSR_FIELD(vminfo_t, "swap_free", swap_free),
+	KSR_FIELD(vminfo_t, "updates", updates),
+};
+
+static constexpr ksr_field_t ksr_mntinfo_fields[] = {
+	KSR_FIELD(struct mntinfo_kstat, "mik_proto", mik_proto),
+	KSR_FIELD(struct mntinfo_kstat, "mik_vers", mik_vers),
+	KSR_FIELD(struct mntinfo_kstat, "mik_flags", mik_flags),
+	KSR_FIELD(struct mntinfo_kstat, "mik_secmod", mik_secmod),
+	KSR_FIELD(struct mntinfo_kstat, "mik_curread", mik_curread),
+	KSR_FIELD(struct mntinfo_kstat, "mik_curwrite", mik_curwrite),
+	KSR_FIELD(struct mntinfo_kstat, "mik_timeo", mik_timeo),
+	KSR_FIELD(struct mntinfo_kstat, "mik_retrans", mik_retrans),
+	KSR_FIELD(struct mntinfo_kstat, "mik_acregmin", mik_acregmin),
+	KSR_FIELD(struct mntinfo_kstat, "mik_acregmax", mik_acregmax),
+	KSR_FIELD(struct mntinfo_kstat, "mik_acdirmin", mik_acdirmin),
+	KSR_FIELD(struct mntinfo_kstat, "mik_acdirmax", mik_acdirmax),
+	KSR_FIELD(struct mntinfo_kstat, "lookup_srtt", mik_timers[0].srtt),
+	KSR_FIELD(struct mntinfo_kstat, "lookup_deviate",
+	    mik_timers[0].deviate),
+	KSR_FIELD(struct mntinfo_kstat, "lookup_rtxcur", mik_timers[0].rtxcur),
+	KSR_FIELD(struct mntinfo_kstat, "read_srtt", mik_timers[1].srtt),
+	KSR_FIELD(struct mntinfo_kstat, "read_deviate", mik_timers[1].deviate),
+	KSR_FIELD(struct mntinfo_kstat, "read_rtxcur", mik_timers[1].rtxcur),
+	KSR_FIELD(struct mntinfo_kstat, "write_srtt", mik_timers[2].srtt),
+	KSR_FIELD(struct mntinfo_kstat, "write_deviate", mik_timers[2].deviate),
+	KSR_FIELD(struct mntinfo_kstat, "write_rtxcur", mik_timers[2].rtxcur),
+	KSR_FIELD(struct mntinfo_kstat, "mik_noresponse", mik_noresponse),
+	KSR_FIELD(struct mntinfo_kstat, "mik_failover", mik_failover),
+	KSR_FIELD(struct mntinfo_kstat, "mik_remap", mik_remap),
+	KSR_FIELD(struct mntinfo_kstat, "mik_curserver", mik_curserver),
+};
+
+#ifdef	__sparc
+static constexpr ksr_field_t ksr_flushmeter_fields[] = {
+	KSR_FIELD(struct flushmeter, "f_ctx", f_ctx),
+	KSR_FIELD(struct flushmeter, "f_segment", f_segment),
+	KSR_FIELD(struct flushmeter, "f_page", f_page),
+	KSR_FIELD(struct flushmeter, "f_partial", f_partial),
+	KSR_FIELD(struct flushmeter, "f_usr", f_usr),
+	KSR_FIELD(struct flushmeter, "f_region", f_region),
+};
+#endif
+
+#define	KSR_SCHEMA(name, s)	{ #name, sizeof (s), ksr_##name##_fields,	\
+	sizeof (ksr_##name##_fields) / sizeof (ksr_field_t) }
+
+const ksr_schema_t ksr_schemas[] = {
+	KSR_SCHEMA(cpu_stat, cpu_stat_t),
+	KSR_SCHEMA(var, struct var),
+	KSR_SCHEMA(ncstats, struct ncstats),
+	KSR_SCHEMA(sysinfo, sysinfo_t),
+	KSR_SCHEMA(vminfo, vminfo_t),
+	KSR_SCHEMA(mntinfo, struct mntinfo_kstat),
+#ifdef	__sparc
+	KSR_SCHEMA(flushmeter, struct flushmeter),
+#endif
+};
+
+const size_t ksr_nschemas = sizeof (ksr_schemas) / sizeof (ksr_schema_t);
+
+/*
+ * Hand an integer to a visitor as the signed or unsigned integer it is.
+ */
+template <typename T> static inline void
+ksr_visitint(ksr_visitor *v, const char *name, T value)
+{
+	if (std::is_signed<T>::value)
+		v->integer(name, (int64_t)value);
+	else
+		v->uinteger(name, (uint64_t)value);
+}
+
+/*
+ * Hand each field of a raw kstat that we know the layout of to a visitor.
+ * Character arrays needn't be NUL-terminated, so we copy them out.
+ */
+static void
+ksr_decode_raw(kstat_t *ksp, ksr_visitor *v)
+{
+	const ksr_schema_t *schema;
+	const ksr_field_t *field;
+	const char *addr;
+	int32_t i32;
+	uint32_t ui32;
+	int64_t i64;
+	uint64_t ui64;
+	size_t i;
+
+	assert(ksp->ks_type == KSTAT_TYPE_RAW);
+
+	if ((schema = ksr_rawschema(ksp)) == NULL)
+		return;
+
+	for (i = 0; i < schema->ks_nfields; i++) {
+		field = &schema->ks_fields[i];
+		addr = (const char *)ksp->ks_data + field->kf_offset;
+
+		switch (field->kf_type) {
+		case KSR_STRING:
+			v->text(field->kf_name, string(addr,
+			    strnlen(addr, field->kf_size)).c_str());
+			break;
+		case KSR_INT32:
+			(void) memcpy(&i32, addr, sizeof (i32));
+			v->integer(field->kf_name, i32);
+			break;
+		case KSR_UINT32:
+			(void) memcpy(&ui32, addr, sizeof (ui32));
+			v->uinteger(field->kf_name, ui32);
+			break;
+		case KSR_INT64:
+			(void) memcpy(&i64, addr, sizeof (i64));
+			v->integer(field->kf_name, i64);
+			break;
+		case KSR_UINT64:
+			(void) memcpy(&ui64, addr, sizeof (ui64));
+			v->uinteger(field->kf_name, ui64);
+			break;
+		}
+	}
+}
+
+static int
+ksr_decode_named(kstat_t *ksp, ksr_visitor *v, kstat_named_t **badp)
+{
+	kstat_named_t *nm = KSTAT_NAMED_PTR(ksp);
+	unsigned int i;
+
+	assert(ksp->ks_type == KSTAT_TYPE_NAMED);
+
+	for (i = 0; i < ksp->ks_ndata; i++, nm++) {
+		switch (nm->data_type) {
+		case KSTAT_DATA_STRING:
+			v->text(nm->name, KSTAT_NAMED_STR_PTR(nm));
+			break;
+		case KSTAT_DATA_CHAR:
+			v->integer(nm->name, nm->value.c[0]);
+			break;
+		case KSTAT_DATA_INT32:
+			v->integer(nm->name, nm->value.i32);
+			break;
+		case KSTAT_DATA_UINT32:
+			v->uinteger(nm->name, nm->value.ui32);
+			break;
+		case KSTAT_DATA_INT64:
+			v->integer(nm->name, nm->value.i64);
+			break;
+		case KSTAT_DATA_UINT64:
+			v->uinteger(nm->name, nm->value.ui64);
+			break;
+		default:
+			*badp = nm;
+			return (-1);
+		}
+	}
+
+	return (0);
+}
+
+static void
+ksr_decode_intr(kstat_t *ksp, ksr_visitor *v)
+{
+	kstat_intr_t *intr = KSTAT_INTR_PTR(ksp);
+
+	assert(ksp->ks_type == KSTAT_TYPE_INTR);
+
+	ksr_visitint(v, "KSTAT_INTR_HARD", intr->intrs[KSTAT_INTR_HARD]);
+	ksr_visitint(v, "KSTAT_INTR_SOFT", intr->intrs[KSTAT_INTR_SOFT]);
+	ksr_visitint(v, "KSTAT_INTR_WATCHDOG",
+	    intr->intrs[KSTAT_INTR_WATCHDOG]);
+	ksr_visitint(v, "KSTAT_INTR_SPURIOUS",
+	    intr->intrs[KSTAT_INTR_SPURIOUS]);
+	ksr_visitint(v, "KSTAT_INTR_MULTSVC", intr->intrs[KSTAT_INTR_MULTSVC]);
+}
+
+static void
+ksr_decode_io(kstat_t *ksp, ksr_visitor *v)
+{
+	kstat_io_t *io = KSTAT_IO_PTR(ksp);
+
+	assert(ksp->ks_type == KSTAT_TYPE_IO);
+
+	ksr_visitint(v, "nread", io->nread);
+	ksr_visitint(v, "nwritten", io->nwritten);
+	ksr_visitint(v, "reads", io->reads);
+	ksr_visitint(v, "writes", io->writes);
+
+	ksr_visitint(v, "wtime", io->wtime);
+	ksr_visitint(v, "wlentime", io->wlentime);
+	ksr_visitint(v, "wlastupdate", io->wlastupdate);
+
+	ksr_visitint(v, "rtime", io->rtime);
+	ksr_visitint(v, "rlentime", io->rlentime);
+	ksr_visitint(v, "rlastupdate", io->rlastupdate);
+
+	ksr_visitint(v, "wcnt", io->wcnt);
+	ksr_visitint(v, "rcnt", io->rcnt);
+}
+
+static void
+ksr_decode_timer(kstat_t *ksp, ksr_visitor *v)
+{
+	kstat_timer_t *timer = KSTAT_TIMER_PTR(ksp);
+
+	assert(ksp->ks_type == KSTAT_TYPE_TIMER);
+
+	v->text("name", timer->name);
+	ksr_visitint(v, "num_events", timer->num_events);
+	ksr_visitint(v, "elapsed_time", timer->elapsed_time);
+	ksr_visitint(v, "min_time", timer->min_time);
+	ksr_visitint(v, "max_time", timer->max_time);
+	ksr_visitint(v, "start_time", timer->start_time);
+	ksr_visitint(v, "stop_time", timer->stop_time);
+}
+
+int
+ksr_decode(kstat_t *ksp, ksr_visitor *v, kstat_named_t **badp)
+{
+	*badp = NULL;
+
+	switch (ksp->ks_type) {
+		case KSTAT_TYPE_RAW:
+			ksr_decode_raw(ksp, v);
+			return (0);
+
+		case KSTAT_TYPE_NAMED:
+			return (ksr_decode_named(ksp, v, badp));
+
+		case KSTAT_TYPE_INTR:
+			ksr_decode_intr(ksp, v);
+			return (0);
+
+		case KSTAT_TYPE_IO:
+			ksr_decode_io(ksp, v);
+			return (0);
+
+		case KSTAT_TYPE_TIMER:
+			ksr_decode_timer(ksp, v);
+			return (0);
+
+		default:
+			return (-1);
+	}
+}
+
+/*
+ * Return the table describing a raw kstat, or NULL if we don't know its
+ * layout (or its size isn't what we expect).
+ */
+const ksr_schema_t *
+ksr_rawschema(kstat_t *ksp)
+{
+	const char *name = ksp->ks_name;
+	size_t i;
+
+	if (strcmp(ksp->ks_module, "cpu_stat") == 0)
+		name = "cpu_stat";
+
+	for (i = 0; i < ksr_nschemas; i++) {
+		if (strcmp(name, ksr_schemas[i].ks_name) != 0)
+			continue;
+
+		if (ksp->ks_data_size != ksr_schemas[i].ks_size)
+			return (NULL);
+
+		return (&ksr_schemas[i]);
+	}
+
+	return (NULL);
+}
+
+bool
+ksr_rawvalue(const void *data, const ksr_field_t *field, double *valp)
+{
+	const char *addr = (const char *)data + field->kf_offset;
+	int32_t i32;
+	uint32_t ui32;
+	int64_t i64;
+	uint64_t ui64;
+
+	switch (field->kf_type) {
+	case KSR_INT32:
+		(void) memcpy(&i32, addr, sizeof (i32));
+		*valp = i32;
+		return (true);
+	case KSR_UINT32:
+		(void) memcpy(&ui32, addr, sizeof (ui32));
+		*valp = ui32;
+		return (true);
+	case KSR_INT64:
+		(void) memcpy(&i64, addr, sizeof (i64));
+		*valp = i64;
+		return (true);
+	case KSR_UINT64:
+		(void) memcpy(&ui64, addr, sizeof (ui64));
+		*valp = ui64;
+		return (true);
+	default:
+		return (false);
+	}
+}
+
+static const char *ksr_intrnames[KSTAT_NUM_INTRS] = {
+	"KSTAT_INTR_HARD", "KSTAT_INTR_SOFT", "KSTAT_INTR_WATCHDOG",
+	"KSTAT_INTR_SPURIOUS", "KSTAT_INTR_MULTSVC"
+};
+
+static const char *ksr_ionames[] = {
+	"nread", "nwritten", "reads", "writes", "wtime", "wlentime",
+	"wlastupdate", "rtime", "rlentime", "rlastupdate", "wcnt", "rcnt"
+};
+
+static const char *ksr_timernames[] = {
+	"num_events", "elapsed_time", "min_time", "max_time", "start_time",
+	"stop_time"
+};
+
+/*
+ * Extract a single numeric statistic from a kstat that has already been read,
+ * without building its data object.
+ */
+bool
+ksr_fieldvalue(kstat_t *ksp, const char *field, double *valp)
+{
+	kstat_named_t *nm;
+	kstat_io_t *io;
+	kstat_timer_t *timer;
+	const ksr_schema_t *schema;
+	size_t f;
+	int i;
+
+	switch (ksp->ks_type) {
+	case KSTAT_TYPE_NAMED:
+		if ((nm = (kstat_named_t *)kstat_data_lookup(ksp,
+		    (char *)field)) == NULL)
+			return (false);
+
+		return (ksr_namednumber(nm, valp));
+
+	case KSTAT_TYPE_INTR:
+		for (i = 0; i < KSTAT_NUM_INTRS; i++) {
+			if (strcmp(field, ksr_intrnames[i]) == 0) {
+				*valp = KSTAT_INTR_PTR(ksp)->intrs[i];
+				return (true);
+			}
+		}
+		return (false);
+
+	case KSTAT_TYPE_IO:
+		io = KSTAT_IO_PTR(ksp);
+
+		if (strcmp(field, "nread") == 0)
+			*valp = io->nread;
+		else if (strcmp(field, "nwritten") == 0)
+			*valp = io->nwritten;
+		else if (strcmp(field, "reads") == 0)
+			*valp = io->reads;
+		else if (strcmp(field, "writes") == 0)
+			*valp = io->writes;
+		else if (strcmp(field, "wtime") == 0)
+			*valp = io->wtime;
+		else if (strcmp(field, "wlentime") == 0)
+			*valp = io->wlentime;
+		else if (strcmp(field, "wlastupdate") == 0)
+			*valp = io->wlastupdate;
+		else if (strcmp(field, "rtime") == 0)
+			*valp = io->rtime;
+		else if (strcmp(field, "rlentime") == 0)
+			*valp = io->rlentime;
+		else if (strcmp(field, "rlastupdate") == 0)
+			*valp = io->rlastupdate;
+		else if (strcmp(field, "wcnt") == 0)
+			*valp = io->wcnt;
+		else if (strcmp(field, "rcnt") == 0)
+			*valp = io->rcnt;
+		else
+			return (false);
+		return (true);
+
+	case KSTAT_TYPE_TIMER:
+		timer = KSTAT_TIMER_PTR(ksp);
+
+		if (strcmp(field, "num_events") == 0)
+			*valp = timer->num_events;
+		else if (strcmp(field, "elapsed_time") == 0)
+			*valp = timer->elapsed_time;
+		else if (strcmp(field, "min_time") == 0)
+			*valp = timer->min_time;
+		else if (strcmp(field, "max_time") == 0)
+			*valp = timer->max_time;
+		else if (strcmp(field, "start_time") == 0)
+			*valp = timer->start_time;
+		else if (strcmp(field, "stop_time") == 0)
+			*valp = timer->stop_time;
+		else
+			return (false);
+		return (true);
+
+	case KSTAT_TYPE_RAW:
+		if ((schema = ksr_rawschema(ksp)) == NULL)
+			return (false);
+
+		for (f = 0; f < schema->ks_nfields; f++) {
+			if (strcmp(field, schema->ks_fields[f].kf_name) == 0) {
+				return (ksr_rawvalue(ksp->ks_data,
+				    &schema->ks_fields[f], valp));
+			}
+		}
+		return (false);
+	}
+
+	return (false);
+}
+
+bool
+ksr_namednumber(kstat_named_t *nm, double *valp)
+{
+	switch (nm->data_type) {
+	case KSTAT_DATA_CHAR:
+		*valp = nm->value.c[0];
+		return (true);
+	case KSTAT_DATA_INT32:
+		*valp = nm->value.i32;
+		return (true);
+	case KSTAT_DATA_UINT32:
+		*valp = nm->value.ui32;
+		return (true);
+	case KSTAT_DATA_INT64:
+		*valp = nm->value.i64;
+		return (true);
+	case KSTAT_DATA_UINT64:
+		*valp = nm->value.ui64;
+		return (true);
+	default:
+		return (false);
+	}
+}
+
+/*
+ * List the numeric fields of a kstat that has been read, in the order in which
+ * they appear.  (Named characters are numbers -- their first byte -- as they
+ * are to read().)
+ */
+void
+ksr_fieldnames(kstat_t *ksp, vector<string> *fields)
+{
+	const ksr_schema_t *schema;
+	kstat_named_t *nm;
+	size_t i;
+
+	fields->clear();
+
+	switch (ksp->ks_type) {
+	case KSTAT_TYPE_NAMED:
+		for (i = 0, nm = KSTAT_NAMED_PTR(ksp); i < ksp->ks_ndata;
+		    i++, nm++) {
+			if (nm->data_type != KSTAT_DATA_STRING)
+				fields->push_back(nm->name);
+		}
+		break;
+
+	case KSTAT_TYPE_INTR:
+		fields->assign(ksr_intrnames, ksr_intrnames + KSTAT_NUM_INTRS);
+		break;
+
+	case KSTAT_TYPE_IO:
+		fields->assign(ksr_ionames, ksr_ionames +
+		    sizeof (ksr_ionames) / sizeof (ksr_ionames[0]));
+		break;
+
+	case KSTAT_TYPE_TIMER:
+		fields->assign(ksr_timernames, ksr_timernames +
+		    sizeof (ksr_timernames) / sizeof (ksr_timernames[0]));
+		break;
+
+	case KSTAT_TYPE_RAW:
+		if ((schema = ksr_rawschema(ksp)) == NULL)
+			break;
+
+		for (i = 0; i < schema->ks_nfields; i++) {
+			if (schema->ks_fields[i].kf_type != KSR_STRING)
+				fields->push_back(schema->ks_fields[i].kf_name);
+		}
+		break;
+	}
+}
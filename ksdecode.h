@@ -0,0 +1,83 @@
+/*
+ * The kstat decoding core.  This turns a kstat that has been read into the
+ * statistics that it holds, without reference to Node:  the addon builds its
+ * objects from it, and ksdump(1) prints what it's given.
+ */
+#ifndef _KSDECODE_H
+#define	_KSDECODE_H
+
+#include <kstat.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Raw kstats are C structures, which we describe with tables of their fields
+ * (the type of each field is deduced from the structure itself).  The tables
+ * are all that we use to decode raw kstats and pull single statistics out of
+ * them, and they tell consumers of raw data buffers how to decode them.
+ */
+typedef enum ksr_fieldtype {
+	KSR_INT32,
+	KSR_UINT32,
+	KSR_INT64,
+	KSR_UINT64,
+	KSR_STRING
+} ksr_fieldtype_t;
+
+typedef struct ksr_field {
+	const char *kf_name;
+	size_t kf_offset;
+	size_t kf_size;
+	ksr_fieldtype_t kf_type;
+} ksr_field_t;
+
+typedef struct ksr_schema {
+	const char *ks_name;
+	size_t ks_size;
+	const ksr_field_t *ks_fields;
+	size_t ks_nfields;
+} ksr_schema_t;
+
+extern const char *ksr_fieldtypes[];
+extern const ksr_schema_t ksr_schemas[];
+extern const size_t ksr_nschemas;
+
+/*
+ * A kstat is decoded by handing each of its statistics, in order, to a
+ * visitor.  Numbers are passed as doubles, as JavaScript would see them,
+ * unless the visitor takes integers itself (as ksdump does, to print 64-bit
+ * counters exactly); strings are only valid for the duration of the call.
+ */
+class ksr_visitor {
+public:
+	virtual ~ksr_visitor() {}
+	virtual void number(const char *, double) = 0;
+	virtual void text(const char *, const char *) = 0;
+
+	virtual void integer(const char *name, int64_t value) {
+		number(name, (double)value);
+	}
+
+	virtual void uinteger(const char *name, uint64_t value) {
+		number(name, (double)value);
+	}
+};
+
+/*
+ * Decode a kstat that has been read.  This returns -1 if the kstat's type
+ * isn't one that we know, or if one of its named statistics isn't; in the
+ * latter case, the statistic is returned through the last argument (which is
+ * otherwise set to NULL), and the statistics before it will have been
+ * visited.
+ */
+extern int ksr_decode(kstat_t *, ksr_visitor *, kstat_named_t **);
+
+extern const ksr_schema_t *ksr_rawschema(kstat_t *);
+extern bool ksr_rawvalue(const void *, const ksr_field_t *, double *);
+extern bool ksr_fieldvalue(kstat_t *, const char *, double *);
+extern bool ksr_namednumber(kstat_named_t *, double *);
+extern void ksr_fieldnames(kstat_t *, std::vector<std::string> *);
+
+#endif	/* _KSDECODE_H */
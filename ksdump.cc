@@ -0,0 +1,503 @@
+/*
+ * ksdump:  print kstats, in the parseable format of kstat -p or as JSON,
+ * using the same decoding core as the addon (and so seeing the same
+ * statistics).  Usage:
+ *
+ *	ksdump [-jp] [-T count] [-c class] [-m module] [-i instance]
+ *	    [-n name] [module:instance:name:statistic]
+ *
+ * As with kstat(1M), any field of the colon-separated specification may be
+ * left empty to match everything.  With -p (the default), each statistic is
+ * printed on a line of its own as
+ *
+ *	module:instance:name:statistic<TAB>value
+ *
+ * and with -j, the kstats are printed as a JSON array of objects laid out
+ * as the addon's read() returns them.  With -T count, nothing is printed;
+ * instead, each matching kstat is read once and decoded count times, and the
+ * time taken to decode each kind of kstat (each raw structure, and each other
+ * kstat type) is reported.  The exit status is 0 if any kstats matched, 1 if
+ * none did, and 2 on error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <kstat.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "ksdecode.h"
+
+using std::string;
+using std::vector;
+using std::map;
+
+typedef enum ksd_kind {
+	KSD_TEXT,
+	KSD_NUMBER,
+	KSD_INT,
+	KSD_UINT
+} ksd_kind_t;
+
+typedef struct ksd_stat {
+	const char *kds_name;
+	ksd_kind_t kds_kind;
+	string kds_text;
+	double kds_value;
+	int64_t kds_int;
+	uint64_t kds_uint;
+} ksd_stat_t;
+
+/*
+ * Collects the statistics of one kstat as they are decoded.  The names point
+ * into the kstat (or the decoder's tables), so they are valid until the kstat
+ * is next read -- which is longer than we need them -- but strings are only
+ * valid during the visit, and are copied.
+ */
+class ksd_collector : public ksr_visitor {
+public:
+	void number(const char *name, double value) {
+		ksd_stat_t s = { name, KSD_NUMBER, string(), value, 0, 0 };
+		kdc_stats.push_back(s);
+	}
+
+	/*
+	 * Integers are kept as they are, so that counters beyond 2^53 are
+	 * printed exactly, as kstat -p prints them.
+	 */
+	void integer(const char *name, int64_t value) {
+		ksd_stat_t s = { name, KSD_INT, string(), 0, value, 0 };
+		kdc_stats.push_back(s);
+	}
+
+	void uinteger(const char *name, uint64_t value) {
+		ksd_stat_t s = { name, KSD_UINT, string(), 0, 0, value };
+		kdc_stats.push_back(s);
+	}
+
+	void text(const char *name, const char *value) {
+		ksd_stat_t s = { name, KSD_TEXT, string(value), 0, 0, 0 };
+		kdc_stats.push_back(s);
+	}
+
+	vector<ksd_stat_t> kdc_stats;
+};
+
+/*
+ * Only counts the statistics it's handed, so that timing a decode measures
+ * the decoder rather than what's done with its output.
+ */
+class ksd_counter : public ksr_visitor {
+public:
+	ksd_counter() : kdn_count(0) {}
+
+	void number(const char *name, double value) {
+		kdn_count++;
+	}
+
+	void integer(const char *name, int64_t value) {
+		kdn_count++;
+	}
+
+	void uinteger(const char *name, uint64_t value) {
+		kdn_count++;
+	}
+
+	void text(const char *name, const char *value) {
+		kdn_count++;
+	}
+
+	uint64_t kdn_count;
+};
+
+typedef struct ksd_timing {
+	uint64_t kdt_kstats;		/* kstats decoded */
+	uint64_t kdt_fields;		/* statistics visited */
+	hrtime_t kdt_time;		/* total time taken */
+} ksd_timing_t;
+
+static const char *ksd_class;
+static const char *ksd_module;
+static const char *ksd_name;
+static const char *ksd_statistic;
+static int ksd_instance = -1;
+static long ksd_iterations;
+static map<string, ksd_timing_t> ksd_timings;
+
+static void
+ksd_usage(const char *cmd)
+{
+	(void) fprintf(stderr, "Usage: %s [-jp] [-T count] [-c class] "
+	    "[-m module] [-i instance]\n\t[-n name] "
+	    "[module:instance:name:statistic]\n", cmd);
+	exit(2);
+}
+
+static bool
+ksd_statcmp(const ksd_stat_t &lhs, const ksd_stat_t &rhs)
+{
+	return (strcmp(lhs.kds_name, rhs.kds_name) < 0);
+}
+
+static bool
+ksd_match(kstat_t *ksp)
+{
+	if (ksd_class != NULL && strcmp(ksp->ks_class, ksd_class) != 0)
+		return (false);
+
+	if (ksd_module != NULL && strcmp(ksp->ks_module, ksd_module) != 0)
+		return (false);
+
+	if (ksd_name != NULL && strcmp(ksp->ks_name, ksd_name) != 0)
+		return (false);
+
+	if (ksd_instance != -1 && ksp->ks_instance != ksd_instance)
+		return (false);
+
+	return (true);
+}
+
+/*
+ * Set a filter from a field of the specification, leaving it alone if the
+ * field is empty.
+ */
+static void
+ksd_field(const char **filterp, const string &field)
+{
+	if (!field.empty())
+		*filterp = strdup(field.c_str());
+}
+
+static void
+ksd_spec(const char *cmd, const char *spec)
+{
+	vector<string> fields;
+	const char *c;
+	char *end;
+
+	for (c = spec; ; c++) {
+		const char *colon = strchr(c, ':');
+
+		if (colon == NULL) {
+			fields.push_back(string(c));
+			break;
+		}
+
+		fields.push_back(string(c, colon - c));
+		c = colon;
+	}
+
+	if (fields.size() > 4)
+		ksd_usage(cmd);
+
+	fields.resize(4);
+	ksd_field(&ksd_module, fields[0]);
+	ksd_field(&ksd_name, fields[2]);
+	ksd_field(&ksd_statistic, fields[3]);
+
+	if (!fields[1].empty()) {
+		errno = 0;
+		ksd_instance = strtol(fields[1].c_str(), &end, 10);
+
+		if (errno != 0 || *end != '\0' || ksd_instance < 0)
+			ksd_usage(cmd);
+	}
+}
+
+static void
+ksd_jsonstr(const char *str)
+{
+	const unsigned char *c;
+
+	(void) putchar('"');
+
+	for (c = (const unsigned char *)str; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			(void) putchar('\\');
+			(void) putchar(*c);
+		} else if (*c < 0x20) {
+			(void) printf("\\u%04x", *c);
+		} else {
+			(void) putchar(*c);
+		}
+	}
+
+	(void) putchar('"');
+}
+
+static void
+ksd_number(const ksd_stat_t &stat)
+{
+	switch (stat.kds_kind) {
+	case KSD_INT:
+		(void) printf("%lld", (long long)stat.kds_int);
+		break;
+	case KSD_UINT:
+		(void) printf("%llu", (unsigned long long)stat.kds_uint);
+		break;
+	default:
+		(void) printf("%.17g", stat.kds_value);
+		break;
+	}
+}
+
+static void
+ksd_parseable(kstat_t *ksp, vector<ksd_stat_t> &stats)
+{
+	char prefix[KSTAT_STRLEN * 2 + 32];
+	size_t i;
+
+	(void) snprintf(prefix, sizeof (prefix), "%s:%d:%s:",
+	    ksp->ks_module, ksp->ks_instance, ksp->ks_name);
+
+	for (i = 0; i < stats.size(); i++) {
+		if (ksd_statistic != NULL &&
+		    strcmp(stats[i].kds_name, ksd_statistic) != 0)
+			continue;
+
+		(void) printf("%s%s\t", prefix, stats[i].kds_name);
+
+		if (stats[i].kds_kind == KSD_TEXT)
+			(void) printf("%s", stats[i].kds_text.c_str());
+		else
+			ksd_number(stats[i]);
+
+		(void) putchar('\n');
+	}
+}
+
+static void
+ksd_json(kstat_t *ksp, vector<ksd_stat_t> &stats, bool first)
+{
+	bool comma = false;
+	size_t i;
+
+	(void) printf("%s\n  {\"class\": ", first ? "" : ",");
+	ksd_jsonstr(ksp->ks_class);
+	(void) printf(", \"module\": ");
+	ksd_jsonstr(ksp->ks_module);
+	(void) printf(", \"name\": ");
+	ksd_jsonstr(ksp->ks_name);
+	(void) printf(", \"instance\": %d, \"type\": %d, \"snaptime\": %lld, "
+	    "\"crtime\": %lld, \"data\": {", ksp->ks_instance, ksp->ks_type,
+	    (long long)ksp->ks_snaptime, (long long)ksp->ks_crtime);
+
+	for (i = 0; i < stats.size(); i++) {
+		if (ksd_statistic != NULL &&
+		    strcmp(stats[i].kds_name, ksd_statistic) != 0)
+			continue;
+
+		(void) printf("%s", comma ? ", " : "");
+		ksd_jsonstr(stats[i].kds_name);
+		(void) printf(": ");
+
+		if (stats[i].kds_kind == KSD_TEXT)
+			ksd_jsonstr(stats[i].kds_text.c_str());
+		else
+			ksd_number(stats[i]);
+
+		comma = true;
+	}
+
+	(void) printf("}}");
+}
+
+/*
+ * Decode a kstat that has been read ksd_iterations times, charging the time
+ * to its raw structure or (for other kstats) its type.
+ */
+static void
+ksd_time(kstat_t *ksp)
+{
+	static const char *types[] = { "raw", "named", "intr", "io", "timer" };
+	const ksr_schema_t *schema;
+	ksd_counter v;
+	kstat_named_t *nm;
+	const char *kind = "unknown";
+	hrtime_t start;
+	long i;
+
+	if (ksp->ks_type == KSTAT_TYPE_RAW &&
+	    (schema = ksr_rawschema(ksp)) != NULL) {
+		kind = schema->ks_name;
+	} else if (ksp->ks_type >= 0 &&
+	    ksp->ks_type < (int)(sizeof (types) / sizeof (types[0]))) {
+		kind = types[ksp->ks_type];
+	}
+
+	start = gethrtime();
+
+	for (i = 0; i < ksd_iterations; i++)
+		(void) ksr_decode(ksp, &v, &nm);
+
+	ksd_timing_t &t = ksd_timings[kind];
+	t.kdt_time += gethrtime() - start;
+	t.kdt_kstats += ksd_iterations;
+	t.kdt_fields += v.kdn_count;
+}
+
+static void
+ksd_timereport(void)
+{
+	map<string, ksd_timing_t>::iterator it;
+
+	(void) printf("%-16s %10s %10s %10s %10s\n", "KIND", "DECODES",
+	    "FIELDS", "NS/DECODE", "NS/FIELD");
+
+	for (it = ksd_timings.begin(); it != ksd_timings.end(); it++) {
+		ksd_timing_t &t = it->second;
+
+		(void) printf("%-16s %10llu %10llu %10.1f %10.2f\n",
+		    it->first.c_str(), (unsigned long long)t.kdt_kstats,
+		    (unsigned long long)t.kdt_fields,
+		    (double)t.kdt_time / t.kdt_kstats,
+		    t.kdt_fields == 0 ? 0 : (double)t.kdt_time / t.kdt_fields);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char buf[64 * 1024];
+	bool json = false;
+	kstat_ctl_t *kc;
+	kstat_t *ksp;
+	kstat_named_t *nm;
+	char *end;
+	int c, nmatched = 0;
+
+	while ((c = getopt(argc, argv, "jpT:c:m:i:n:")) != -1) {
+		switch (c) {
+		case 'j':
+			json = true;
+			break;
+
+		case 'p':
+			json = false;
+			break;
+
+		case 'T':
+			errno = 0;
+			ksd_iterations = strtol(optarg, &end, 10);
+
+			if (errno != 0 || *end != '\0' || ksd_iterations <= 0)
+				ksd_usage(argv[0]);
+			break;
+
+		case 'c':
+			ksd_class = optarg;
+			break;
+
+		case 'm':
+			ksd_module = optarg;
+			break;
+
+		case 'n':
+			ksd_name = optarg;
+			break;
+
+		case 'i':
+			errno = 0;
+			ksd_instance = strtol(optarg, &end, 10);
+
+			if (errno != 0 || *end != '\0' || ksd_instance < 0)
+				ksd_usage(argv[0]);
+			break;
+
+		default:
+			ksd_usage(argv[0]);
+		}
+	}
+
+	if (optind < argc - 1)
+		ksd_usage(argv[0]);
+
+	if (optind == argc - 1)
+		ksd_spec(argv[0], argv[optind]);
+
+	if ((kc = kstat_open()) == NULL) {
+		(void) fprintf(stderr, "%s: kstat_open: %s\n", argv[0],
+		    strerror(errno));
+		return (2);
+	}
+
+	/*
+	 * A full dump is thousands of lines, so we buffer it rather than let
+	 * stdio flush each line to a terminal.
+	 */
+	(void) setvbuf(stdout, buf, _IOFBF, sizeof (buf));
+
+	if (ksd_iterations != 0)
+		json = false;
+
+	if (json)
+		(void) printf("[");
+
+	for (ksp = kc->kc_chain; ksp != NULL; ksp = ksp->ks_next) {
+		ksd_collector v;
+
+		if (!ksd_match(ksp))
+			continue;
+
+		/*
+		 * As kstat(1M) does, we quietly skip kstats that can't be read
+		 * (some are restricted to privileged readers).
+		 */
+		if (kstat_read(kc, ksp, NULL) == -1)
+			continue;
+
+		nmatched++;
+
+		if (ksd_iterations != 0) {
+			ksd_time(ksp);
+			continue;
+		}
+
+		if (ksr_decode(ksp, &v, &nm) != 0 && nm != NULL) {
+			(void) fprintf(stderr, "%s: unrecognized data type %d "
+			    "for member \"%s\" of %s:%d:%s\n", argv[0],
+			    nm->data_type, nm->name, ksp->ks_module,
+			    ksp->ks_instance, ksp->ks_name);
+		}
+
+		if (json) {
+			ksd_json(ksp, v.kdc_stats, nmatched == 1);
+		} else {
+			char crtime[32], snaptime[32];
+
+			/*
+			 * kstat -p includes the kstat's class and times among
+			 * its statistics (in seconds), and sorts them.
+			 */
+			(void) snprintf(crtime, sizeof (crtime), "%.9f",
+			    ksp->ks_crtime / 1e9);
+			(void) snprintf(snaptime, sizeof (snaptime), "%.9f",
+			    ksp->ks_snaptime / 1e9);
+
+			ksd_stat_t cls = { "class", KSD_TEXT, ksp->ks_class };
+			ksd_stat_t cr = { "crtime", KSD_TEXT, crtime };
+			ksd_stat_t snap = { "snaptime", KSD_TEXT, snaptime };
+
+			v.kdc_stats.push_back(cls);
+			v.kdc_stats.push_back(cr);
+			v.kdc_stats.push_back(snap);
+			std::stable_sort(v.kdc_stats.begin(),
+			    v.kdc_stats.end(), ksd_statcmp);
+			ksd_parseable(ksp, v.kdc_stats);
+		}
+	}
+
+	if (json)
+		(void) printf("%s]\n", nmatched == 0 ? "" : "\n");
+
+	if (ksd_iterations != 0 && nmatched != 0)
+		ksd_timereport();
+
+	(void) fflush(stdout);
+	(void) kstat_close(kc);
+
+	return (nmatched == 0 ? 1 : 0);
+}
@@ -1,65 +1,818 @@
-#include <v8.h>
-#include <node.h>
+#define	NAPI_VERSION	6
+
+#include <node_api.h>
 #include <string.h>
 #include <unistd.h>
-#include <nfs/nfs_clnt.h>
-#include <node_object_wrap.h>
 #include <kstat.h>
 #include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
 #include <string>
 #include <vector>
-#include <sys/dnlc.h>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <uv.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stropts.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/varargs.h>
-#include <sys/sysinfo.h>
 #include <sys/time.h>
-#include <sys/var.h>
+#include "ksdecode.h"
+#include "ksarrow.h"
 
-using namespace v8;
 using std::string;
 using std::vector;
+using std::map;
+using std::set;
+
+/*
+ * A watch is a threshold rule evaluated natively against every kstat that
+ * matches its specification.  We keep the last observed value (and its
+ * snaptime, so that rates can be computed) for each matching kstat, and
+ * report only transitions between the inactive and active states.
+ */
+enum ksr_watchop { KSW_GT, KSW_GE, KSW_LT, KSW_LE, KSW_EQ, KSW_NE };
+
+typedef struct ksr_watchstate {
+	double kws_value;
+	hrtime_t kws_snaptime;
+	bool kws_active;
+} ksr_watchstate_t;
+
+typedef struct ksr_watch {
+	int kw_id;
+	string kw_module;
+	string kw_class;
+	string kw_name;
+	int64_t kw_instance;
+	string kw_statistic;
+	bool kw_rate;
+	double kw_scale;
+	ksr_watchop kw_op;
+	double kw_threshold;
+	map<kid_t, ksr_watchstate_t> kw_state;
+} ksr_watch_t;
+
+/*
+ * A schedule is a set of specifications, each to be read at its own interval.
+ * An entry falls due at each multiple of its interval in wall-clock time, so
+ * that entries whose intervals are multiples of one another fall due together
+ * and are read on one wakeup, after one chain update.
+ */
+typedef struct ksr_schedentry {
+	string kse_module;
+	string kse_class;
+	string kse_name;
+	int64_t kse_instance;
+	int64_t kse_interval;		/* in milliseconds */
+	int kse_flags;			/* read flags */
+	int64_t kse_due;		/* in milliseconds since the epoch */
+} ksr_schedentry_t;
+
+/*
+ * A rate histogram records how much a statistic changed (per second, unless
+ * told otherwise) between successive reads of each kstat that matches its
+ * specification, whenever the reader reads one.  Values are counted in
+ * log-linear buckets, as HdrHistogram does: each value below
+ * 2^(KSR_RHIST_SUBBITS + 1) has a bucket of its own, and each power of two
+ * above that is split into 2^KSR_RHIST_SUBBITS buckets, so that a value is
+ * known to within one part in 2^KSR_RHIST_SUBBITS however large it is.
+ * Values of 2^KSR_RHIST_MAXBITS or more are counted in the last bucket.  The
+ * buckets are allocated with the histogram, so it stays the same size however
+ * many values are recorded.  A histogram with a window keeps the last complete
+ * window as well as the current one.
+ */
+#define	KSR_RHIST_SUBBITS	6
+#define	KSR_RHIST_SUB		(1 << KSR_RHIST_SUBBITS)
+#define	KSR_RHIST_MAXBITS	48
+#define	KSR_RHIST_BUCKETS	\
+	((KSR_RHIST_MAXBITS - KSR_RHIST_SUBBITS + 1) * KSR_RHIST_SUB)
+
+typedef struct ksr_rhistwin {
+	hrtime_t krw_start;		/* when the window began */
+	int64_t krw_time;		/* ... in milliseconds since the epoch */
+	uint64_t krw_count;
+	uint64_t krw_discarded;		/* changes that were negative */
+	uint64_t krw_min;
+	uint64_t krw_max;
+	double krw_total;
+	uint64_t krw_buckets[KSR_RHIST_BUCKETS];
+} ksr_rhistwin_t;
+
+typedef struct ksr_ratehist {
+	int krh_id;
+	string krh_module;
+	string krh_class;
+	string krh_name;
+	int64_t krh_instance;
+	string krh_statistic;
+	bool krh_rate;
+	double krh_scale;
+	hrtime_t krh_window;		/* 0 if kept until reset */
+	map<kid_t, ksr_watchstate_t> krh_state;
+	ksr_rhistwin_t krh_cur;
+	ksr_rhistwin_t krh_prev;
+	bool krh_hasprev;
+} ksr_ratehist_t;
+
+static int
+ksr_rhist_bucket(uint64_t value)
+{
+	int shift;
+
+	if (value >= 1ULL << KSR_RHIST_MAXBITS)
+		value = (1ULL << KSR_RHIST_MAXBITS) - 1;
+
+	if (value < 2 * KSR_RHIST_SUB)
+		return ((int)value);
+
+	shift = 63 - __builtin_clzll(value) - KSR_RHIST_SUBBITS;
+
+	return (shift * KSR_RHIST_SUB + (int)(value >> shift));
+}
+
+/*
+ * Return the least value counted in a bucket, and the least value counted in
+ * the next.
+ */
+static void
+ksr_rhist_bounds(int bucket, uint64_t *lowp, uint64_t *highp)
+{
+	int shift;
+	uint64_t top;
+
+	if (bucket < 2 * KSR_RHIST_SUB) {
+		*lowp = bucket;
+		*highp = bucket + 1;
+		return;
+	}
+
+	shift = (bucket >> KSR_RHIST_SUBBITS) - 1;
+	top = bucket - shift * KSR_RHIST_SUB;
+	*lowp = top << shift;
+	*highp = (top + 1) << shift;
+}
+
+static void
+ksr_rhist_reset(ksr_rhistwin_t *krw, hrtime_t start, int64_t time)
+{
+	(void) memset(krw, 0, sizeof (ksr_rhistwin_t));
+	krw->krw_start = start;
+	krw->krw_time = time;
+	krw->krw_min = UINT64_MAX;
+}
 
-class KStatReader : public node::ObjectWrap {
+/*
+ * Some kstats fail to read under otherwise routine conditions.  Rather than
+ * retrying them on every read, we remember each failing kstat and back off
+ * exponentially (up to the reader's configured maximum) before trying it
+ * again.
+ */
+#define	KSR_BACKOFF_INITIAL	1000000000LL	/* nanoseconds */
+#define	KSR_BACKOFF_DEFAULT	300000		/* milliseconds */
+
+typedef struct ksr_failure {
+	string kf_class;
+	string kf_module;
+	string kf_name;
+	int kf_instance;
+	int kf_errno;
+	unsigned int kf_count;
+	hrtime_t kf_backoff;
+	hrtime_t kf_retry;
+} ksr_failure_t;
+
+/*
+ * When a reader keeps snapshots, each kstat that it reads is copied into the
+ * inactive one of a pair of buffers, which then becomes the current one; the
+ * other buffer holds the previous read.  The buffers are allocated once and
+ * only grow if the kstat does, so steady-state reads don't allocate.
+ */
+class ksr_snap {
 public:
-	static void Initialize(Local<Object> exports);
+	ksr_snap() : kss_cur(0) {
+		kss_buf[0] = kss_buf[1] = NULL;
+		kss_size[0] = kss_size[1] = 0;
+		kss_valid[0] = kss_valid[1] = false;
+	}
 
-protected:
-	static Persistent<FunctionTemplate> templ;
+	~ksr_snap() {
+		free(kss_buf[0]);
+		free(kss_buf[1]);
+	}
+
+	char *kss_buf[2];
+	size_t kss_size[2];
+	bool kss_valid[2];
+	int kss_cur;
+
+private:
+	ksr_snap(const ksr_snap&);
+	ksr_snap& operator=(const ksr_snap&);
+};
+
+/*
+ * Readers that are created with a coalescing window share their reads: each
+ * kstat that such a reader reads is kept here, by ID, and another reader that
+ * wants the same kstat within its window is given a copy rather than reading
+ * it again.  Kstat IDs are never reused, so entries for kstats that have left
+ * the chain simply age out.  The table is shared by readers on every thread
+ * that has loaded us, and so is protected by ksr_coalesce_lock.
+ */
+typedef struct ksr_coalesced {
+	hrtime_t kco_time;		/* when the kstat was read */
+	kid_t kco_chain;		/* what kstat_read() returned */
+	vector<char> kco_snap;		/* snapshot of the kstat */
+} ksr_coalesced_t;
+
+#define	KSR_COALESCE_SWEEP	1024	/* reads between sweeps */
+
+static map<kid_t, ksr_coalesced_t> ksr_coalesced;
+static hrtime_t ksr_coalesce_max;	/* widest window of any reader */
+static unsigned int ksr_coalesce_reads;
+static size_t ksr_coalesce_mem;		/* bytes of snapshots held */
+static uv_mutex_t ksr_coalesce_lock;
+static uv_once_t ksr_coalesce_once = UV_ONCE_INIT;
+
+static void
+ksr_coalesce_init(void)
+{
+	if (uv_mutex_init(&ksr_coalesce_lock) != 0)
+		abort();
+}
+
+/*
+ * Readers created with "instrument" keep a histogram of the time spent in each
+ * phase of reading, for each module and class of kstat: reading the kstat
+ * (kstat_read(), or copying a coalesced read), decoding its data into
+ * JavaScript, and materializing the object that describes it.  Bucket i of a
+ * histogram counts times of less than 2^i nanoseconds (and, for i > 0, of at
+ * least 2^(i - 1)); the last bucket counts everything longer.
+ */
+#define	KSR_HIST_BUCKETS	40
+
+typedef struct ksr_hist {
+	uint64_t kh_count;
+	hrtime_t kh_total;
+	hrtime_t kh_max;
+	uint64_t kh_buckets[KSR_HIST_BUCKETS];
+} ksr_hist_t;
+
+enum ksr_phase { KSP_READ, KSP_DECODE, KSP_MATERIALIZE, KSP_NPHASES };
+
+static const char *ksr_phases[] = { "read", "decode", "materialize" };
+
+typedef struct ksr_modstats {
+	string kms_module;
+	string kms_class;
+	uint64_t kms_errors;
+	ksr_hist_t kms_hist[KSP_NPHASES];
+} ksr_modstats_t;
+
+/*
+ * Counters that every reader keeps, instrumented or not.
+ */
+typedef struct ksr_counters {
+	uint64_t kct_reads;		/* kstat reads attempted */
+	uint64_t kct_coalesced;		/* ... of which were coalesced */
+	uint64_t kct_errors;		/* failed reads */
+	uint64_t kct_updates;		/* kstat_chain_update() calls */
+	uint64_t kct_changes;		/* ... that found the chain changed */
+	uint64_t kct_skipped;		/* updates skipped by refresh policy */
+	uint64_t kct_lookups;		/* kstat_lookup() calls */
+} ksr_counters_t;
+
+/*
+ * A reader's refresh policy decides when reading brings the chain up to date:
+ * on every call, at most once an interval, or only once the chain watcher --
+ * a thread that polls the kernel's chain ID on its own descriptor -- has seen
+ * it change.  Whatever the policy, a read that returns a chain ID other than
+ * ours (or that fails because the kstat has gone) marks the chain stale, so
+ * that the next call brings it up to date.
+ */
+typedef enum ksr_refresh {
+	KSR_REFRESH_ALWAYS,
+	KSR_REFRESH_INTERVAL,
+	KSR_REFRESH_WATCH
+} ksr_refresh_t;
+
+#define	KSR_CHAINPOLL_DEFAULT	100		/* in milliseconds */
+
+typedef struct ksr_chainwatch {
+	uv_thread_t kcw_thread;
+	uv_mutex_t kcw_lock;
+	uv_cond_t kcw_cv;
+	bool kcw_done;			/* protected by kcw_lock */
+	uint64_t kcw_poll;		/* in nanoseconds */
+	int kcw_fd;
+	kid_t kcw_kid;			/* last chain ID seen */
+	int kcw_stale;			/* set by the watcher; atomic */
+	uv_async_t *kcw_async;
+} ksr_chainwatch_t;
+
+/*
+ * A reader's native memory, by what it is used for.  The chain and the data
+ * buffers belong to libkstat; the rest are ours.  Figures are approximate
+ * where they depend on the C++ library's node sizes.
+ */
+typedef struct ksr_memory {
+	size_t km_chain;		/* kstat headers in the chain */
+	size_t km_data;			/* data buffers of kstats read */
+	size_t km_snapshots;		/* snapshot buffers */
+	size_t km_caches;		/* failures, watch state, statistics */
+	size_t km_publish;		/* publication buffer and segment */
+} ksr_memory_t;
+
+#define	KSR_MAPNODE		(4 * sizeof (void *))	/* est. map overhead */
+
+/*
+ * Flags to read() describing how a kstat should be returned.
+ */
+#define	KSR_READ_BUFFER		0x1	/* raw data as a Buffer */
+#define	KSR_READ_LAZY		0x2	/* decode data on first access */
+
+/*
+ * A reader can publish the kstats that it reads into a POSIX shared memory
+ * segment, from which any number of subscribers on the same system can decode
+ * them without reading anything from the kernel.  The segment starts with a
+ * header describing its layout, followed by a record for each kstat: the
+ * record's length, and a snapshot of the kstat in which any named strings are
+ * stored as offsets into its data.  The publisher makes ksh_seq odd while it
+ * rewrites the segment and even again when it is done; a subscriber copies
+ * the segment out and tries again if the sequence changed while it did so.
+ */
+#define	KSR_SHM_MAGIC		0x6b737461	/* "ksta" */
+#define	KSR_SHM_VERSION		1
+#define	KSR_SHM_MINSIZE		(64 * 1024)
+#define	KSR_SHM_RETRIES		1000
+
+typedef struct ksr_shmhdr {
+	uint32_t ksh_magic;
+	uint32_t ksh_version;
+	uint32_t ksh_hdrsize;		/* sizeof (ksr_shmhdr_t) */
+	uint32_t ksh_kstatsize;		/* sizeof (kstat_t) */
+	uint32_t ksh_namedsize;		/* sizeof (kstat_named_t) */
+	uint32_t ksh_count;		/* number of records */
+	uint64_t ksh_seq;		/* odd while being written */
+	uint64_t ksh_size;		/* bytes in use, including header */
+	int64_t ksh_chain;		/* kstat chain ID when published */
+	int64_t ksh_time;		/* gethrtime() when published */
+} ksr_shmhdr_t;
+
+#define	KSR_SHM_ALIGN(x)	(((x) + sizeof (uint64_t) - 1) & \
+	~(sizeof (uint64_t) - 1))
+
+/*
+ * A reader can also sample the numeric fields of the kstats it matches into a
+ * Float64Array, normally over a SharedArrayBuffer so that worker threads can
+ * see each sample without it being copied to them.  The array starts with a
+ * header, followed by a slot for each kstat: its snaptime (zero if it could
+ * not be read) and then the value of each of its fields.  Which kstat and
+ * field lives where is fixed until the set of matching kstats (or the fields
+ * of one of them) changes; each change bumps ksa_generation, and layout()
+ * describes the current layout.  As with a published segment, ksa_seq is odd
+ * while a sample is being written; it is 32 bits wide so that JavaScript can
+ * use Atomics on it through an Int32Array.
+ */
+typedef struct ksr_samplehdr {
+	int32_t ksa_seq;		/* odd while being written */
+	int32_t ksa_generation;		/* bumped when the layout changes */
+	int32_t ksa_nslots;		/* number of kstats */
+	int32_t ksa_nvalues;		/* values in use, including header */
+	double ksa_time;		/* gethrtime() of the sample */
+	double ksa_chain;		/* kstat chain ID of the sample */
+} ksr_samplehdr_t;
+
+#define	KSR_SAMPLE_HDR		(sizeof (ksr_samplehdr_t) / sizeof (double))
+
+typedef struct ksr_sampleslot {
+	kstat_t *ksl_ksp;
+	kid_t ksl_kid;
+	string ksl_class;
+	string ksl_module;
+	string ksl_name;
+	int ksl_instance;
+	bool ksl_ok;			/* read succeeded this time */
+	unsigned int ksl_ndata;		/* ks_ndata when laid out */
+	size_t ksl_offset;		/* index of the slot's snaptime */
+	vector<string> ksl_fields;
+	vector<int> ksl_index;		/* where named fields were found */
+} ksr_sampleslot_t;
+
+/*
+ * Each instance of the addon (one for the main thread, and one for each worker
+ * thread that loads it) has its own constructors and its own key for tagging
+ * objects with kstat IDs; nothing that refers to a JavaScript value is shared
+ * between instances.
+ */
+typedef struct ksr_instance {
+	napi_ref ki_reader;		/* Reader constructor */
+	napi_ref ki_handle;		/* Handle constructor */
+	napi_ref ki_cursor;		/* Cursor constructor */
+	napi_ref ki_keys;		/* object holding the kstat ID key */
+	int64_t ki_coalesced;		/* coalescing table, as last reported */
+} ksr_instance_t;
+
+static ksr_instance_t *
+ksr_instdata(napi_env env)
+{
+	void *data = NULL;
+
+	(void) napi_get_instance_data(env, &data);
+
+	return ((ksr_instance_t *)data);
+}
+
+static void
+ksr_instance_free(napi_env env, void *data, void *hint)
+{
+	ksr_instance_t *ki = (ksr_instance_t *)data;
+
+	(void) napi_delete_reference(env, ki->ki_reader);
+	(void) napi_delete_reference(env, ki->ki_handle);
+	(void) napi_delete_reference(env, ki->ki_cursor);
+	(void) napi_delete_reference(env, ki->ki_keys);
+	delete ki;
+}
+
+/*
+ * Thrown once a JavaScript exception has been raised from deep within a read,
+ * to unwind to the method that JavaScript called; that method returns with the
+ * exception still pending.
+ */
+typedef struct ksr_pending {
+} ksr_pending_t;
+
+/*
+ * Helpers for building and taking apart JavaScript values.  Failures (which
+ * can only be due to a pending exception) leave the value NULL, which
+ * Node-API treats as undefined.
+ */
+static napi_value
+ksr_number(napi_env env, double value)
+{
+	napi_value rval = NULL;
+
+	(void) napi_create_double(env, value, &rval);
+
+	return (rval);
+}
+
+static napi_value
+ksr_string(napi_env env, const char *str)
+{
+	napi_value rval = NULL;
+
+	(void) napi_create_string_utf8(env, str, NAPI_AUTO_LENGTH, &rval);
+
+	return (rval);
+}
+
+static napi_value
+ksr_boolean(napi_env env, bool value)
+{
+	napi_value rval = NULL;
+
+	(void) napi_get_boolean(env, value, &rval);
+
+	return (rval);
+}
+
+static napi_value
+ksr_null(napi_env env)
+{
+	napi_value rval = NULL;
+
+	(void) napi_get_null(env, &rval);
+
+	return (rval);
+}
+
+static napi_value
+ksr_object(napi_env env)
+{
+	napi_value rval = NULL;
+
+	(void) napi_create_object(env, &rval);
+
+	return (rval);
+}
+
+static napi_value
+ksr_array(napi_env env, size_t length = 0)
+{
+	napi_value rval = NULL;
+
+	(void) napi_create_array_with_length(env, length, &rval);
+
+	return (rval);
+}
+
+static void
+ksr_set(napi_env env, napi_value obj, const char *name, napi_value value)
+{
+	(void) napi_set_named_property(env, obj, name, value);
+}
+
+static napi_value
+ksr_get(napi_env env, napi_value obj, const char *name)
+{
+	napi_value rval = NULL;
+
+	(void) napi_get_named_property(env, obj, name, &rval);
+
+	return (rval);
+}
+
+static bool
+ksr_has(napi_env env, napi_value obj, const char *name)
+{
+	bool rval = false;
+
+	(void) napi_has_named_property(env, obj, name, &rval);
+
+	return (rval);
+}
+
+static void
+ksr_unset(napi_env env, napi_value obj, const char *name)
+{
+	if (ksr_has(env, obj, name))
+		(void) napi_delete_property(env, obj, ksr_string(env, name),
+		    NULL);
+}
+
+static void
+ksr_setelem(napi_env env, napi_value arr, uint32_t i, napi_value value)
+{
+	(void) napi_set_element(env, arr, i, value);
+}
+
+static napi_value
+ksr_getelem(napi_env env, napi_value arr, uint32_t i)
+{
+	napi_value rval = NULL;
+
+	(void) napi_get_element(env, arr, i, &rval);
+
+	return (rval);
+}
+
+static napi_valuetype
+ksr_type(napi_env env, napi_value value)
+{
+	napi_valuetype type = napi_undefined;
+
+	if (value != NULL)
+		(void) napi_typeof(env, value, &type);
+
+	return (type);
+}
+
+static bool
+ksr_isarray(napi_env env, napi_value value)
+{
+	bool rval = false;
+
+	if (value != NULL)
+		(void) napi_is_array(env, value, &rval);
+
+	return (rval);
+}
+
+static bool
+ksr_isbuffer(napi_env env, napi_value value)
+{
+	bool rval = false;
+
+	if (value != NULL)
+		(void) napi_is_buffer(env, value, &rval);
+
+	return (rval);
+}
+
+/*
+ * Return the value coerced to a string, as UTF-8.
+ */
+static string
+ksr_utf8(napi_env env, napi_value value)
+{
+	napi_value str;
+	vector<char> buf;
+	size_t len;
+
+	if (napi_coerce_to_string(env, value, &str) != napi_ok ||
+	    napi_get_value_string_utf8(env, str, NULL, 0, &len) != napi_ok)
+		return (string());
+
+	buf.resize(len + 1);
+	(void) napi_get_value_string_utf8(env, str, buf.data(), len + 1, &len);
+
+	return (string(buf.data(), len));
+}
+
+/*
+ * Fetch the arguments of a method call (any that weren't passed are left
+ * undefined) and the native object that the method was called on, throwing if
+ * it wasn't called on one of ours.
+ */
+template <class T> static T *
+ksr_unwrap(napi_env env, napi_callback_info info, napi_value *argv,
+    size_t argc, napi_value *selfp = NULL)
+{
+	napi_value self;
+	void *obj = NULL;
+
+	if (napi_get_cb_info(env, info, &argc, argv, &self, NULL) != napi_ok ||
+	    napi_unwrap(env, self, &obj) != napi_ok || obj == NULL) {
+		(void) napi_throw_type_error(env, NULL,
+		    "method called on an incompatible object");
+		return (NULL);
+	}
+
+	if (selfp != NULL)
+		*selfp = self;
+
+	return ((T *)obj);
+}
+
+/*
+ * Sets each statistic that the decoding core visits as a property of an
+ * object.
+ */
+class ksr_objvisitor : public ksr_visitor {
+public:
+	ksr_objvisitor(napi_env env, napi_value obj) :
+	    kov_env(env), kov_obj(obj) {}
+
+	void number(const char *name, double value) {
+		ksr_set(kov_env, kov_obj, name, ksr_number(kov_env, value));
+	}
+
+	void text(const char *name, const char *value) {
+		ksr_set(kov_env, kov_obj, name, ksr_string(kov_env, value));
+	}
+
+private:
+	napi_env kov_env;
+	napi_value kov_obj;
+};
+
+/*
+ * A sparse read returns each kstat's statistics as a list of the indexes of
+ * those that are nonzero (or, when reading changes, that have changed since
+ * the reader last read the kstat so) and a list of their values, against a
+ * schema -- a list of the names of all of its statistics -- that is shared by
+ * every kstat with the same statistics.  A row holds one kstat's statistics
+ * as they are decoded; a reader reading changes keeps the last row of each
+ * kstat.
+ */
+typedef struct ksr_sparseval {
+	bool ksv_text;
+	double ksv_number;
+	string ksv_str;
+} ksr_sparseval_t;
+
+class ksr_sparserow : public ksr_visitor {
+public:
+	void number(const char *name, double value) {
+		ksr_sparseval_t v = { false, value, "" };
+
+		kspr_key.append(name).push_back('\0');
+		kspr_values.push_back(v);
+	}
+
+	void text(const char *name, const char *value) {
+		ksr_sparseval_t v = { true, 0, value };
+
+		kspr_key.append(name).push_back('\0');
+		kspr_values.push_back(v);
+	}
+
+	string kspr_key;			/* the names, each terminated */
+	vector<ksr_sparseval_t> kspr_values;
+};
+
+typedef map<kid_t, vector<ksr_sparseval_t> > ksr_sparsestate_t;
+
+typedef struct ksr_sparsectx {
+	bool ksc_changed;			/* omit unchanged, not zero */
+	ksr_sparsestate_t *ksc_state;		/* last values, if changed */
+	map<string, uint32_t> ksc_index;	/* schema indexes by key */
+	napi_value ksc_schemas;
+} ksr_sparsectx_t;
+
+class KStatReader {
+	friend class KStatHandle;
+	friend class KStatCursor;
+	friend class KStatSubscriber;
 
-	KStatReader(string *module, string *classname,
+public:
+	static napi_value Initialize(napi_env env, napi_value exports);
+
+protected:
+	KStatReader(napi_env, string *module, string *classname,
 	    string *name, int instance);
 	void close();
-	Local<Value> error(Isolate *isolate, const char *fmt, ...);
-	Local<Value> read(Isolate *, kstat_t *);
-	Local<Value> list(Isolate *, kstat_t *);
-	bool matches(kstat_t *, string *, string *, string *, int64_t);
-	int update();
+	static napi_value error(napi_env env, const char *fmt, ...);
+	napi_value read(napi_env, kstat_t *, int);
+	napi_value rank(napi_env, string *, string *, string *, int64_t, int,
+	    const string&, bool, size_t);
+	napi_value sparse(napi_env, kstat_t *, ksr_sparsectx_t *);
+	void refresh(napi_env, napi_value, kstat_t *, int);
+	napi_value list(napi_env, kstat_t *);
+	static bool matches(kstat_t *, string *, string *, string *, int64_t);
+	bool backingoff(kstat_t *);
+	kid_t kread(kstat_t *);
+	bool keep(kstat_t *);
+	kstat_t *previous(kstat_t *);
+	kid_t coalesced(kstat_t *);
+	void coalesce(kstat_t *, kid_t);
+	void record(kstat_t *, ksr_phase, hrtime_t);
+	void memory(ksr_memory_t *);
+	void evict(size_t);
+	void account(napi_env);
+	static napi_value header(napi_env, kstat_t *);
+	static void contents(napi_env, napi_value, kstat_t *, int);
+	int publish(const char *, vector<kstat_t *>&);
+	void unpublish();
+	size_t sampleread(vector<kstat_t *>&, size_t);
+	void samplewrite(double *);
+	int update(bool force = false);
+	bool stale();
+	int chainwatch(napi_env, int64_t);
+	void unchainwatch();
+	void ratesample(kstat_t *);
+	static void ratewindow(ksr_ratehist_t *, hrtime_t);
 	int getkcid();
 	~KStatReader();
 
-	static void Close(const FunctionCallbackInfo<Value>& args);
-	static void New(const FunctionCallbackInfo<Value>& args);
-	static void Read(const FunctionCallbackInfo<Value>& args);
-	static void List(const FunctionCallbackInfo<Value>& args);
-	static void getKCID(const FunctionCallbackInfo<Value>& args);
-	static void getKstat(const FunctionCallbackInfo<Value>& args);
-	static void Update(const FunctionCallbackInfo<Value>& args);
-
+	static void finalize(napi_env, void *, void *);
+	static napi_value Close(napi_env, napi_callback_info);
+	static napi_value New(napi_env, napi_callback_info);
+	static napi_value Read(napi_env, napi_callback_info);
+	static napi_value List(napi_env, napi_callback_info);
+	static napi_value getKCID(napi_env, napi_callback_info);
+	static napi_value getKstat(napi_env, napi_callback_info);
+	static napi_value Update(napi_env, napi_callback_info);
+	static napi_value Watch(napi_env, napi_callback_info);
+	static napi_value Unwatch(napi_env, napi_callback_info);
+	static napi_value CheckWatch(napi_env, napi_callback_info);
+	static napi_value StartWatch(napi_env, napi_callback_info);
+	static napi_value StopWatch(napi_env, napi_callback_info);
+	static napi_value Schedule(napi_env, napi_callback_info);
+	static napi_value Unschedule(napi_env, napi_callback_info);
+	static napi_value Histogram(napi_env, napi_callback_info);
+	static napi_value GetHistogram(napi_env, napi_callback_info);
+	static napi_value Unhistogram(napi_env, napi_callback_info);
+	static napi_value Failures(napi_env, napi_callback_info);
+	static napi_value Refresh(napi_env, napi_callback_info);
+	static napi_value Previous(napi_env, napi_callback_info);
+	static napi_value Prepare(napi_env, napi_callback_info);
+	static napi_value Iterate(napi_env, napi_callback_info);
+	static napi_value Publish(napi_env, napi_callback_info);
+	static napi_value Sample(napi_env, napi_callback_info);
+	static napi_value Layout(napi_env, napi_callback_info);
+	static napi_value Arrow(napi_env, napi_callback_info);
+	static napi_value Stats(napi_env, napi_callback_info);
+	static napi_value MemoryUsage(napi_env, napi_callback_info);
 
 private:
-	static string *stringMember(Isolate *, Local<Value>, char *, char *);
-	static int64_t intMember(Isolate *, Local<Value>, char *, int64_t);
-	Local<Object> data_raw_cpu_stat(Isolate *, kstat_t *);
-	Local<Object> data_raw_var(Isolate *, kstat_t *);
-	Local<Object> data_raw_ncstats(Isolate *, kstat_t *);
-	Local<Object> data_raw_sysinfo(Isolate *, kstat_t *);
-	Local<Object> data_raw_vminfo(Isolate *, kstat_t *);
-	Local<Object> data_raw_mntinfo(Isolate *, kstat_t *);
-	Local<Object> data_raw(Isolate *, kstat_t *);
-	Local<Object> data_named(Isolate *, kstat_t *);
-	Local<Object> data_intr(Isolate *, kstat_t *);
-	Local<Object> data_io(Isolate *, kstat_t *);
-	Local<Object> data_timer(Isolate *, kstat_t *);
-
+	static string *stringMember(napi_env, napi_value, const char *,
+	    const char *);
+	static int64_t intMember(napi_env, napi_value, const char *, int64_t);
+	static double numberMember(napi_env, napi_value, const char *, double);
+	static bool boolMember(napi_env, napi_value, const char *, bool);
+	static void watchtimer(uv_timer_t *);
+	static void watchclose(uv_handle_t *);
+	static void chainwatcher(void *);
+	static void chainnotify(uv_async_t *);
+	static void chainclose(uv_handle_t *);
+	static bool samplevalue(ksr_sampleslot_t *, size_t, double *);
+	static int readflags(napi_env, napi_value);
+	static napi_value key(napi_env, const char *);
+	static kid_t kidof(napi_env, napi_value);
+	int checkwatches(napi_env, napi_value);
+	void stopwatch();
+	static int64_t schednow();
+	static void schedtimer(uv_timer_t *);
+	void schedarm();
+	void unschedule();
+	static napi_value namedvalue(napi_env, kstat_t *, kstat_named_t *);
+	static napi_value decode(napi_env, kstat_t *, napi_value);
+	static napi_value dataobject(napi_env, kstat_t *);
+	static size_t snapsize(kstat_t *);
+	static kstat_t *snapshot(kstat_t *, void *);
+	static void rebase(kstat_t *, const char *);
+	static napi_value lazydata(napi_env, napi_callback_info);
+	static void lazyfree(napi_env, void *, void *);
+
+	napi_env ksr_env;
+	napi_ref ksr_self;
 	string *ksr_module;
 	string *ksr_class;
 	string *ksr_name;
@@ -67,27 +820,206 @@ private:
 	kid_t ksr_kid;
 	kstat_ctl_t *ksr_ctl;
 	vector<kstat_t *> ksr_kstats;
+	vector<ksr_watch_t *> ksr_watches;
+	int ksr_watchid;
+	uv_timer_t *ksr_timer;
+	napi_ref ksr_watchcb;
+	napi_async_context ksr_watchctx;
+	vector<ksr_schedentry_t> ksr_sched;
+	uv_timer_t *ksr_schedtimer;
+	napi_ref ksr_schedcb;
+	napi_async_context ksr_schedctx;
+	vector<ksr_ratehist_t *> ksr_ratehists;
+	int ksr_ratehistid;
+	map<string, map<kid_t, ksr_watchstate_t> > ksr_rankstate;
+	map<string, ksr_sparsestate_t> ksr_sparsestate;	/* by spec */
+	ksr_refresh_t ksr_refresh;
+	hrtime_t ksr_refreshint;
+	hrtime_t ksr_lastupdate;
+	bool ksr_stale;
+	ksr_chainwatch_t *ksr_chainwatch;
+	hrtime_t ksr_backoff;
+	map<kid_t, ksr_failure_t> ksr_failures;
+	bool ksr_snapshots;
+	map<kid_t, ksr_snap> ksr_snaps;
+	hrtime_t ksr_coalesce;
+	bool ksr_instrument;
+	map<string, ksr_modstats_t> ksr_modstats;
+	ksr_counters_t ksr_counters;
+	size_t ksr_chainmem;
+	size_t ksr_datamem;
+	size_t ksr_snapmem;
+	size_t ksr_memlimit;
+	uint32_t ksr_reopens;		/* times the chain has been reopened */
+	bool ksr_overlimit;		/* limit can't be met by evicting */
+	int64_t ksr_external;
+	string ksr_shmname;
+	int ksr_shmfd;
+	char *ksr_shm;
+	size_t ksr_shmsize;
+	vector<char> ksr_shmbuf;
+	vector<ksr_sampleslot_t> ksr_slots;
+	size_t ksr_samplevalues;
+	int32_t ksr_generation;
+};
+
+/*
+ * A handle is a kstat that has been looked up once, for reading repeatedly.
+ * The kstat (and the positions of any named fields asked for) are only looked
+ * up again if the chain changes.
+ */
+class KStatHandle {
+public:
+	static void Initialize(napi_env);
+	static napi_value New(napi_env, KStatReader *, napi_value, napi_value);
+
+protected:
+	KStatHandle(napi_env, KStatReader *, napi_value, string *, int,
+	    string *);
+	~KStatHandle();
+	kstat_t *resolve();
+	napi_value project(napi_env, kstat_t *);
+
+	static void finalize(napi_env, void *, void *);
+	static napi_value Construct(napi_env, napi_callback_info);
+	static napi_value Read(napi_env, napi_callback_info);
+
+private:
+	napi_env kh_env;
+	KStatReader *kh_reader;
+	napi_ref kh_readerobj;
+	string kh_module;
+	int kh_instance;
+	string kh_name;
+	kstat_t *kh_ksp;
+	kid_t kh_chain;
+	uint32_t kh_reopens;
+	vector<string> kh_fields;
+	vector<int> kh_index;
+};
+
+/*
+ * A cursor walks the kstats that matched a specification when it was created,
+ * a batch at a time.  The set (and order) of kstats is fixed at creation; if
+ * the chain changes underneath us, kstats that have gone are skipped.
+ */
+class KStatCursor {
+public:
+	static void Initialize(napi_env);
+	static napi_value New(napi_env, KStatReader *, napi_value, napi_value,
+	    napi_value);
+
+protected:
+	KStatCursor(napi_env, KStatReader *, napi_value);
+	~KStatCursor();
+	void resolve();
+
+	static void finalize(napi_env, void *, void *);
+	static napi_value Construct(napi_env, napi_callback_info);
+	static napi_value Next(napi_env, napi_callback_info);
+
+private:
+	napi_env kc_env;
+	KStatReader *kc_reader;
+	napi_ref kc_readerobj;
+	vector<kstat_t *> kc_kstats;
+	vector<kid_t> kc_ids;
+	kid_t kc_chain;
+	uint32_t kc_reopens;
+	size_t kc_next;
+	size_t kc_batch;
+	bool kc_list;
+	int kc_flags;
 };
 
-Persistent<FunctionTemplate> KStatReader::templ;
+#define	KSR_BATCH_DEFAULT	100
+
+/*
+ * A subscriber maps a segment published by a reader (possibly in another
+ * process) and decodes the kstats in it.
+ */
+class KStatSubscriber {
+public:
+	static void Initialize(napi_env, napi_value exports);
+
+protected:
+	KStatSubscriber(string *);
+	~KStatSubscriber();
+	int map();
+	void close();
+	int copy();
+
+	static void finalize(napi_env, void *, void *);
+	static napi_value New(napi_env, napi_callback_info);
+	static napi_value Read(napi_env, napi_callback_info);
+	static napi_value Close(napi_env, napi_callback_info);
+
+private:
+	string *kss_name;
+	int kss_fd;
+	char *kss_shm;
+	size_t kss_size;
+	vector<char> kss_buf;
+};
 
-KStatReader::KStatReader(string *module, string *classname,
+KStatReader::KStatReader(napi_env env, string *module, string *classname,
     string *name, int instance)
-    : node::ObjectWrap(), ksr_module(module), ksr_class(classname),
-    ksr_name(name), ksr_instance(instance), ksr_kid(-1)
+    : ksr_env(env), ksr_self(NULL), ksr_module(module), ksr_class(classname),
+    ksr_name(name), ksr_instance(instance), ksr_kid(-1), ksr_watchid(0),
+    ksr_timer(NULL), ksr_watchcb(NULL), ksr_watchctx(NULL),
+    ksr_schedtimer(NULL), ksr_schedcb(NULL), ksr_schedctx(NULL),
+    ksr_ratehistid(0),
+    ksr_refresh(KSR_REFRESH_ALWAYS), ksr_refreshint(0), ksr_lastupdate(0),
+    ksr_stale(false), ksr_chainwatch(NULL),
+    ksr_backoff(KSR_BACKOFF_DEFAULT * 1000000LL),
+    ksr_snapshots(false), ksr_coalesce(0), ksr_instrument(false),
+    ksr_chainmem(0), ksr_datamem(0), ksr_snapmem(0), ksr_memlimit(0),
+    ksr_reopens(0), ksr_overlimit(false), ksr_external(0), ksr_shmfd(-1),
+    ksr_shm(NULL), ksr_shmsize(0),
+    ksr_samplevalues(KSR_SAMPLE_HDR), ksr_generation(0)
 {
+	(void) memset(&ksr_counters, 0, sizeof (ksr_counters));
+
 	if ((ksr_ctl = kstat_open()) == NULL)
 		throw "could not open kstat";
 };
 
 KStatReader::~KStatReader()
 {
+	int64_t adjusted;
+
 	delete ksr_module;
 	delete ksr_class;
 	delete ksr_name;
 
+	for (size_t i = 0; i < ksr_watches.size(); i++)
+		delete ksr_watches[i];
+
+	for (size_t i = 0; i < ksr_ratehists.size(); i++)
+		delete ksr_ratehists[i];
+
+	this->stopwatch();
+	this->unschedule();
+	this->unchainwatch();
+	this->unpublish();
+
 	if (ksr_ctl != NULL)
 		this->close();
+
+	if (ksr_external != 0) {
+		(void) napi_adjust_external_memory(ksr_env, -ksr_external,
+		    &adjusted);
+	}
+}
+
+void
+KStatReader::finalize(napi_env env, void *data, void *hint)
+{
+	KStatReader *k = (KStatReader *)data;
+	napi_ref self = k->ksr_self;
+
+	delete k;
+	(void) napi_delete_reference(env, self);
 }
 
 void
@@ -95,6 +1027,9 @@ KStatReader::close()
 {
 	kstat_close(ksr_ctl);
 	ksr_ctl = NULL;
+	ksr_kstats.clear();
+	ksr_snaps.clear();
+	ksr_chainmem = ksr_datamem = ksr_snapmem = 0;
 }
 
 bool
@@ -119,746 +1054,4476 @@ KStatReader::getkcid()
 	return((int) ksr_ctl->kc_chain_id);
 }
 
+template <typename T> static void
+prune(map<kid_t, T>& m, set<kid_t>& live)
+{
+	typename map<kid_t, T>::iterator it;
+
+	for (it = m.begin(); it != m.end(); ) {
+		if (live.count(it->first) == 0)
+			m.erase(it++);
+		else
+			it++;
+	}
+}
+
+/*
+ * Determine whether our refresh policy calls for the chain to be brought up
+ * to date now.
+ */
+bool
+KStatReader::stale()
+{
+	switch (ksr_refresh) {
+	case KSR_REFRESH_INTERVAL:
+		return (gethrtime() - ksr_lastupdate >= ksr_refreshint);
+
+	case KSR_REFRESH_WATCH:
+		return (__atomic_exchange_n(&ksr_chainwatch->kcw_stale, 0,
+		    __ATOMIC_ACQ_REL) != 0);
+
+	default:
+		return (true);
+	}
+}
+
+/*
+ * Bring the chain up to date, if our refresh policy (or the caller) says that
+ * it may have changed.
+ */
 int
-KStatReader::update()
+KStatReader::update(bool force)
 {
 	kstat_t *ksp;
 	kid_t kid;
 
+	if (!force && ksr_kid != -1 && !ksr_stale && !this->stale()) {
+		ksr_counters.kct_skipped++;
+		return (0);
+	}
+
+	ksr_stale = false;
+	ksr_lastupdate = gethrtime();
+	ksr_counters.kct_updates++;
+
 	if ((kid = kstat_chain_update(ksr_ctl)) == 0 && ksr_kid != -1)
 		return (0);
 
 	if (kid == -1)
 		return (-1);
 
-	ksr_kid = kid;
+	ksr_counters.kct_changes++;
+
+	ksr_kid = ksr_ctl->kc_chain_id;
 	ksr_kstats.clear();
 
+	if (!ksr_failures.empty() || !ksr_snaps.empty() ||
+	    !ksr_watches.empty() || !ksr_ratehists.empty() ||
+	    !ksr_rankstate.empty() || !ksr_sparsestate.empty()) {
+		/*
+		 * Forget about any kstats that have left the chain.
+		 */
+		set<kid_t> live;
+
+		for (ksp = ksr_ctl->kc_chain; ksp != NULL; ksp = ksp->ks_next)
+			live.insert(ksp->ks_kid);
+
+		prune(ksr_failures, live);
+		prune(ksr_snaps, live);
+
+		for (map<string, ksr_sparsestate_t>::iterator it =
+		    ksr_sparsestate.begin(); it != ksr_sparsestate.end(); ) {
+			prune(it->second, live);
+
+			if (it->second.empty())
+				ksr_sparsestate.erase(it++);
+			else
+				it++;
+		}
+
+		for (size_t i = 0; i < ksr_watches.size(); i++)
+			prune(ksr_watches[i]->kw_state, live);
+
+		for (size_t i = 0; i < ksr_ratehists.size(); i++)
+			prune(ksr_ratehists[i]->krh_state, live);
+
+		for (map<string, map<kid_t, ksr_watchstate_t> >::iterator it =
+		    ksr_rankstate.begin(); it != ksr_rankstate.end(); it++)
+			prune(it->second, live);
+	}
+
+	/*
+	 * libkstat may have freed (or resized) any of the data buffers, so
+	 * count them again.
+	 */
+	ksr_chainmem = ksr_datamem = ksr_snapmem = 0;
+
+	for (ksp = ksr_ctl->kc_chain; ksp != NULL; ksp = ksp->ks_next) {
+		ksr_chainmem += sizeof (kstat_t);
+
+		if (ksp->ks_data != NULL)
+			ksr_datamem += ksp->ks_data_size;
+	}
+
+	for (map<kid_t, ksr_snap>::iterator it = ksr_snaps.begin();
+	    it != ksr_snaps.end(); it++) {
+		ksr_snapmem += KSR_MAPNODE + sizeof (ksr_snap) +
+		    it->second.kss_size[0] + it->second.kss_size[1];
+	}
+
 	for (ksp = ksr_ctl->kc_chain; ksp != NULL; ksp = ksp->ks_next) {
 		if (!this->matches(ksp,
 		    ksr_module, ksr_class, ksr_name, ksr_instance))
 			continue;
 
-		ksr_kstats.push_back(ksp);
+		ksr_kstats.push_back(ksp);
+	}
+
+	return (0);
+}
+
+bool
+KStatReader::backingoff(kstat_t *ksp)
+{
+	map<kid_t, ksr_failure_t>::iterator it;
+
+	if (ksr_failures.empty() ||
+	    (it = ksr_failures.find(ksp->ks_kid)) == ksr_failures.end())
+		return (false);
+
+	return (gethrtime() < it->second.kf_retry);
+}
+
+/*
+ * Read a kstat, remembering failures.  If the kstat failed recently and we
+ * are still backing off from it, we return -1 with errno set to the original
+ * error without making the system call.
+ */
+kid_t
+KStatReader::kread(kstat_t *ksp)
+{
+	map<kid_t, ksr_failure_t>::iterator it = ksr_failures.end();
+	hrtime_t now, start;
+	size_t datasize;
+	kid_t kid;
+
+	if (!ksr_failures.empty() &&
+	    (it = ksr_failures.find(ksp->ks_kid)) != ksr_failures.end() &&
+	    gethrtime() < it->second.kf_retry) {
+		errno = it->second.kf_errno;
+		return (-1);
+	}
+
+	start = ksr_instrument ? gethrtime() : 0;
+	datasize = ksp->ks_data != NULL ? ksp->ks_data_size : 0;
+	ksr_counters.kct_reads++;
+
+	if (ksr_coalesce > 0 && (kid = this->coalesced(ksp)) != -1) {
+		/*
+		 * Another reader has read this kstat recently enough.
+		 */
+		ksr_counters.kct_coalesced++;
+	} else if ((kid = kstat_read(ksr_ctl, ksp, NULL)) != -1 &&
+	    ksr_coalesce > 0) {
+		this->coalesce(ksp, kid);
+	}
+
+	if (ksr_instrument)
+		this->record(ksp, kid == -1 ? KSP_NPHASES : KSP_READ,
+		    gethrtime() - start);
+
+	/*
+	 * kstat_read() allocates the data buffer on first use, and may
+	 * reallocate it if the kstat has grown.
+	 */
+	ksr_datamem += (ksp->ks_data != NULL ? ksp->ks_data_size : 0) - datasize;
+
+	if (kid == -1)
+		ksr_counters.kct_errors++;
+
+	/*
+	 * A read returns the kernel's chain ID, so it tells us for free when
+	 * our chain is out of date.
+	 */
+	if ((kid == -1 && errno == ENXIO) || (kid != -1 && kid != ksr_kid))
+		ksr_stale = true;
+
+	if (kid != -1) {
+		if (it != ksr_failures.end())
+			ksr_failures.erase(it);
+
+		if (ksr_snapshots && !this->keep(ksp)) {
+			errno = ENOMEM;
+			return (-1);
+		}
+
+		if (!ksr_ratehists.empty())
+			this->ratesample(ksp);
+
+		return (kid);
+	}
+
+	if (ksr_backoff <= 0)
+		return (-1);
+
+	now = gethrtime();
+
+	if (it == ksr_failures.end()) {
+		ksr_failure_t kf;
+
+		kf.kf_class = ksp->ks_class;
+		kf.kf_module = ksp->ks_module;
+		kf.kf_name = ksp->ks_name;
+		kf.kf_instance = ksp->ks_instance;
+		kf.kf_count = 0;
+		kf.kf_backoff = 0;
+		it = ksr_failures.insert(std::make_pair(ksp->ks_kid, kf)).first;
+	}
+
+	ksr_failure_t *kfp = &it->second;
+
+	kfp->kf_errno = errno;
+	kfp->kf_count++;
+	kfp->kf_backoff = kfp->kf_backoff == 0 ?
+	    KSR_BACKOFF_INITIAL : kfp->kf_backoff * 2;
+
+	if (kfp->kf_backoff > ksr_backoff)
+		kfp->kf_backoff = ksr_backoff;
+
+	kfp->kf_retry = now + kfp->kf_backoff;
+
+	return (-1);
+}
+
+/*
+ * If some reader read this kstat within our window, copy what it read into
+ * the kstat's data and return the chain ID that its read returned; otherwise
+ * return -1.  We only copy into data that libkstat has already allocated (and
+ * that is still the same size), so the first read of a kstat by any one reader
+ * always goes to the kernel.
+ */
+kid_t
+KStatReader::coalesced(kstat_t *ksp)
+{
+	map<kid_t, ksr_coalesced_t>::iterator it;
+	kstat_t *snap;
+	kid_t kid = -1;
+
+	if (ksp->ks_data == NULL)
+		return (-1);
+
+	uv_mutex_lock(&ksr_coalesce_lock);
+
+	if ((it = ksr_coalesced.find(ksp->ks_kid)) == ksr_coalesced.end() ||
+	    gethrtime() - it->second.kco_time > ksr_coalesce)
+		goto out;
+
+	snap = (kstat_t *)it->second.kco_snap.data();
+
+	if (snap->ks_type != ksp->ks_type ||
+	    snap->ks_data_size != ksp->ks_data_size)
+		goto out;
+
+	(void) memcpy(ksp->ks_data, snap->ks_data, snap->ks_data_size);
+	ksp->ks_ndata = snap->ks_ndata;
+	ksp->ks_snaptime = snap->ks_snaptime;
+	rebase(ksp, (const char *)snap->ks_data);
+	kid = it->second.kco_chain;
+
+out:
+	uv_mutex_unlock(&ksr_coalesce_lock);
+
+	return (kid);
+}
+
+/*
+ * Offer a kstat that we have just read to other coalescing readers, and
+ * periodically discard what is too old to be of use to any of them.
+ */
+void
+KStatReader::coalesce(kstat_t *ksp, kid_t kid)
+{
+	map<kid_t, ksr_coalesced_t>::iterator it;
+	ksr_coalesced_t *kco;
+	hrtime_t now = gethrtime();
+
+	uv_mutex_lock(&ksr_coalesce_lock);
+
+	kco = &ksr_coalesced[ksp->ks_kid];
+	kco->kco_time = now;
+	kco->kco_chain = kid;
+	ksr_coalesce_mem -= kco->kco_snap.size();
+	kco->kco_snap.resize(snapsize(ksp));
+	ksr_coalesce_mem += kco->kco_snap.size();
+	(void) snapshot(ksp, kco->kco_snap.data());
+
+	if (++ksr_coalesce_reads >= KSR_COALESCE_SWEEP) {
+		ksr_coalesce_reads = 0;
+
+		for (it = ksr_coalesced.begin(); it != ksr_coalesced.end(); ) {
+			if (now - it->second.kco_time > ksr_coalesce_max) {
+				ksr_coalesce_mem -= it->second.kco_snap.size();
+				ksr_coalesced.erase(it++);
+			}
+			else
+				it++;
+		}
+	}
+
+	uv_mutex_unlock(&ksr_coalesce_lock);
+}
+
+/*
+ * Add a time to the histogram of the given phase for the kstat's module and
+ * class; KSP_NPHASES records a failed read.
+ */
+void
+KStatReader::record(kstat_t *ksp, ksr_phase phase, hrtime_t elapsed)
+{
+	string key = string(ksp->ks_module) + ":" + ksp->ks_class;
+	map<string, ksr_modstats_t>::iterator it;
+	ksr_modstats_t *kms;
+	ksr_hist_t *hist;
+	int bucket = 0;
+
+	if ((it = ksr_modstats.find(key)) == ksr_modstats.end()) {
+		ksr_modstats_t ms;
+
+		ms.kms_module = ksp->ks_module;
+		ms.kms_class = ksp->ks_class;
+		ms.kms_errors = 0;
+		(void) memset(ms.kms_hist, 0, sizeof (ms.kms_hist));
+		it = ksr_modstats.insert(std::make_pair(key, ms)).first;
+	}
+
+	kms = &it->second;
+
+	if (phase == KSP_NPHASES) {
+		kms->kms_errors++;
+		return;
+	}
+
+	hist = &kms->kms_hist[phase];
+
+	while (bucket < KSR_HIST_BUCKETS - 1 && (1LL << bucket) <= elapsed)
+		bucket++;
+
+	hist->kh_count++;
+	hist->kh_total += elapsed;
+	hist->kh_buckets[bucket]++;
+
+	if (elapsed > hist->kh_max)
+		hist->kh_max = elapsed;
+}
+
+void
+KStatReader::memory(ksr_memory_t *km)
+{
+	size_t i;
+
+	km->km_chain = ksr_chainmem;
+	km->km_data = ksr_datamem;
+	km->km_snapshots = ksr_snapmem;
+	km->km_caches = ksr_kstats.capacity() * sizeof (kstat_t *) +
+	    ksr_failures.size() * (KSR_MAPNODE + sizeof (ksr_failure_t)) +
+	    ksr_modstats.size() * (KSR_MAPNODE + sizeof (ksr_modstats_t));
+
+	for (i = 0; i < ksr_watches.size(); i++) {
+		km->km_caches += sizeof (ksr_watch_t) +
+		    ksr_watches[i]->kw_state.size() *
+		    (KSR_MAPNODE + sizeof (ksr_watchstate_t));
+	}
+
+	for (i = 0; i < ksr_ratehists.size(); i++) {
+		km->km_caches += sizeof (ksr_ratehist_t) +
+		    ksr_ratehists[i]->krh_state.size() *
+		    (KSR_MAPNODE + sizeof (ksr_watchstate_t));
+	}
+
+	for (map<string, map<kid_t, ksr_watchstate_t> >::iterator it =
+	    ksr_rankstate.begin(); it != ksr_rankstate.end(); it++) {
+		km->km_caches += KSR_MAPNODE + sizeof (it->second) +
+		    it->first.capacity() + it->second.size() *
+		    (KSR_MAPNODE + sizeof (ksr_watchstate_t));
+	}
+
+	for (map<string, ksr_sparsestate_t>::iterator it =
+	    ksr_sparsestate.begin(); it != ksr_sparsestate.end(); it++) {
+		km->km_caches += KSR_MAPNODE + sizeof (it->second) +
+		    it->first.capacity();
+
+		for (ksr_sparsestate_t::iterator st = it->second.begin();
+		    st != it->second.end(); st++) {
+			km->km_caches += KSR_MAPNODE + sizeof (st->second) +
+			    st->second.capacity() * sizeof (ksr_sparseval_t);
+		}
+	}
+
+	for (i = 0; i < ksr_slots.size(); i++) {
+		km->km_caches += sizeof (ksr_sampleslot_t) +
+		    ksr_slots[i].ksl_fields.capacity() * sizeof (string) +
+		    ksr_slots[i].ksl_index.capacity() * sizeof (int);
+	}
+
+	km->km_publish = ksr_shmbuf.capacity() + ksr_shmsize;
+}
+
+/*
+ * Free what we can until we are using no more than the given number of bytes:
+ * first the snapshot buffers, then the data buffers of kstats in the chain,
+ * which kstat_read() will allocate again when they are next read.  Freeing
+ * the data buffers means reopening the chain, which is only worth doing if
+ * it gets us under the limit; if it wouldn't (the chain and caches alone
+ * being over it), we leave the data be and note that the limit can't be met,
+ * rather than reopen on every call to no effect.
+ */
+void
+KStatReader::evict(size_t limit)
+{
+	ksr_memory_t km;
+	kstat_ctl_t *kc;
+	size_t total;
+	kstat_t *ksp;
+
+	this->memory(&km);
+	total = km.km_chain + km.km_data + km.km_snapshots + km.km_caches +
+	    km.km_publish;
+
+	if (total > limit && !ksr_snaps.empty()) {
+		total -= ksr_snapmem;
+		ksr_snaps.clear();
+		ksr_snapmem = 0;
+	}
+
+	if (total <= limit) {
+		ksr_overlimit = false;
+		return;
+	}
+
+	if (ksr_ctl == NULL || (ksr_overlimit = total - km.km_data > limit))
+		return;
+
+	/*
+	 * The data buffers belong to libkstat, which frees them only along
+	 * with their kstats, so to give them back we open the chain afresh
+	 * and close the old one.  Handles and cursors see ksr_reopens change
+	 * and look their kstats up again; if the chain has also changed, the
+	 * next update starts over, as it does for a new reader.
+	 */
+	if ((kc = kstat_open()) == NULL)
+		return;
+
+	(void) kstat_close(ksr_ctl);
+	ksr_ctl = kc;
+	ksr_reopens++;
+	ksr_datamem = 0;
+	ksr_kstats.clear();
+
+	if (kc->kc_chain_id != ksr_kid) {
+		ksr_kid = -1;
+		return;
+	}
+
+	for (ksp = kc->kc_chain; ksp != NULL; ksp = ksp->ks_next) {
+		if (this->matches(ksp,
+		    ksr_module, ksr_class, ksr_name, ksr_instance))
+			ksr_kstats.push_back(ksp);
+	}
+}
+
+/*
+ * Tell the engine how much native memory we (and the process-wide coalescing
+ * table) are holding, so that it is taken into account when deciding to
+ * collect, evicting first if we are over our limit.  The coalescing table is
+ * accounted to each instance of the addon separately.
+ */
+void
+KStatReader::account(napi_env env)
+{
+	ksr_instance_t *ki = ksr_instdata(env);
+	ksr_memory_t km;
+	int64_t total, coalesced, adjusted;
+
+	if (ksr_memlimit != 0)
+		this->evict(ksr_memlimit);
+
+	this->memory(&km);
+	total = km.km_chain + km.km_data + km.km_snapshots + km.km_caches +
+	    km.km_publish;
+
+	if (total != ksr_external) {
+		(void) napi_adjust_external_memory(env, total - ksr_external,
+		    &adjusted);
+		ksr_external = total;
+	}
+
+	uv_mutex_lock(&ksr_coalesce_lock);
+	coalesced = ksr_coalesce_mem;
+	uv_mutex_unlock(&ksr_coalesce_lock);
+
+	if (ki != NULL && coalesced != ki->ki_coalesced) {
+		(void) napi_adjust_external_memory(env,
+		    coalesced - ki->ki_coalesced, &adjusted);
+		ki->ki_coalesced = coalesced;
+	}
+}
+
+bool
+KStatReader::keep(kstat_t *ksp)
+{
+	size_t size = snapsize(ksp);
+	int next;
+
+	if (ksr_snaps.count(ksp->ks_kid) == 0)
+		ksr_snapmem += KSR_MAPNODE + sizeof (ksr_snap);
+
+	ksr_snap& snap = ksr_snaps[ksp->ks_kid];
+	next = snap.kss_cur ^ 1;
+
+	if (snap.kss_size[next] < size) {
+		char *buf;
+
+		if ((buf = (char *)realloc(snap.kss_buf[next], size)) == NULL)
+			return (false);
+
+		ksr_snapmem += size - snap.kss_size[next];
+		snap.kss_buf[next] = buf;
+		snap.kss_size[next] = size;
+	}
+
+	(void) snapshot(ksp, snap.kss_buf[next]);
+	snap.kss_valid[next] = true;
+	snap.kss_cur = next;
+
+	return (true);
+}
+
+/*
+ * Return the snapshot of the read before last of a kstat, if we have one.
+ */
+kstat_t *
+KStatReader::previous(kstat_t *ksp)
+{
+	map<kid_t, ksr_snap>::iterator it = ksr_snaps.find(ksp->ks_kid);
+	int prev;
+
+	if (it == ksr_snaps.end())
+		return (NULL);
+
+	prev = it->second.kss_cur ^ 1;
+
+	if (!it->second.kss_valid[prev])
+		return (NULL);
+
+	return ((kstat_t *)it->second.kss_buf[prev]);
+}
+
+/*
+ * Publish a snapshot of the given kstats to the named shared memory segment,
+ * creating (or growing) the segment as needed.  Returns the number of kstats
+ * published, or -1 on failure.
+ */
+int
+KStatReader::publish(const char *name, vector<kstat_t *>& kstats)
+{
+	size_t size = sizeof (ksr_shmhdr_t), len, mapsize;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	ksr_shmhdr_t *hdr;
+	uint32_t count = 0;
+	uint64_t seq;
+	struct stat st;
+	size_t i;
+
+	/*
+	 * Assemble the records in a private buffer first, so that the segment
+	 * is only inconsistent for as long as it takes to copy it.
+	 */
+	ksr_shmbuf.resize(size);
+
+	for (i = 0; i < kstats.size(); i++) {
+		kstat_t *ksp = kstats[i], *snap;
+		kstat_named_t *nm;
+		char *rec, *data;
+		unsigned int j;
+
+		if (this->kread(ksp) == -1)
+			continue;
+
+		len = KSR_SHM_ALIGN(sizeof (uint64_t) + snapsize(ksp));
+		ksr_shmbuf.resize(size + len);
+		rec = &ksr_shmbuf[size];
+		*(uint64_t *)rec = len;
+		snap = snapshot(ksp, rec + sizeof (uint64_t));
+		data = (char *)snap->ks_data;
+
+		if (snap->ks_type == KSTAT_TYPE_NAMED) {
+			/*
+			 * Pointers mean nothing to another process, so named
+			 * strings are stored as offsets into the data (with
+			 * any that lie outside of it made empty).
+			 */
+			for (j = 0, nm = KSTAT_NAMED_PTR(snap);
+			    j < snap->ks_ndata; j++, nm++) {
+				char *str = KSTAT_NAMED_STR_PTR(nm);
+
+				if (nm->data_type != KSTAT_DATA_STRING)
+					continue;
+
+				if (str < data || str >= data + snap->ks_data_size) {
+					KSTAT_NAMED_STR_PTR(nm) =
+					    (char *)snap->ks_data_size;
+					KSTAT_NAMED_STR_BUFLEN(nm) = 0;
+					continue;
+				}
+
+				KSTAT_NAMED_STR_PTR(nm) = (char *)(str - data);
+			}
+		}
+
+		snap->ks_data = NULL;
+		size += len;
+		count++;
+	}
+
+	if (ksr_shmfd == -1) {
+		if ((ksr_shmfd = shm_open(name, O_RDWR | O_CREAT, 0644)) == -1)
+			return (-1);
+
+		ksr_shmname = name;
+	}
+
+	if (size > ksr_shmsize) {
+		/*
+		 * Subscribers may have the segment mapped, so it only ever
+		 * grows; they map it again when they see that it has.
+		 */
+		if (fstat(ksr_shmfd, &st) == -1)
+			return (-1);
+
+		mapsize = std::max(size, std::max(ksr_shmsize * 2,
+		    (size_t)KSR_SHM_MINSIZE));
+		mapsize = (mapsize + pagesize - 1) & ~(pagesize - 1);
+
+		if ((size_t)st.st_size > mapsize)
+			mapsize = st.st_size;
+
+		if ((size_t)st.st_size < mapsize &&
+		    ftruncate(ksr_shmfd, mapsize) == -1)
+			return (-1);
+
+		if (ksr_shm != NULL)
+			(void) munmap(ksr_shm, ksr_shmsize);
+
+		ksr_shm = (char *)mmap(NULL, mapsize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, ksr_shmfd, 0);
+
+		if (ksr_shm == MAP_FAILED) {
+			ksr_shm = NULL;
+			ksr_shmsize = 0;
+			return (-1);
+		}
+
+		ksr_shmsize = mapsize;
+	}
+
+	hdr = (ksr_shmhdr_t *)ksr_shm;
+
+	/*
+	 * If an earlier publisher died while writing, its odd sequence number
+	 * is left behind; round it up so that ours is odd while we write.
+	 */
+	seq = (hdr->ksh_seq + 1) & ~1ULL;
+	__atomic_store_n(&hdr->ksh_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	hdr->ksh_magic = KSR_SHM_MAGIC;
+	hdr->ksh_version = KSR_SHM_VERSION;
+	hdr->ksh_hdrsize = sizeof (ksr_shmhdr_t);
+	hdr->ksh_kstatsize = sizeof (kstat_t);
+	hdr->ksh_namedsize = sizeof (kstat_named_t);
+	hdr->ksh_count = count;
+	hdr->ksh_size = size;
+	hdr->ksh_chain = ksr_ctl->kc_chain_id;
+	hdr->ksh_time = gethrtime();
+	(void) memcpy(ksr_shm + sizeof (ksr_shmhdr_t),
+	    &ksr_shmbuf[sizeof (ksr_shmhdr_t)], size - sizeof (ksr_shmhdr_t));
+
+	__atomic_store_n(&hdr->ksh_seq, seq + 2, __ATOMIC_RELEASE);
+
+	return (count);
+}
+
+void
+KStatReader::unpublish()
+{
+	if (ksr_shm != NULL)
+		(void) munmap(ksr_shm, ksr_shmsize);
+
+	if (ksr_shmfd != -1) {
+		(void) ::close(ksr_shmfd);
+		(void) shm_unlink(ksr_shmname.c_str());
+	}
+
+	ksr_shm = NULL;
+	ksr_shmsize = 0;
+	ksr_shmfd = -1;
+	ksr_shmname.clear();
+}
+
+#define	KSR_METHOD(name, method)	\
+	{ name, NULL, method, NULL, NULL, NULL,	\
+	(napi_property_attributes)(napi_writable | napi_configurable), NULL }
+
+napi_value
+KStatReader::Initialize(napi_env env, napi_value exports)
+{
+	napi_property_descriptor methods[] = {
+		KSR_METHOD("read", KStatReader::Read),
+		KSR_METHOD("list", KStatReader::List),
+		KSR_METHOD("close", KStatReader::Close),
+		KSR_METHOD("getkcid", KStatReader::getKCID),
+		KSR_METHOD("getkstat", KStatReader::getKstat),
+		KSR_METHOD("chainupdate", KStatReader::Update),
+		KSR_METHOD("watch", KStatReader::Watch),
+		KSR_METHOD("unwatch", KStatReader::Unwatch),
+		KSR_METHOD("checkwatch", KStatReader::CheckWatch),
+		KSR_METHOD("startwatch", KStatReader::StartWatch),
+		KSR_METHOD("stopwatch", KStatReader::StopWatch),
+		KSR_METHOD("schedule", KStatReader::Schedule),
+		KSR_METHOD("unschedule", KStatReader::Unschedule),
+		KSR_METHOD("histogram", KStatReader::Histogram),
+		KSR_METHOD("gethistogram", KStatReader::GetHistogram),
+		KSR_METHOD("unhistogram", KStatReader::Unhistogram),
+		KSR_METHOD("failures", KStatReader::Failures),
+		KSR_METHOD("refresh", KStatReader::Refresh),
+		KSR_METHOD("previous", KStatReader::Previous),
+		KSR_METHOD("prepare", KStatReader::Prepare),
+		KSR_METHOD("iterate", KStatReader::Iterate),
+		KSR_METHOD("publish", KStatReader::Publish),
+		KSR_METHOD("sample", KStatReader::Sample),
+		KSR_METHOD("layout", KStatReader::Layout),
+		KSR_METHOD("stats", KStatReader::Stats),
+		KSR_METHOD("memoryUsage", KStatReader::MemoryUsage),
+		KSR_METHOD("arrow", KStatReader::Arrow),
+	};
+	ksr_instance_t *ki = new ksr_instance_t();
+	napi_value reader, keys, kid, ndata;
+
+	uv_once(&ksr_coalesce_once, ksr_coalesce_init);
+
+	(void) napi_define_class(env, "Reader", NAPI_AUTO_LENGTH,
+	    KStatReader::New, NULL, sizeof (methods) / sizeof (methods[0]),
+	    methods, &reader);
+	(void) napi_create_reference(env, reader, 1, &ki->ki_reader);
+
+	/*
+	 * Each object that we return for a kstat is tagged with the kstat's
+	 * ID, and the data of each named kstat with its number of statistics,
+	 * under symbols that aren't visible to JavaScript, so that refresh()
+	 * can find them again and tell whether they still fit.
+	 */
+	keys = ksr_object(env);
+	(void) napi_create_symbol(env, ksr_string(env, "kstat::kid"), &kid);
+	ksr_set(env, keys, "kid", kid);
+	(void) napi_create_symbol(env, ksr_string(env, "kstat::ndata"),
+	    &ndata);
+	ksr_set(env, keys, "ndata", ndata);
+	(void) napi_create_reference(env, keys, 1, &ki->ki_keys);
+
+	(void) napi_set_instance_data(env, ki, ksr_instance_free, NULL);
+
+	KStatHandle::Initialize(env);
+	KStatCursor::Initialize(env);
+	KStatSubscriber::Initialize(env, exports);
+
+	/*
+	 * Export the layouts of the raw kstats we know about, so that raw
+	 * data returned as a Buffer can be decoded from JavaScript.
+	 */
+	napi_value schemas = ksr_object(env);
+
+	for (size_t i = 0; i < ksr_nschemas; i++) {
+		const ksr_schema_t *schema = &ksr_schemas[i];
+		napi_value s = ksr_object(env);
+		napi_value fields = ksr_object(env);
+
+		for (size_t j = 0; j < schema->ks_nfields; j++) {
+			const ksr_field_t *field = &schema->ks_fields[j];
+			napi_value f = ksr_object(env);
+
+			ksr_set(env, f, "offset", ksr_number(env, field->kf_offset));
+			ksr_set(env, f, "size", ksr_number(env, field->kf_size));
+			ksr_set(env, f, "type",
+			    ksr_string(env, ksr_fieldtypes[field->kf_type]));
+			ksr_set(env, fields, field->kf_name, f);
+		}
+
+		ksr_set(env, s, "size", ksr_number(env, schema->ks_size));
+		ksr_set(env, s, "fields", fields);
+		ksr_set(env, schemas, schema->ks_name, s);
+	}
+
+	ksr_set(env, exports, "schemas", schemas);
+	ksr_set(env, exports, "Reader", reader);
+
+	return (exports);
+}
+
+string *
+KStatReader::stringMember(napi_env env, napi_value value, const char *member,
+    const char *deflt)
+{
+	if (ksr_type(env, value) != napi_object)
+		return (new string(deflt));
+
+	value = ksr_get(env, value, member);
+
+	if (ksr_type(env, value) != napi_string)
+		return (new string(deflt));
+
+	return (new string(ksr_utf8(env, value)));
+}
+
+int64_t
+KStatReader::intMember(napi_env env, napi_value value, const char *member,
+    int64_t deflt)
+{
+	int64_t rval = deflt;
+
+	if (ksr_type(env, value) != napi_object)
+		return (rval);
+
+	value = ksr_get(env, value, member);
+
+	if (ksr_type(env, value) != napi_number)
+		return (rval);
+
+	(void) napi_get_value_int64(env, value, &rval);
+
+	return (rval);
+}
+
+double
+KStatReader::numberMember(napi_env env, napi_value value, const char *member,
+    double deflt)
+{
+	double rval = deflt;
+
+	if (ksr_type(env, value) != napi_object)
+		return (rval);
+
+	value = ksr_get(env, value, member);
+
+	if (ksr_type(env, value) != napi_number)
+		return (rval);
+
+	(void) napi_get_value_double(env, value, &rval);
+
+	return (rval);
+}
+
+bool
+KStatReader::boolMember(napi_env env, napi_value value, const char *member,
+    bool deflt)
+{
+	bool rval = deflt;
+
+	if (ksr_type(env, value) != napi_object)
+		return (rval);
+
+	value = ksr_get(env, value, member);
+
+	if (ksr_type(env, value) != napi_boolean)
+		return (rval);
+
+	(void) napi_get_value_bool(env, value, &rval);
+
+	return (rval);
+}
+
+/*
+ * Return the symbol under which objects are tagged with the given property:
+ * "kid" or "ndata".
+ */
+napi_value
+KStatReader::key(napi_env env, const char *name)
+{
+	napi_value keys;
+
+	if (napi_get_reference_value(env, ksr_instdata(env)->ki_keys,
+	    &keys) != napi_ok)
+		return (NULL);
+
+	return (ksr_get(env, keys, name));
+}
+
+/*
+ * Return the ID of the kstat that an object returned by read() describes, or
+ * -1 if it isn't such an object.
+ */
+kid_t
+KStatReader::kidof(napi_env env, napi_value value)
+{
+	napi_value kid;
+	int64_t rval;
+
+	if (ksr_type(env, value) != napi_object ||
+	    napi_get_property(env, value, key(env, "kid"), &kid) != napi_ok ||
+	    ksr_type(env, kid) != napi_number ||
+	    napi_get_value_int64(env, kid, &rval) != napi_ok)
+		return (-1);
+
+	return (rval);
+}
+
+/*
+ * Turn the options object given to read() or getkstat() into read flags.
+ */
+int
+KStatReader::readflags(napi_env env, napi_value options)
+{
+	int flags = 0;
+
+	if (boolMember(env, options, "buffer", false))
+		flags |= KSR_READ_BUFFER;
+
+	if (boolMember(env, options, "lazy", false))
+		flags |= KSR_READ_LAZY;
+
+	return (flags);
+}
+
+napi_value
+KStatReader::New(napi_env env, napi_callback_info info)
+{
+	napi_value args[1], self;
+	size_t argc = 1;
+	KStatReader *k;
+
+	if (napi_get_cb_info(env, info, &argc, args, &self, NULL) != napi_ok)
+		return (NULL);
+
+	try {
+		k = new KStatReader(env,
+		    stringMember(env, args[0], "module", ""),
+		    stringMember(env, args[0], "class", ""),
+		    stringMember(env, args[0], "name", ""),
+		    intMember(env, args[0], "instance", -1));
+	} catch (const char *msg) {
+		return (error(env, "%s", msg));
+	}
+
+	/*
+	 * The remaining members of the specification are options.
+	 */
+	k->ksr_backoff = intMember(env, args[0], "backoff",
+	    KSR_BACKOFF_DEFAULT) * 1000000LL;
+	k->ksr_snapshots = boolMember(env, args[0], "snapshots", false);
+	k->ksr_coalesce = intMember(env, args[0], "coalesce", 0) * 1000000LL;
+	k->ksr_instrument = boolMember(env, args[0], "instrument", false);
+	k->ksr_memlimit = intMember(env, args[0], "memoryLimit", 0);
+
+	string *refresh = stringMember(env, args[0], "refresh", "always");
+	int64_t refreshint = intMember(env, args[0], "refresh", 0);
+
+	if (refreshint > 0) {
+		k->ksr_refresh = KSR_REFRESH_INTERVAL;
+		k->ksr_refreshint = refreshint * 1000000LL;
+	} else if (*refresh == "watch") {
+		if (k->chainwatch(env, intMember(env, args[0], "refreshPoll",
+		    KSR_CHAINPOLL_DEFAULT)) != 0) {
+			delete refresh;
+			delete k;
+			return (error(env, "could not start chain watcher"));
+		}
+	} else if (*refresh != "always") {
+		error(env, "unrecognized refresh policy \"%s\"\n",
+		    refresh->c_str());
+		delete refresh;
+		delete k;
+		return (NULL);
+	}
+
+	delete refresh;
+
+	uv_mutex_lock(&ksr_coalesce_lock);
+
+	if (k->ksr_coalesce > ksr_coalesce_max)
+		ksr_coalesce_max = k->ksr_coalesce;
+
+	uv_mutex_unlock(&ksr_coalesce_lock);
+
+	if (napi_wrap(env, self, k, finalize, NULL, &k->ksr_self) != napi_ok) {
+		delete k;
+		return (error(env, "Reader() must be called as a constructor\n"));
+	}
+
+	return (self);
+}
+
+napi_value
+KStatReader::error(napi_env env, const char *fmt, ...)
+{
+	char buf[1024], buf2[1024];
+	char *err = buf;
+	va_list ap;
+
+	va_start(ap, fmt);
+	(void) vsnprintf(buf, sizeof (buf), fmt, ap);
+
+	if (buf[strlen(buf) - 1] != '\n') {
+		/*
+		 * If our error doesn't end in a new-line, we'll append the
+		 * strerror of errno.
+		 */
+		(void) snprintf(err = buf2, sizeof (buf2),
+		    "%s: %s", buf, strerror(errno));
+	} else {
+		buf[strlen(buf) - 1] = '\0';
+	}
+
+	(void) napi_throw_error(env, NULL, err);
+
+	return (NULL);
+}
+
+napi_value
+KStatReader::namedvalue(napi_env env, kstat_t *ksp, kstat_named_t *nm)
+{
+	switch (nm->data_type) {
+	case KSTAT_DATA_CHAR:
+		return (ksr_number(env, nm->value.c[0]));
+
+	case KSTAT_DATA_INT32:
+		return (ksr_number(env, nm->value.i32));
+
+	case KSTAT_DATA_UINT32:
+		return (ksr_number(env, nm->value.ui32));
+
+	case KSTAT_DATA_INT64:
+		return (ksr_number(env, nm->value.i64));
+
+	case KSTAT_DATA_UINT64:
+		return (ksr_number(env, nm->value.ui64));
+
+	case KSTAT_DATA_STRING:
+		return (ksr_string(env, KSTAT_NAMED_STR_PTR(nm)));
+
+	default:
+		error(env, "unrecognized data type %d for member "
+		    "\"%s\" in instance %d of stat \"%s\" (module "
+		    "\"%s\", class \"%s\")\n", nm->data_type,
+		    nm->name, ksp->ks_instance, ksp->ks_name,
+		    ksp->ks_module, ksp->ks_class);
+		throw (ksr_pending_t());
+	}
+}
+
+napi_value
+KStatReader::read(napi_env env, kstat_t *ksp, int flags)
+{
+	hrtime_t start = ksr_instrument ? gethrtime() : 0;
+	napi_value rval = header(env, ksp);
+
+	if (ksr_instrument)
+		this->record(ksp, KSP_MATERIALIZE, gethrtime() - start);
+
+	if (this->kread(ksp) == -1) {
+		/*
+		 * It is deeply annoying, but some kstats can return errors
+		 * under otherwise routine conditions.  (ACPI is one
+		 * offender; there are surely others.)  To prevent these
+		 * fouled kstats from completely ruining our day, we assign
+		 * an "error" member to the return value that consists of
+		 * the strerror().
+		 */
+		ksr_set(env, rval, "error", ksr_string(env, strerror(errno)));
+		return (rval);
+	}
+
+	start = ksr_instrument ? gethrtime() : 0;
+	contents(env, rval, ksp, flags);
+
+	if (ksr_instrument)
+		this->record(ksp, KSP_DECODE, gethrtime() - start);
+
+	return (rval);
+}
+
+typedef std::pair<double, kstat_t *> ksr_ranked_t;
+
+static bool
+ksr_rankorder(const ksr_ranked_t& l, const ksr_ranked_t& r)
+{
+	return (l.first > r.first);
+}
+
+/*
+ * Read the kstats that match a specification and return the n with the
+ * highest values of a statistic (or of its per-second rate since the last
+ * ranking by it), highest first, each with the "value" that it was ranked by.
+ * Every matching kstat has to be read, but only the statistic is decoded: the
+ * best n seen so far are kept in a heap whose least is at its root, and only
+ * those that are left at the end are made into objects.  A kstat that can't
+ * be read, or doesn't have the statistic, isn't ranked; nor, when ranking by
+ * rate, is one that hasn't been ranked by it before.
+ */
+napi_value
+KStatReader::rank(napi_env env, string *rmodule, string *rclass,
+    string *rname, int64_t rinstance, int flags, const string& statistic,
+    bool rate, size_t n)
+{
+	map<kid_t, ksr_watchstate_t> *state =
+	    rate ? &ksr_rankstate[statistic] : NULL;
+	map<kid_t, ksr_watchstate_t>::iterator st;
+	vector<ksr_ranked_t> heap;
+	napi_value rval, obj;
+	hrtime_t start, delta;
+	double value, v;
+	size_t i;
+
+	for (i = 0; i < ksr_kstats.size(); i++) {
+		kstat_t *ksp = ksr_kstats[i];
+
+		if (!this->matches(ksp, rmodule, rclass, rname, rinstance) ||
+		    this->kread(ksp) == -1 ||
+		    !ksr_fieldvalue(ksp, statistic.c_str(), &value))
+			continue;
+
+		v = value;
+
+		if (rate) {
+			if ((st = state->find(ksp->ks_kid)) == state->end()) {
+				ksr_watchstate_t ws = { value,
+				    ksp->ks_snaptime, false };
+
+				state->insert(std::make_pair(ksp->ks_kid, ws));
+				continue;
+			}
+
+			if ((delta = ksp->ks_snaptime -
+			    st->second.kws_snaptime) <= 0)
+				continue;
+
+			v = (value - st->second.kws_value) * 1e9 / delta;
+			st->second.kws_value = value;
+			st->second.kws_snaptime = ksp->ks_snaptime;
+		}
+
+		if (heap.size() < n) {
+			heap.push_back(std::make_pair(v, ksp));
+			std::push_heap(heap.begin(), heap.end(), ksr_rankorder);
+		} else if (v > heap.front().first) {
+			std::pop_heap(heap.begin(), heap.end(), ksr_rankorder);
+			heap.back() = std::make_pair(v, ksp);
+			std::push_heap(heap.begin(), heap.end(), ksr_rankorder);
+		}
+	}
+
+	std::sort_heap(heap.begin(), heap.end(), ksr_rankorder);
+	rval = ksr_array(env, heap.size());
+
+	for (i = 0; i < heap.size(); i++) {
+		kstat_t *ksp = heap[i].second;
+
+		start = ksr_instrument ? gethrtime() : 0;
+		obj = header(env, ksp);
+		ksr_set(env, obj, "value", ksr_number(env, heap[i].first));
+
+		if (ksr_instrument)
+			this->record(ksp, KSP_MATERIALIZE, gethrtime() - start);
+
+		start = ksr_instrument ? gethrtime() : 0;
+		contents(env, obj, ksp, flags);
+
+		if (ksr_instrument)
+			this->record(ksp, KSP_DECODE, gethrtime() - start);
+
+		ksr_setelem(env, rval, i, obj);
+	}
+
+	return (rval);
+}
+
+/*
+ * Read a kstat for a sparse read.  The schema of the kstat is added to those
+ * of the read if it's the first with its statistics.
+ */
+napi_value
+KStatReader::sparse(napi_env env, kstat_t *ksp, ksr_sparsectx_t *ksc)
+{
+	vector<ksr_sparseval_t> *prev = NULL;
+	ksr_sparsestate_t::iterator st;
+	map<string, uint32_t>::iterator it;
+	napi_value rval = header(env, ksp), indexes, values, names;
+	ksr_sparserow row;
+	kstat_named_t *nm;
+	uint32_t i, n;
+	size_t pos;
+	hrtime_t start;
+
+	if (this->kread(ksp) == -1) {
+		ksr_set(env, rval, "error", ksr_string(env, strerror(errno)));
+		return (rval);
+	}
+
+	ksr_set(env, rval, "snaptime", ksr_number(env, ksp->ks_snaptime));
+	ksr_set(env, rval, "crtime", ksr_number(env, ksp->ks_crtime));
+	start = ksr_instrument ? gethrtime() : 0;
+
+	if (ksr_decode(ksp, &row, &nm) == -1) {
+		if (nm == NULL)
+			return (rval);
+
+		error(env, "unrecognized data type %d for member "
+		    "\"%s\" in instance %d of stat \"%s\" (module "
+		    "\"%s\", class \"%s\")\n", nm->data_type,
+		    nm->name, ksp->ks_instance, ksp->ks_name,
+		    ksp->ks_module, ksp->ks_class);
+		throw (ksr_pending_t());
+	}
+
+	if ((it = ksc->ksc_index.find(row.kspr_key)) == ksc->ksc_index.end()) {
+		n = ksc->ksc_index.size();
+		names = ksr_array(env, row.kspr_values.size());
+
+		for (i = 0, pos = 0; i < row.kspr_values.size(); i++) {
+			ksr_setelem(env, names, i,
+			    ksr_string(env, row.kspr_key.c_str() + pos));
+			pos = row.kspr_key.find('\0', pos) + 1;
+		}
+
+		ksr_setelem(env, ksc->ksc_schemas, n, names);
+		it = ksc->ksc_index.insert(std::make_pair(row.kspr_key, n)).first;
+	}
+
+	if (ksc->ksc_changed &&
+	    (st = ksc->ksc_state->find(ksp->ks_kid)) != ksc->ksc_state->end() &&
+	    st->second.size() == row.kspr_values.size())
+		prev = &st->second;
+
+	indexes = ksr_array(env);
+	values = ksr_array(env);
+
+	for (i = 0, n = 0; i < row.kspr_values.size(); i++) {
+		ksr_sparseval_t *v = &row.kspr_values[i];
+
+		if (!ksc->ksc_changed) {
+			if (v->ksv_text ? v->ksv_str.empty() :
+			    v->ksv_number == 0)
+				continue;
+		} else if (prev != NULL) {
+			ksr_sparseval_t *p = &(*prev)[i];
+
+			if (v->ksv_text == p->ksv_text &&
+			    v->ksv_number == p->ksv_number &&
+			    v->ksv_str == p->ksv_str)
+				continue;
+		}
+
+		ksr_setelem(env, indexes, n, ksr_number(env, i));
+		ksr_setelem(env, values, n++, v->ksv_text ?
+		    ksr_string(env, v->ksv_str.c_str()) :
+		    ksr_number(env, v->ksv_number));
+	}
+
+	if (ksc->ksc_changed)
+		(*ksc->ksc_state)[ksp->ks_kid].swap(row.kspr_values);
+
+	ksr_set(env, rval, "schema", ksr_number(env, it->second));
+	ksr_set(env, rval, "indexes", indexes);
+	ksr_set(env, rval, "values", values);
+
+	if (ksr_instrument)
+		this->record(ksp, KSP_DECODE, gethrtime() - start);
+
+	return (rval);
+}
+
+/*
+ * Create the object describing a kstat, without its data.
+ */
+napi_value
+KStatReader::header(napi_env env, kstat_t *ksp)
+{
+	napi_value rval = ksr_object(env);
+	napi_property_descriptor kid = { NULL, key(env, "kid"), NULL, NULL, NULL,
+	    ksr_number(env, ksp->ks_kid), napi_default, NULL };
+
+	ksr_set(env, rval, "class", ksr_string(env, ksp->ks_class));
+	ksr_set(env, rval, "module", ksr_string(env, ksp->ks_module));
+	ksr_set(env, rval, "name", ksr_string(env, ksp->ks_name));
+	ksr_set(env, rval, "instance", ksr_number(env, ksp->ks_instance));
+	ksr_set(env, rval, "type", ksr_number(env, ksp->ks_type));
+	(void) napi_define_properties(env, rval, 1, &kid);
+
+	return (rval);
+}
+
+/*
+ * Fill in the times and data of a kstat (or a snapshot of one) that has been
+ * read.
+ */
+void
+KStatReader::contents(napi_env env, napi_value rval, kstat_t *ksp, int flags)
+{
+	napi_value data;
+
+	ksr_set(env, rval, "snaptime", ksr_number(env, ksp->ks_snaptime));
+	ksr_set(env, rval, "crtime", ksr_number(env, ksp->ks_crtime));
+
+	if ((flags & KSR_READ_BUFFER) && ksp->ks_type == KSTAT_TYPE_RAW) {
+		/*
+		 * Hand back a copy of the raw data, along with the name of its
+		 * schema if we know its layout.  (We can't lend out ks_data
+		 * itself; libkstat will overwrite it on the next read.)
+		 */
+		const ksr_schema_t *schema = ksr_rawschema(ksp);
+
+		if (schema != NULL)
+			ksr_set(env, rval, "schema",
+			    ksr_string(env, schema->ks_name));
+
+		if (napi_create_buffer_copy(env, ksp->ks_data_size,
+		    ksp->ks_data, NULL, &data) == napi_ok)
+			ksr_set(env, rval, "data", data);
+
+		return;
+	}
+
+	if ((flags & KSR_READ_LAZY) && ksp->ks_type < KSTAT_NUM_TYPES) {
+		/*
+		 * Take a private copy of the kstat and defer decoding it until
+		 * (and unless) someone looks at the data.  The copy lives as
+		 * long as the object does.
+		 */
+		void *snap;
+
+		if ((snap = malloc(snapsize(ksp))) == NULL)
+			return;
+
+		(void) snapshot(ksp, snap);
+
+		napi_property_descriptor lazy = { "data", NULL, NULL, lazydata,
+		    NULL, NULL, (napi_property_attributes)(napi_enumerable |
+		    napi_configurable), snap };
+
+		if (napi_add_finalizer(env, rval, snap, lazyfree, NULL,
+		    NULL) != napi_ok) {
+			free(snap);
+			return;
+		}
+
+		(void) napi_define_properties(env, rval, 1, &lazy);
+
+		return;
+	}
+
+	if ((data = decode(env, ksp, dataobject(env, ksp))) == NULL)
+		return;
+
+	ksr_set(env, rval, "data", data);
+}
+
+/*
+ * Read a kstat into an object that we returned for it previously, updating
+ * its snaptime and data in place.
+ */
+void
+KStatReader::refresh(napi_env env, napi_value rval, kstat_t *ksp, int flags)
+{
+	napi_value data, ndata;
+	hrtime_t start;
+	uint32_t n;
+
+	if (this->kread(ksp) == -1) {
+		/*
+		 * As for read(), a kstat that can't be read has an error and
+		 * nothing else:  what was read before would look current.
+		 */
+		ksr_unset(env, rval, "snaptime");
+		ksr_unset(env, rval, "crtime");
+		ksr_unset(env, rval, "schema");
+		ksr_unset(env, rval, "data");
+		ksr_set(env, rval, "error", ksr_string(env, strerror(errno)));
+		return;
+	}
+
+	start = ksr_instrument ? gethrtime() : 0;
+
+	if (ksr_has(env, rval, "error")) {
+		ksr_unset(env, rval, "error");
+		ksr_set(env, rval, "crtime", ksr_number(env, ksp->ks_crtime));
+	}
+
+	ksr_set(env, rval, "snaptime", ksr_number(env, ksp->ks_snaptime));
+	data = ksr_get(env, rval, "data");
+
+	if ((flags & KSR_READ_BUFFER) && ksp->ks_type == KSTAT_TYPE_RAW) {
+		const ksr_schema_t *schema = ksr_rawschema(ksp);
+		void *buf;
+		size_t len;
+
+		if (schema == NULL)
+			ksr_unset(env, rval, "schema");
+		else if (!ksr_has(env, rval, "schema"))
+			ksr_set(env, rval, "schema",
+			    ksr_string(env, schema->ks_name));
+
+		if (ksr_isbuffer(env, data) &&
+		    napi_get_buffer_info(env, data, &buf, &len) == napi_ok &&
+		    len == ksp->ks_data_size) {
+			(void) memcpy(buf, ksp->ks_data, ksp->ks_data_size);
+		} else if (napi_create_buffer_copy(env, ksp->ks_data_size,
+		    ksp->ks_data, NULL, &data) == napi_ok) {
+			ksr_set(env, rval, "data", data);
+		}
+	} else {
+		/*
+		 * Statistics are only ever added to the object we decode into,
+		 * so if a named kstat has grown or shrunk since, we start over
+		 * with a new one rather than keep those that are gone.  (Nor
+		 * does decoded data have a schema, as a Buffer would.)
+		 */
+		if (ksr_isbuffer(env, data))
+			ksr_unset(env, rval, "schema");
+
+		if (ksr_type(env, data) != napi_object ||
+		    ksr_isbuffer(env, data) ||
+		    (ksp->ks_type == KSTAT_TYPE_NAMED &&
+		    (napi_get_property(env, data, key(env, "ndata"),
+		    &ndata) != napi_ok ||
+		    napi_get_value_uint32(env, ndata, &n) != napi_ok ||
+		    n != ksp->ks_ndata)))
+			data = dataobject(env, ksp);
+
+		data = decode(env, ksp, data);
+
+		if (data != NULL)
+			ksr_set(env, rval, "data", data);
+	}
+
+	if (ksr_instrument)
+		this->record(ksp, KSP_DECODE, gethrtime() - start);
+}
+
+/*
+ * Create an object to decode the data of a kstat into, tagging it (if the
+ * kstat is named) with the number of statistics that it will hold.
+ */
+napi_value
+KStatReader::dataobject(napi_env env, kstat_t *ksp)
+{
+	napi_value rval = ksr_object(env);
+
+	if (ksp->ks_type != KSTAT_TYPE_NAMED)
+		return (rval);
+
+	napi_property_descriptor ndata = { NULL, key(env, "ndata"), NULL,
+	    NULL, NULL, ksr_number(env, ksp->ks_ndata), napi_default, NULL };
+
+	(void) napi_define_properties(env, rval, 1, &ndata);
+
+	return (rval);
+}
+
+/*
+ * Decode the data of a kstat that has been read into the given object (which
+ * may be a fresh one, or one that we decoded into previously), returning NULL
+ * if we don't know the kstat's type.
+ */
+napi_value
+KStatReader::decode(napi_env env, kstat_t *ksp, napi_value data)
+{
+	ksr_objvisitor v(env, data);
+	kstat_named_t *nm;
+
+	if (ksr_decode(ksp, &v, &nm) == 0)
+		return (data);
+
+	if (nm == NULL)
+		return (NULL);
+
+	error(env, "unrecognized data type %d for member "
+	    "\"%s\" in instance %d of stat \"%s\" (module "
+	    "\"%s\", class \"%s\")\n", nm->data_type,
+	    nm->name, ksp->ks_instance, ksp->ks_name,
+	    ksp->ks_module, ksp->ks_class);
+	throw (ksr_pending_t());
+}
+
+/*
+ * A snapshot is a private copy of a kstat header followed by its data, which
+ * can be decoded after libkstat has moved on.
+ */
+size_t
+KStatReader::snapsize(kstat_t *ksp)
+{
+	return (sizeof (kstat_t) + ksp->ks_data_size);
+}
+
+kstat_t *
+KStatReader::snapshot(kstat_t *ksp, void *buf)
+{
+	kstat_t *snap = (kstat_t *)buf;
+	char *data = (char *)buf + sizeof (kstat_t);
+
+	(void) memcpy(snap, ksp, sizeof (kstat_t));
+	(void) memcpy(data, ksp->ks_data, ksp->ks_data_size);
+	snap->ks_next = NULL;
+	snap->ks_data = data;
+	rebase(snap, (const char *)ksp->ks_data);
+
+	return (snap);
+}
+
+/*
+ * Named strings point into the data buffer, so when the data of a kstat has
+ * been copied from elsewhere, they need to be moved along with it.  Any that
+ * point outside of the buffer (or nowhere) would be left pointing at memory
+ * that libkstat may free or reuse before the copy is decoded, so they're made
+ * empty.
+ */
+void
+KStatReader::rebase(kstat_t *ksp, const char *base)
+{
+	static char empty[1] = { '\0' };
+	char *data = (char *)ksp->ks_data;
+	kstat_named_t *nm;
+	unsigned int i;
+
+	if (ksp->ks_type != KSTAT_TYPE_NAMED)
+		return;
+
+	for (i = 0, nm = KSTAT_NAMED_PTR(ksp); i < ksp->ks_ndata; i++, nm++) {
+		char *str = KSTAT_NAMED_STR_PTR(nm);
+
+		if (nm->data_type != KSTAT_DATA_STRING)
+			continue;
+
+		if (str < base || str >= base + ksp->ks_data_size) {
+			KSTAT_NAMED_STR_PTR(nm) = empty;
+			KSTAT_NAMED_STR_BUFLEN(nm) = 0;
+			continue;
+		}
+
+		KSTAT_NAMED_STR_PTR(nm) = data + (str - base);
+	}
+}
+
+/*
+ * The getter for the data of a lazily read kstat: decode the snapshot, and
+ * replace the getter with what we decoded, so that we only do so once.
+ */
+napi_value
+KStatReader::lazydata(napi_env env, napi_callback_info info)
+{
+	napi_value self, data;
+	size_t argc = 0;
+	void *snap;
+
+	if (napi_get_cb_info(env, info, &argc, NULL, &self, &snap) != napi_ok)
+		return (NULL);
+
+	try {
+		data = decode(env, (kstat_t *)snap,
+		    dataobject(env, (kstat_t *)snap));
+	} catch (ksr_pending_t) {
+		return (NULL);
+	}
+
+	if (data != NULL) {
+		napi_property_descriptor value = { "data", NULL, NULL, NULL,
+		    NULL, data, (napi_property_attributes)(napi_writable |
+		    napi_enumerable | napi_configurable), NULL };
+
+		(void) napi_define_properties(env, self, 1, &value);
+	}
+
+	return (data);
+}
+
+void
+KStatReader::lazyfree(napi_env env, void *data, void *hint)
+{
+	free(data);
+}
+
+napi_value
+KStatReader::list(napi_env env, kstat_t *ksp)
+{
+	napi_value rval = ksr_object(env);
+
+	ksr_set(env, rval, "class", ksr_string(env, ksp->ks_class));
+	ksr_set(env, rval, "module", ksr_string(env, ksp->ks_module));
+	ksr_set(env, rval, "name", ksr_string(env, ksp->ks_name));
+	ksr_set(env, rval, "instance", ksr_number(env, ksp->ks_instance));
+	ksr_set(env, rval, "type", ksr_number(env, ksp->ks_type));
+	ksr_set(env, rval, "snaptime", ksr_number(env, ksp->ks_snaptime));
+	ksr_set(env, rval, "crtime", ksr_number(env, ksp->ks_crtime));
+
+	return (rval);
+}
+
+/*
+ * Return the value of one of a slot's fields.  As for handles, we remember
+ * where each named field was found, and only search for it again if it isn't
+ * there next time.
+ */
+bool
+KStatReader::samplevalue(ksr_sampleslot_t *ksl, size_t f, double *valp)
+{
+	kstat_t *ksp = ksl->ksl_ksp;
+	const char *field = ksl->ksl_fields[f].c_str();
+	kstat_named_t *nm;
+	int ndx;
+
+	if (ksp->ks_type != KSTAT_TYPE_NAMED)
+		return (ksr_fieldvalue(ksp, field, valp));
+
+	nm = KSTAT_NAMED_PTR(ksp);
+	ndx = ksl->ksl_index[f];
+
+	if (ndx < 0 || (unsigned int)ndx >= ksp->ks_ndata ||
+	    strcmp(nm[ndx].name, field) != 0) {
+		for (ndx = 0; (unsigned int)ndx < ksp->ks_ndata; ndx++) {
+			if (strcmp(nm[ndx].name, field) == 0)
+				break;
+		}
+
+		if ((unsigned int)ndx == ksp->ks_ndata)
+			return (false);
+
+		ksl->ksl_index[f] = ndx;
+	}
+
+	return (ksr_namednumber(&nm[ndx], valp));
+}
+
+/*
+ * Read the kstats to be sampled, laying them out afresh if they aren't the
+ * kstats that we last laid out, or if the fields of one of them may have
+ * changed.  Returns the number of values that a sample needs; if that is more
+ * than the given length, the layout is left as it was, so that a sample that
+ * is refused doesn't change what layout() describes.
+ */
+size_t
+KStatReader::sampleread(vector<kstat_t *>& kstats, size_t length)
+{
+	bool relayout = kstats.size() != ksr_slots.size();
+	vector<bool> ok(kstats.size());
+	vector<ksr_sampleslot_t> slots;
+	size_t i, offset;
+
+	for (i = 0; i < kstats.size(); i++) {
+		kstat_t *ksp = kstats[i];
+
+		ok[i] = this->kread(ksp) != -1;
+
+		if (!relayout && (ksr_slots[i].ksl_kid != ksp->ks_kid ||
+		    (ok[i] && ksr_slots[i].ksl_ndata != ksp->ks_ndata)))
+			relayout = true;
+	}
+
+	if (!relayout) {
+		if (ksr_samplevalues > length)
+			return (ksr_samplevalues);
+
+		for (i = 0; i < kstats.size(); i++) {
+			ksr_slots[i].ksl_ksp = kstats[i];
+			ksr_slots[i].ksl_ok = ok[i];
+		}
+
+		return (ksr_samplevalues);
+	}
+
+	slots.resize(kstats.size());
+	offset = KSR_SAMPLE_HDR;
+
+	for (i = 0; i < kstats.size(); i++) {
+		kstat_t *ksp = kstats[i];
+		ksr_sampleslot_t *ksl = &slots[i];
+
+		ksl->ksl_ksp = ksp;
+		ksl->ksl_kid = ksp->ks_kid;
+		ksl->ksl_class = ksp->ks_class;
+		ksl->ksl_module = ksp->ks_module;
+		ksl->ksl_name = ksp->ks_name;
+		ksl->ksl_instance = ksp->ks_instance;
+		ksl->ksl_ok = ok[i];
+
+		/*
+		 * A kstat that we couldn't read has no fields (as far as we
+		 * know); it will be laid out again once it can be read.
+		 */
+		if (ok[i]) {
+			ksl->ksl_ndata = ksp->ks_ndata;
+			ksr_fieldnames(ksp, &ksl->ksl_fields);
+		} else {
+			ksl->ksl_ndata = UINT_MAX;
+		}
+
+		ksl->ksl_index.assign(ksl->ksl_fields.size(), -1);
+		ksl->ksl_offset = offset;
+		offset += 1 + ksl->ksl_fields.size();
+	}
+
+	if (offset > length)
+		return (offset);
+
+	ksr_slots.swap(slots);
+	ksr_samplevalues = offset;
+	ksr_generation++;
+
+	return (ksr_samplevalues);
+}
+
+/*
+ * Write a sample of the kstats read by sampleread() into an array that is
+ * large enough for it.
+ */
+void
+KStatReader::samplewrite(double *values)
+{
+	ksr_samplehdr_t *hdr = (ksr_samplehdr_t *)values;
+	uint32_t seq;
+	size_t i, f;
+
+	/*
+	 * As for a published segment, round up any odd sequence number left
+	 * behind by a writer that didn't finish.
+	 */
+	seq = ((uint32_t)hdr->ksa_seq + 1) & ~1U;
+	__atomic_store_n(&hdr->ksa_seq, (int32_t)(seq + 1), __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	hdr->ksa_generation = ksr_generation;
+	hdr->ksa_nslots = ksr_slots.size();
+	hdr->ksa_nvalues = ksr_samplevalues;
+	hdr->ksa_time = gethrtime();
+	hdr->ksa_chain = ksr_ctl->kc_chain_id;
+
+	for (i = 0; i < ksr_slots.size(); i++) {
+		ksr_sampleslot_t *ksl = &ksr_slots[i];
+		double *slot = values + ksl->ksl_offset;
+
+		if (!ksl->ksl_ok) {
+			slot[0] = 0;
+			continue;
+		}
+
+		slot[0] = ksl->ksl_ksp->ks_snaptime;
+
+		for (f = 0; f < ksl->ksl_fields.size(); f++) {
+			if (!samplevalue(ksl, f, &slot[f + 1]))
+				slot[f + 1] = NAN;
+		}
+	}
+
+	__atomic_store_n(&hdr->ksa_seq, (int32_t)(seq + 2), __ATOMIC_RELEASE);
+}
+
+/*
+ * Evaluate every watch against the kstats it matches, reading each kstat at
+ * most once.  An event is appended to the array for each watch/kstat pair
+ * whose state changed; the number of events is returned, or -1 if the chain
+ * could not be updated.
+ */
+int
+KStatReader::checkwatches(napi_env env, napi_value events)
+{
+	map<kstat_t *, bool> sampled;
+	map<kstat_t *, bool>::iterator it;
+	map<kid_t, ksr_watchstate_t>::iterator st;
+	int nevents = 0;
+	size_t i, w;
+
+	if (this->update() == -1)
+		return (-1);
+
+	for (w = 0; w < ksr_watches.size(); w++) {
+		ksr_watch_t *kw = ksr_watches[w];
+
+		for (i = 0; i < ksr_kstats.size(); i++) {
+			kstat_t *ksp = ksr_kstats[i];
+			double value, v;
+			bool active;
+
+			if (!this->matches(ksp, &kw->kw_module, &kw->kw_class,
+			    &kw->kw_name, kw->kw_instance))
+				continue;
+
+			if ((it = sampled.find(ksp)) == sampled.end()) {
+				it = sampled.insert(std::make_pair(ksp,
+				    this->kread(ksp) != -1)).first;
+			}
+
+			if (!it->second || !ksr_fieldvalue(ksp,
+			    kw->kw_statistic.c_str(), &value))
+				continue;
+
+			if ((st = kw->kw_state.find(ksp->ks_kid)) ==
+			    kw->kw_state.end()) {
+				ksr_watchstate_t ws = { value,
+				    ksp->ks_snaptime, false };
+
+				st = kw->kw_state.insert(
+				    std::make_pair(ksp->ks_kid, ws)).first;
+
+				/*
+				 * A rate needs two samples; we'll have our
+				 * second next time around.
+				 */
+				if (kw->kw_rate)
+					continue;
+			}
+
+			v = value;
+
+			if (kw->kw_rate) {
+				hrtime_t delta = ksp->ks_snaptime -
+				    st->second.kws_snaptime;
+
+				if (delta <= 0)
+					continue;
+
+				v = (value - st->second.kws_value) * 1e9 /
+				    delta;
+			}
+
+			st->second.kws_value = value;
+			st->second.kws_snaptime = ksp->ks_snaptime;
+			v *= kw->kw_scale;
+
+			switch (kw->kw_op) {
+			case KSW_GT:
+				active = v > kw->kw_threshold;
+				break;
+			case KSW_GE:
+				active = v >= kw->kw_threshold;
+				break;
+			case KSW_LT:
+				active = v < kw->kw_threshold;
+				break;
+			case KSW_LE:
+				active = v <= kw->kw_threshold;
+				break;
+			case KSW_EQ:
+				active = v == kw->kw_threshold;
+				break;
+			default:
+				active = v != kw->kw_threshold;
+				break;
+			}
+
+			if (active == st->second.kws_active)
+				continue;
+
+			st->second.kws_active = active;
+
+			napi_value ev = ksr_object(env);
+			ksr_set(env, ev, "id", ksr_number(env, kw->kw_id));
+			ksr_set(env, ev, "class", ksr_string(env, ksp->ks_class));
+			ksr_set(env, ev, "module", ksr_string(env, ksp->ks_module));
+			ksr_set(env, ev, "name", ksr_string(env, ksp->ks_name));
+			ksr_set(env, ev, "instance", ksr_number(env, ksp->ks_instance));
+			ksr_set(env, ev, "statistic",
+			    ksr_string(env, kw->kw_statistic.c_str()));
+			ksr_set(env, ev, "value", ksr_number(env, v));
+			ksr_set(env, ev, "active", ksr_boolean(env, active));
+			ksr_set(env, ev, "snaptime", ksr_number(env, ksp->ks_snaptime));
+			ksr_setelem(env, events, nevents++, ev);
+		}
+	}
+
+	this->account(env);
+
+	return (nevents);
+}
+
+void
+KStatReader::watchtimer(uv_timer_t *timer)
+{
+	KStatReader *k = (KStatReader *)timer->data;
+	napi_env env = k->ksr_env;
+	napi_handle_scope scope;
+	napi_value self, cb, events, argv[2], rval, err;
+	int n;
+
+	if (napi_open_handle_scope(env, &scope) != napi_ok)
+		return;
+
+	events = ksr_array(env);
+
+	if ((n = k->checkwatches(env, events)) == 0 ||
+	    napi_get_reference_value(env, k->ksr_self, &self) != napi_ok ||
+	    napi_get_reference_value(env, k->ksr_watchcb, &cb) != napi_ok) {
+		(void) napi_close_handle_scope(env, scope);
+		return;
+	}
+
+	if (n == -1) {
+		(void) napi_create_error(env, NULL,
+		    ksr_string(env, "failed to update kstat chain"), &argv[0]);
+		(void) napi_get_undefined(env, &argv[1]);
+	} else {
+		argv[0] = ksr_null(env);
+		argv[1] = events;
+	}
+
+	/*
+	 * Nothing is above us to catch an exception thrown by the callback,
+	 * so it is reported as uncaught.
+	 */
+	if (napi_make_callback(env, k->ksr_watchctx, self, cb, 2, argv,
+	    &rval) == napi_pending_exception &&
+	    napi_get_and_clear_last_exception(env, &err) == napi_ok)
+		(void) napi_fatal_exception(env, err);
+
+	(void) napi_close_handle_scope(env, scope);
+}
+
+void
+KStatReader::watchclose(uv_handle_t *handle)
+{
+	delete (uv_timer_t *)handle;
+}
+
+void
+KStatReader::stopwatch()
+{
+	uint32_t refs;
+
+	if (ksr_timer == NULL)
+		return;
+
+	uv_timer_stop(ksr_timer);
+	uv_close((uv_handle_t *)ksr_timer, watchclose);
+	ksr_timer = NULL;
+	(void) napi_delete_reference(ksr_env, ksr_watchcb);
+	(void) napi_async_destroy(ksr_env, ksr_watchctx);
+	ksr_watchcb = NULL;
+	ksr_watchctx = NULL;
+	(void) napi_reference_unref(ksr_env, ksr_self, &refs);
+}
+
+/*
+ * Return the wall-clock time in milliseconds, against which schedule entries
+ * fall due.
+ */
+int64_t
+KStatReader::schednow()
+{
+	struct timeval tv;
+
+	(void) gettimeofday(&tv, NULL);
+
+	return ((int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+/*
+ * Set the schedule's timer for the next time that any of its entries falls
+ * due.  If the clock has been set back, an entry may be due more than an
+ * interval from now; it is brought back into line.
+ */
+void
+KStatReader::schedarm()
+{
+	int64_t now = schednow(), next = INT64_MAX;
+
+	for (size_t i = 0; i < ksr_sched.size(); i++) {
+		ksr_schedentry_t *kse = &ksr_sched[i];
+
+		if (kse->kse_due > now + kse->kse_interval) {
+			kse->kse_due = (now / kse->kse_interval + 1) *
+			    kse->kse_interval;
+		}
+
+		next = std::min(next, kse->kse_due);
+	}
+
+	uv_timer_start(ksr_schedtimer, schedtimer,
+	    next > now ? next - now : 0, 0);
+}
+
+/*
+ * Read every schedule entry that has fallen due, after updating the chain
+ * once for all of them, and pass the results to the callback together.  Due
+ * times that were missed (because the loop was busy) are skipped rather than
+ * made up.
+ */
+void
+KStatReader::schedtimer(uv_timer_t *timer)
+{
+	KStatReader *k = (KStatReader *)timer->data;
+	napi_env env = k->ksr_env;
+	napi_handle_scope scope;
+	napi_value self, cb, results, argv[2], rval, err;
+	int64_t now = schednow();
+	vector<size_t> due;
+	vector<int64_t> times;
+	size_t i, j, n;
+
+	for (i = 0; i < k->ksr_sched.size(); i++) {
+		ksr_schedentry_t *kse = &k->ksr_sched[i];
+
+		if (kse->kse_due > now)
+			continue;
+
+		due.push_back(i);
+		times.push_back(kse->kse_due);
+		kse->kse_due = (now / kse->kse_interval + 1) *
+		    kse->kse_interval;
+	}
+
+	/*
+	 * We rearm before reading, as the callback is free to change (or
+	 * cancel) the schedule.
+	 */
+	k->schedarm();
+
+	if (due.empty() || napi_open_handle_scope(env, &scope) != napi_ok)
+		return;
+
+	if (napi_get_reference_value(env, k->ksr_self, &self) != napi_ok ||
+	    napi_get_reference_value(env, k->ksr_schedcb, &cb) != napi_ok) {
+		(void) napi_close_handle_scope(env, scope);
+		return;
+	}
+
+	argv[0] = ksr_null(env);
+	argv[1] = results = ksr_array(env, due.size());
+
+	if (k->update() == -1) {
+		(void) napi_create_error(env, NULL,
+		    ksr_string(env, "failed to update kstat chain"), &argv[0]);
+		(void) napi_get_undefined(env, &argv[1]);
+	} else {
+		try {
+			for (i = 0; i < due.size(); i++) {
+				ksr_schedentry_t *kse = &k->ksr_sched[due[i]];
+				napi_value result = ksr_object(env);
+				napi_value kstats = ksr_array(env);
+
+				for (j = 0, n = 0; j < k->ksr_kstats.size();
+				    j++) {
+					kstat_t *ksp = k->ksr_kstats[j];
+
+					if (!matches(ksp, &kse->kse_module,
+					    &kse->kse_class, &kse->kse_name,
+					    kse->kse_instance) ||
+					    k->backingoff(ksp))
+						continue;
+
+					ksr_setelem(env, kstats, n++,
+					    k->read(env, ksp, kse->kse_flags));
+				}
+
+				ksr_set(env, result, "index",
+				    ksr_number(env, due[i]));
+				ksr_set(env, result, "interval",
+				    ksr_number(env, kse->kse_interval));
+				ksr_set(env, result, "time",
+				    ksr_number(env, times[i]));
+				ksr_set(env, result, "kstats", kstats);
+				ksr_setelem(env, results, i, result);
+			}
+		} catch (ksr_pending_t) {
+			(void) napi_get_and_clear_last_exception(env, &argv[0]);
+			(void) napi_get_undefined(env, &argv[1]);
+		}
+
+		k->account(env);
+	}
+
+	if (napi_make_callback(env, k->ksr_schedctx, self, cb, 2, argv,
+	    &rval) == napi_pending_exception &&
+	    napi_get_and_clear_last_exception(env, &err) == napi_ok)
+		(void) napi_fatal_exception(env, err);
+
+	(void) napi_close_handle_scope(env, scope);
+}
+
+void
+KStatReader::unschedule()
+{
+	uint32_t refs;
+
+	if (ksr_schedtimer == NULL)
+		return;
+
+	uv_timer_stop(ksr_schedtimer);
+	uv_close((uv_handle_t *)ksr_schedtimer, watchclose);
+	ksr_schedtimer = NULL;
+	ksr_sched.clear();
+	(void) napi_delete_reference(ksr_env, ksr_schedcb);
+	(void) napi_async_destroy(ksr_env, ksr_schedctx);
+	ksr_schedcb = NULL;
+	ksr_schedctx = NULL;
+	(void) napi_reference_unref(ksr_env, ksr_self, &refs);
+}
+
+/*
+ * The chain watcher polls the kernel's chain ID until it is told to stop.
+ * When the ID changes it marks the reader stale, which the reader's own
+ * thread will see on its next read, and wakes that thread's loop, which
+ * brings the chain up to date while it's idle.
+ */
+void
+KStatReader::chainwatcher(void *arg)
+{
+	ksr_chainwatch_t *kcw = (ksr_chainwatch_t *)arg;
+	kid_t kid;
+
+	uv_mutex_lock(&kcw->kcw_lock);
+
+	while (!kcw->kcw_done) {
+		if (uv_cond_timedwait(&kcw->kcw_cv, &kcw->kcw_lock,
+		    kcw->kcw_poll) == 0)
+			continue;
+
+		kid = ioctl(kcw->kcw_fd, KSTAT_IOC_CHAIN_ID, NULL);
+
+		/*
+		 * If we can't get the ID, we can't say that the chain hasn't
+		 * changed.
+		 */
+		if (kid == -1 || kid != kcw->kcw_kid) {
+			kcw->kcw_kid = kid;
+			__atomic_store_n(&kcw->kcw_stale, 1, __ATOMIC_RELEASE);
+			uv_async_send(kcw->kcw_async);
+		}
+	}
+
+	uv_mutex_unlock(&kcw->kcw_lock);
+}
+
+void
+KStatReader::chainnotify(uv_async_t *async)
+{
+	KStatReader *k = (KStatReader *)async->data;
+
+	if (k->ksr_ctl == NULL)
+		return;
+
+	(void) k->update();
+	k->account(k->ksr_env);
+}
+
+void
+KStatReader::chainclose(uv_handle_t *handle)
+{
+	delete (uv_async_t *)handle;
+}
+
+int
+KStatReader::chainwatch(napi_env env, int64_t poll)
+{
+	ksr_chainwatch_t *kcw;
+	uv_loop_t *loop;
+	int fd;
+
+	if (poll <= 0 || napi_get_uv_event_loop(env, &loop) != napi_ok)
+		return (-1);
+
+	if ((fd = open("/dev/kstat", O_RDONLY)) == -1)
+		return (-1);
+
+	kcw = new ksr_chainwatch_t;
+	kcw->kcw_done = false;
+	kcw->kcw_poll = poll * 1000000ULL;
+	kcw->kcw_fd = fd;
+	kcw->kcw_kid = ioctl(fd, KSTAT_IOC_CHAIN_ID, NULL);
+	kcw->kcw_stale = 0;
+	kcw->kcw_async = new uv_async_t;
+	kcw->kcw_async->data = this;
+
+	/*
+	 * The notification mustn't keep the loop alive by itself.
+	 */
+	uv_async_init(loop, kcw->kcw_async, chainnotify);
+	uv_unref((uv_handle_t *)kcw->kcw_async);
+	uv_mutex_init(&kcw->kcw_lock);
+	uv_cond_init(&kcw->kcw_cv);
+
+	if (uv_thread_create(&kcw->kcw_thread, chainwatcher, kcw) != 0) {
+		uv_close((uv_handle_t *)kcw->kcw_async, chainclose);
+		uv_mutex_destroy(&kcw->kcw_lock);
+		uv_cond_destroy(&kcw->kcw_cv);
+		(void) ::close(fd);
+		delete kcw;
+		return (-1);
+	}
+
+	ksr_chainwatch = kcw;
+	ksr_refresh = KSR_REFRESH_WATCH;
+
+	return (0);
+}
+
+void
+KStatReader::unchainwatch()
+{
+	ksr_chainwatch_t *kcw = ksr_chainwatch;
+
+	if (kcw == NULL)
+		return;
+
+	uv_mutex_lock(&kcw->kcw_lock);
+	kcw->kcw_done = true;
+	uv_cond_signal(&kcw->kcw_cv);
+	uv_mutex_unlock(&kcw->kcw_lock);
+	(void) uv_thread_join(&kcw->kcw_thread);
+
+	uv_close((uv_handle_t *)kcw->kcw_async, chainclose);
+	uv_mutex_destroy(&kcw->kcw_lock);
+	uv_cond_destroy(&kcw->kcw_cv);
+	(void) ::close(kcw->kcw_fd);
+	delete kcw;
+
+	ksr_chainwatch = NULL;
+	ksr_refresh = KSR_REFRESH_ALWAYS;
+}
+
+/*
+ * If a histogram's window has passed, start a new one, keeping the one that
+ * has just finished.  Windows follow one another without gaps, so if more
+ * than one has passed, the last complete window is empty.
+ */
+void
+KStatReader::ratewindow(ksr_ratehist_t *krh, hrtime_t now)
+{
+	ksr_rhistwin_t *cur = &krh->krh_cur;
+	hrtime_t n, start;
+	int64_t time;
+
+	if (krh->krh_window == 0 || now - cur->krw_start < krh->krh_window)
+		return;
+
+	n = (now - cur->krw_start) / krh->krh_window;
+	start = cur->krw_start + n * krh->krh_window;
+	time = cur->krw_time + n * (krh->krh_window / 1000000);
+
+	if (n == 1) {
+		krh->krh_prev = *cur;
+	} else {
+		ksr_rhist_reset(&krh->krh_prev, start - krh->krh_window,
+		    time - krh->krh_window / 1000000);
+	}
+
+	krh->krh_hasprev = true;
+	ksr_rhist_reset(cur, start, time);
+}
+
+/*
+ * Record the change in each histogram's statistic since we last read this
+ * kstat.
+ */
+void
+KStatReader::ratesample(kstat_t *ksp)
+{
+	map<kid_t, ksr_watchstate_t>::iterator st;
+	hrtime_t now = gethrtime(), delta;
+	ksr_rhistwin_t *krw;
+	double value, v;
+	uint64_t u;
+
+	for (size_t i = 0; i < ksr_ratehists.size(); i++) {
+		ksr_ratehist_t *krh = ksr_ratehists[i];
+
+		if (!this->matches(ksp, &krh->krh_module, &krh->krh_class,
+		    &krh->krh_name, krh->krh_instance) ||
+		    !ksr_fieldvalue(ksp, krh->krh_statistic.c_str(), &value))
+			continue;
+
+		this->ratewindow(krh, now);
+
+		if ((st = krh->krh_state.find(ksp->ks_kid)) ==
+		    krh->krh_state.end()) {
+			ksr_watchstate_t ws = { value, ksp->ks_snaptime, false };
+
+			krh->krh_state.insert(std::make_pair(ksp->ks_kid, ws));
+			continue;
+		}
+
+		/*
+		 * A coalesced read may give us the same snapshot twice.
+		 */
+		if ((delta = ksp->ks_snaptime - st->second.kws_snaptime) <= 0)
+			continue;
+
+		v = value - st->second.kws_value;
+
+		if (krh->krh_rate)
+			v = v * 1e9 / delta;
+
+		st->second.kws_value = value;
+		st->second.kws_snaptime = ksp->ks_snaptime;
+		v *= krh->krh_scale;
+		krw = &krh->krh_cur;
+
+		/*
+		 * A counter that has gone backwards has been reset (or has
+		 * wrapped); the change tells us nothing.
+		 */
+		if (!(v >= 0)) {
+			krw->krw_discarded++;
+			continue;
+		}
+
+		u = v < ldexp(1, 63) ? (uint64_t)(v + 0.5) : UINT64_MAX;
+		krw->krw_buckets[ksr_rhist_bucket(u)]++;
+		krw->krw_count++;
+		krw->krw_total += v;
+
+		if (u < krw->krw_min)
+			krw->krw_min = u;
+
+		if (u > krw->krw_max)
+			krw->krw_max = u;
+	}
+}
+
+napi_value
+KStatReader::Close(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	k->stopwatch();
+	k->unschedule();
+	k->unchainwatch();
+	k->unpublish();
+	k->close();
+	k->account(env);
+
+	return (NULL);
+}
+
+napi_value
+KStatReader::getKCID(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	return (ksr_number(env, k->getkcid()));
+}
+
+napi_value
+KStatReader::getKstat(napi_env env, napi_callback_info info)
+{
+	napi_value args[2], rval;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	string *imodule = stringMember(env, args[0], "module", "");
+	string module = *imodule;
+	int64_t instance = intMember(env, args[0], "instance", -1);
+	string *iname = stringMember(env, args[0], "name", "");
+	string name = *iname;
+	kstat_t *ksp = kstat_lookup(k->ksr_ctl, (char *)module.c_str(), instance, (char *)name.c_str());
+	k->ksr_counters.kct_lookups++;
+	if (ksp == NULL) {
+		rval = ksr_object(env);
+		ksr_set(env, rval, "error", ksr_string(env, "invalid kstat"));
+		ksr_set(env, rval, "module", ksr_string(env, module.c_str()));
+		ksr_set(env, rval, "instance", ksr_number(env, instance));
+		ksr_set(env, rval, "name", ksr_string(env, name.c_str()));
+	} else {
+		try {
+			rval = k->read(env, ksp, readflags(env, args[1]));
+		} catch (ksr_pending_t) {
+			rval = NULL;
+		}
+		k->account(env);
+	}
+	delete imodule;
+	delete iname;
+
+	return (rval);
+}
+
+napi_value
+KStatReader::Update(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+	napi_value rval;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	rval = ksr_number(env, k->update(true));
+	k->account(env);
+
+	return (rval);
+}
+
+napi_value
+KStatReader::List(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+	napi_value rval;
+	unsigned int i;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	if (k->update() == -1)
+		return (k->error(env, "failed to update kstat chain"));
+
+	rval = ksr_array(env, k->ksr_kstats.size());
+
+	for (i = 0; i < k->ksr_kstats.size(); i++)
+		ksr_setelem(env, rval, i, k->list(env, k->ksr_kstats[i]));
+
+	return (rval);
+}
+
+napi_value
+KStatReader::Read(napi_env env, napi_callback_info info)
+{
+	napi_value args[2], rval;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	unsigned int i, j;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	/*
+	 * A read with a budget stops once it has used it up, and returns with
+	 * the partial results a continuation from which the next read picks
+	 * up.  A continuation names the chain that it was made on and resumes
+	 * on that same chain, without updating it, so that the results of the
+	 * reads that make up one pass are consistent; if the chain has been
+	 * updated in the meantime, the pass must be started again.
+	 */
+	hrtime_t budget = intMember(env, args[1], "budgetUs", 0) * 1000LL;
+	string *cont = stringMember(env, args[1], "continuation", "");
+	hrtime_t start = gethrtime();
+	unsigned int first = 0;
+	kid_t kid;
+
+	/*
+	 * A read for the top N kstats ranks every matching kstat by a
+	 * statistic -- or, given "rate(statistic)", by its per-second rate --
+	 * and returns only the N highest.
+	 */
+	int64_t topn = intMember(env, args[1], "topN", 0);
+	string *by = stringMember(env, args[1], "by", "");
+	bool rate = false;
+
+	/*
+	 * A sparse read leaves out statistics that are zero -- or, if "sparse"
+	 * is "changed", that haven't changed since the last such read.
+	 */
+	string *mode = stringMember(env, args[1], "sparse",
+	    boolMember(env, args[1], "sparse", false) ? "zero" : "");
+	bool sparse = !mode->empty();
+	ksr_sparsectx_t ksc;
+
+	ksc.ksc_changed = *mode == "changed";
+	ksc.ksc_state = NULL;
+
+	if (sparse && ((*mode != "zero" && !ksc.ksc_changed) || topn > 0)) {
+		delete mode;
+		delete by;
+		delete cont;
+		return (k->error(env, "sparse must be true, \"zero\" or "
+		    "\"changed\", and can't be combined with topN\n"));
+	}
+
+	delete mode;
+
+	if (by->size() > 6 && by->compare(0, 5, "rate(") == 0 &&
+	    (*by)[by->size() - 1] == ')') {
+		*by = by->substr(5, by->size() - 6);
+		rate = true;
+	}
+
+	if (topn > 0 && (by->empty() || budget > 0 || !cont->empty())) {
+		delete by;
+		delete cont;
+		return (k->error(env, "topN requires a statistic to rank by, "
+		    "and can't be combined with a budget or continuation\n"));
+	}
+
+	if (cont->empty()) {
+		delete cont;
+
+		if (k->update() == -1) {
+			delete by;
+			return (k->error(env, "failed to update kstat chain"));
+		}
+	} else {
+		if (sscanf(cont->c_str(), "%d:%u", &kid, &first) != 2 ||
+		    first > k->ksr_kstats.size()) {
+			k->error(env, "invalid continuation \"%s\"\n",
+			    cont->c_str());
+			delete cont;
+			delete by;
+			return (NULL);
+		}
+
+		delete cont;
+
+		if (kid != k->ksr_kid) {
+			delete by;
+			return (k->error(env, "kstat chain %d has been "
+			    "updated to %d since continuation\n", kid,
+			    k->ksr_kid));
+		}
+	}
+
+	string *rmodule = stringMember(env, args[0], "module", "");
+	string *rclass = stringMember(env, args[0], "class", "");
+	string *rname = stringMember(env, args[0], "name", "");
+	int64_t rinstance = intMember(env, args[0], "instance", -1);
+	int flags = readflags(env, args[1]);
+
+	rval = ksr_array(env);
+
+	if (sparse) {
+		ksc.ksc_schemas = ksr_array(env);
+		ksr_set(env, rval, "schemas", ksc.ksc_schemas);
+	}
+
+	/*
+	 * What has changed is relative to the last such read of the same
+	 * specification, so that reads of different kstats don't disturb
+	 * each other.
+	 */
+	if (ksc.ksc_changed) {
+		char instance[32];
+		string spec = *rclass + '\0' + *rmodule + '\0' + *rname + '\0';
+
+		(void) snprintf(instance, sizeof (instance), "%lld",
+		    (long long)rinstance);
+		ksc.ksc_state = &k->ksr_sparsestate[spec + instance];
+	}
+
+	try {
+		/*
+		 * Having ranked the matching kstats, there are none left to
+		 * read.
+		 */
+		if (topn > 0) {
+			rval = k->rank(env, rmodule, rclass, rname, rinstance,
+			    flags, *by, rate, topn);
+			first = k->ksr_kstats.size();
+		}
+
+		for (i = first, j = 0; i < k->ksr_kstats.size(); i++) {
+			if (!k->matches(k->ksr_kstats[i],
+			    rmodule, rclass, rname, rinstance))
+				continue;
+
+			/*
+			 * A kstat that we're backing off from has already
+			 * reported its error; it is summarized by failures().
+			 */
+			if (k->backingoff(k->ksr_kstats[i]))
+				continue;
+
+			ksr_setelem(env, rval, j++, sparse ?
+			    k->sparse(env, k->ksr_kstats[i], &ksc) :
+			    k->read(env, k->ksr_kstats[i], flags));
+
+			if (budget > 0 && i + 1 < k->ksr_kstats.size() &&
+			    gethrtime() - start >= budget) {
+				char token[32];
+
+				(void) snprintf(token, sizeof (token), "%d:%u",
+				    (int)k->ksr_kid, i + 1);
+				ksr_set(env, rval, "continuation",
+				    ksr_string(env, token));
+				break;
+			}
+		}
+	} catch (ksr_pending_t) {
+		rval = NULL;
+	}
+
+	delete rmodule;
+	delete rclass;
+	delete rname;
+	delete by;
+	k->account(env);
+
+	return (rval);
+}
+
+napi_value
+KStatReader::Watch(napi_env env, napi_callback_info info)
+{
+	napi_value args[1];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 1);
+	ksr_watch_t *kw;
+	string *member;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (ksr_type(env, args[0]) != napi_object)
+		return (k->error(env, "watch requires a rule object\n"));
+
+	kw = new ksr_watch_t;
+	kw->kw_id = ++k->ksr_watchid;
+	kw->kw_instance = intMember(env, args[0], "instance", -1);
+	kw->kw_rate = boolMember(env, args[0], "rate", false);
+	kw->kw_scale = numberMember(env, args[0], "scale", 1);
+	kw->kw_threshold = numberMember(env, args[0], "value", 0);
+
+	member = stringMember(env, args[0], "module", "");
+	kw->kw_module = *member;
+	delete member;
+
+	member = stringMember(env, args[0], "class", "");
+	kw->kw_class = *member;
+	delete member;
+
+	member = stringMember(env, args[0], "name", "");
+	kw->kw_name = *member;
+	delete member;
+
+	member = stringMember(env, args[0], "statistic", "");
+	kw->kw_statistic = *member;
+	delete member;
+
+	member = stringMember(env, args[0], "op", ">");
+
+	if (*member == ">") {
+		kw->kw_op = KSW_GT;
+	} else if (*member == ">=") {
+		kw->kw_op = KSW_GE;
+	} else if (*member == "<") {
+		kw->kw_op = KSW_LT;
+	} else if (*member == "<=") {
+		kw->kw_op = KSW_LE;
+	} else if (*member == "==") {
+		kw->kw_op = KSW_EQ;
+	} else if (*member == "!=") {
+		kw->kw_op = KSW_NE;
+	} else {
+		k->error(env, "unrecognized watch operator \"%s\"\n",
+		    member->c_str());
+		delete member;
+		delete kw;
+		return (NULL);
+	}
+
+	delete member;
+
+	if (kw->kw_statistic.empty()) {
+		delete kw;
+		return (k->error(env, "watch requires a statistic\n"));
+	}
+
+	k->ksr_watches.push_back(kw);
+
+	return (ksr_number(env, kw->kw_id));
+}
+
+napi_value
+KStatReader::Unwatch(napi_env env, napi_callback_info info)
+{
+	napi_value args[1];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 1);
+	int64_t id = -1;
+	size_t i;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (ksr_type(env, args[0]) == napi_number)
+		(void) napi_get_value_int64(env, args[0], &id);
+
+	for (i = 0; i < k->ksr_watches.size(); i++) {
+		if (k->ksr_watches[i]->kw_id != id)
+			continue;
+
+		delete k->ksr_watches[i];
+		k->ksr_watches.erase(k->ksr_watches.begin() + i);
+		return (ksr_boolean(env, true));
+	}
+
+	return (ksr_boolean(env, false));
+}
+
+napi_value
+KStatReader::CheckWatch(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+	napi_value events;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	events = ksr_array(env);
+
+	if (k->checkwatches(env, events) == -1)
+		return (k->error(env, "failed to update kstat chain"));
+
+	return (events);
+}
+
+napi_value
+KStatReader::StartWatch(napi_env env, napi_callback_info info)
+{
+	napi_value args[2];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	uv_loop_t *loop;
+	int64_t interval;
+	uint32_t refs;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	if (ksr_type(env, args[0]) != napi_number ||
+	    ksr_type(env, args[1]) != napi_function ||
+	    napi_get_value_int64(env, args[0], &interval) != napi_ok ||
+	    interval <= 0) {
+		return (k->error(env,
+		    "startwatch requires an interval and a callback\n"));
+	}
+
+	if (napi_get_uv_event_loop(env, &loop) != napi_ok)
+		return (k->error(env, "could not find event loop\n"));
+
+	k->stopwatch();
+
+	/*
+	 * The timer runs on the loop of the thread that we were created on,
+	 * which may be a worker's.
+	 */
+	k->ksr_timer = new uv_timer_t;
+	k->ksr_timer->data = k;
+	uv_timer_init(loop, k->ksr_timer);
+	uv_timer_start(k->ksr_timer, watchtimer, interval, interval);
+	(void) napi_create_reference(env, args[1], 1, &k->ksr_watchcb);
+	(void) napi_async_init(env, NULL, ksr_string(env, "kstat:watch"),
+	    &k->ksr_watchctx);
+
+	/*
+	 * The timer holds a reference to us so that we aren't collected
+	 * while watches are being evaluated on our behalf.
+	 */
+	(void) napi_reference_ref(env, k->ksr_self, &refs);
+
+	return (NULL);
+}
+
+napi_value
+KStatReader::StopWatch(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+
+	if (k == NULL)
+		return (NULL);
+
+	k->stopwatch();
+
+	return (NULL);
+}
+
+napi_value
+KStatReader::Schedule(napi_env env, napi_callback_info info)
+{
+	napi_value args[2], entry;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	vector<ksr_schedentry_t> sched;
+	uv_loop_t *loop;
+	uint32_t i, len;
+	int64_t now;
+	string *member;
+	uint32_t refs;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	if (!ksr_isarray(env, args[0]) ||
+	    ksr_type(env, args[1]) != napi_function ||
+	    napi_get_array_length(env, args[0], &len) != napi_ok || len == 0) {
+		return (k->error(env,
+		    "schedule requires an array of entries and a callback\n"));
+	}
+
+	now = schednow();
+
+	for (i = 0; i < len; i++) {
+		ksr_schedentry_t kse;
+
+		entry = ksr_getelem(env, args[0], i);
+		kse.kse_interval = intMember(env, entry, "interval", 0);
+
+		if (kse.kse_interval <= 0) {
+			return (k->error(env, "schedule entry %u requires "
+			    "a positive interval\n", i));
+		}
+
+		member = stringMember(env, entry, "module", "");
+		kse.kse_module = *member;
+		delete member;
+
+		member = stringMember(env, entry, "class", "");
+		kse.kse_class = *member;
+		delete member;
+
+		member = stringMember(env, entry, "name", "");
+		kse.kse_name = *member;
+		delete member;
+
+		kse.kse_instance = intMember(env, entry, "instance", -1);
+		kse.kse_flags = readflags(env, entry);
+		kse.kse_due = (now / kse.kse_interval + 1) * kse.kse_interval;
+		sched.push_back(kse);
+	}
+
+	if (napi_get_uv_event_loop(env, &loop) != napi_ok)
+		return (k->error(env, "could not find event loop\n"));
+
+	k->unschedule();
+	k->ksr_sched = sched;
+
+	/*
+	 * As with watches, the timer runs on our own thread's loop, and holds
+	 * a reference to us while the schedule runs.
+	 */
+	k->ksr_schedtimer = new uv_timer_t;
+	k->ksr_schedtimer->data = k;
+	uv_timer_init(loop, k->ksr_schedtimer);
+	(void) napi_create_reference(env, args[1], 1, &k->ksr_schedcb);
+	(void) napi_async_init(env, NULL, ksr_string(env, "kstat:schedule"),
+	    &k->ksr_schedctx);
+	(void) napi_reference_ref(env, k->ksr_self, &refs);
+	k->schedarm();
+
+	return (NULL);
+}
+
+napi_value
+KStatReader::Unschedule(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+
+	if (k == NULL)
+		return (NULL);
+
+	k->unschedule();
+
+	return (NULL);
+}
+
+napi_value
+KStatReader::Histogram(napi_env env, napi_callback_info info)
+{
+	napi_value args[1];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 1);
+	ksr_ratehist_t *krh;
+	string *member;
+	int64_t window;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (ksr_type(env, args[0]) != napi_object)
+		return (k->error(env, "histogram requires a rule object\n"));
+
+	if ((window = intMember(env, args[0], "window", 0)) < 0)
+		return (k->error(env, "histogram window must not be negative\n"));
+
+	krh = new ksr_ratehist_t;
+	krh->krh_id = ++k->ksr_ratehistid;
+	krh->krh_instance = intMember(env, args[0], "instance", -1);
+	krh->krh_rate = boolMember(env, args[0], "rate", true);
+	krh->krh_scale = numberMember(env, args[0], "scale", 1);
+	krh->krh_window = window * 1000000LL;
+	krh->krh_hasprev = false;
+	ksr_rhist_reset(&krh->krh_cur, gethrtime(), schednow());
+
+	member = stringMember(env, args[0], "module", "");
+	krh->krh_module = *member;
+	delete member;
+
+	member = stringMember(env, args[0], "class", "");
+	krh->krh_class = *member;
+	delete member;
+
+	member = stringMember(env, args[0], "name", "");
+	krh->krh_name = *member;
+	delete member;
+
+	member = stringMember(env, args[0], "statistic", "");
+	krh->krh_statistic = *member;
+	delete member;
+
+	if (krh->krh_statistic.empty()) {
+		delete krh;
+		return (k->error(env, "histogram requires a statistic\n"));
+	}
+
+	k->ksr_ratehists.push_back(krh);
+
+	return (ksr_number(env, krh->krh_id));
+}
+
+napi_value
+KStatReader::GetHistogram(napi_env env, napi_callback_info info)
+{
+	static const double deflt[] = { 50, 90, 99, 99.9 };
+	napi_value args[2], rval, pcts, buckets, spec, b;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	ksr_ratehist_t *krh = NULL;
+	ksr_rhistwin_t *krw;
+	vector<double> want;
+	uint64_t low, high, seen, rank, value;
+	uint32_t i, n, len;
+	int64_t id = -1;
+	char key[32];
+	double p;
+	int bucket;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	if (ksr_type(env, args[0]) == napi_number)
+		(void) napi_get_value_int64(env, args[0], &id);
+
+	for (i = 0; i < k->ksr_ratehists.size(); i++) {
+		if (k->ksr_ratehists[i]->krh_id == id)
+			krh = k->ksr_ratehists[i];
+	}
+
+	if (krh == NULL)
+		return (k->error(env, "unknown histogram %lld\n", (long long)id));
+
+	spec = ksr_type(env, args[1]) == napi_object ?
+	    ksr_get(env, args[1], "percentiles") : NULL;
+
+	if (spec != NULL && ksr_isarray(env, spec) &&
+	    napi_get_array_length(env, spec, &len) == napi_ok) {
+		for (i = 0; i < len; i++) {
+			b = ksr_getelem(env, spec, i);
+
+			if (ksr_type(env, b) != napi_number ||
+			    napi_get_value_double(env, b, &p) != napi_ok ||
+			    !(p >= 0 && p <= 100)) {
+				return (k->error(env, "percentile %u must be a "
+				    "number from 0 to 100\n", i));
+			}
+
+			want.push_back(p);
+		}
+	} else {
+		want.assign(deflt, deflt + sizeof (deflt) / sizeof (deflt[0]));
+	}
+
+	k->ratewindow(krh, gethrtime());
+
+	if (boolMember(env, args[1], "previous", false)) {
+		if (!krh->krh_hasprev)
+			return (ksr_null(env));
+
+		krw = &krh->krh_prev;
+	} else {
+		krw = &krh->krh_cur;
+	}
+
+	rval = ksr_object(env);
+	ksr_set(env, rval, "id", ksr_number(env, krh->krh_id));
+	ksr_set(env, rval, "statistic",
+	    ksr_string(env, krh->krh_statistic.c_str()));
+	ksr_set(env, rval, "start", ksr_number(env, krw->krw_time));
+	ksr_set(env, rval, "count", ksr_number(env, krw->krw_count));
+	ksr_set(env, rval, "discarded", ksr_number(env, krw->krw_discarded));
+
+	if (krw->krw_count == 0) {
+		ksr_set(env, rval, "min", ksr_null(env));
+		ksr_set(env, rval, "max", ksr_null(env));
+		ksr_set(env, rval, "mean", ksr_null(env));
+	} else {
+		ksr_set(env, rval, "min", ksr_number(env, krw->krw_min));
+		ksr_set(env, rval, "max", ksr_number(env, krw->krw_max));
+		ksr_set(env, rval, "mean",
+		    ksr_number(env, krw->krw_total / krw->krw_count));
+	}
+
+	/*
+	 * As HdrHistogram does, we report the value at a percentile as the
+	 * greatest value that its bucket could have counted, within the values
+	 * actually seen.
+	 */
+	pcts = ksr_object(env);
+
+	for (i = 0; i < want.size(); i++) {
+		(void) snprintf(key, sizeof (key), "%g", want[i]);
+
+		if (krw->krw_count == 0) {
+			ksr_set(env, pcts, key, ksr_null(env));
+			continue;
+		}
+
+		rank = (uint64_t)ceil(want[i] / 100 * krw->krw_count);
+		seen = 0;
+		value = krw->krw_max;
+
+		if (rank == 0)
+			rank = 1;
+
+		for (bucket = 0; bucket < KSR_RHIST_BUCKETS; bucket++) {
+			if ((seen += krw->krw_buckets[bucket]) < rank)
+				continue;
+
+			ksr_rhist_bounds(bucket, &low, &high);
+			value = std::max(krw->krw_min,
+			    std::min(krw->krw_max, high - 1));
+			break;
+		}
+
+		ksr_set(env, pcts, key, ksr_number(env, value));
+	}
+
+	ksr_set(env, rval, "percentiles", pcts);
+
+	if (boolMember(env, args[1], "buckets", false)) {
+		buckets = ksr_array(env);
+
+		for (bucket = 0, n = 0; bucket < KSR_RHIST_BUCKETS; bucket++) {
+			if (krw->krw_buckets[bucket] == 0)
+				continue;
+
+			ksr_rhist_bounds(bucket, &low, &high);
+			b = ksr_array(env, 3);
+			ksr_setelem(env, b, 0, ksr_number(env, low));
+			ksr_setelem(env, b, 1, bucket == KSR_RHIST_BUCKETS - 1 ?
+			    ksr_null(env) : ksr_number(env, high));
+			ksr_setelem(env, b, 2,
+			    ksr_number(env, krw->krw_buckets[bucket]));
+			ksr_setelem(env, buckets, n++, b);
+		}
+
+		ksr_set(env, rval, "buckets", buckets);
+	}
+
+	if (boolMember(env, args[1], "reset", false))
+		ksr_rhist_reset(&krh->krh_cur, gethrtime(), schednow());
+
+	return (rval);
+}
+
+napi_value
+KStatReader::Unhistogram(napi_env env, napi_callback_info info)
+{
+	napi_value args[1];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 1);
+	int64_t id = -1;
+	size_t i;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (ksr_type(env, args[0]) == napi_number)
+		(void) napi_get_value_int64(env, args[0], &id);
+
+	for (i = 0; i < k->ksr_ratehists.size(); i++) {
+		if (k->ksr_ratehists[i]->krh_id != id)
+			continue;
+
+		delete k->ksr_ratehists[i];
+		k->ksr_ratehists.erase(k->ksr_ratehists.begin() + i);
+		return (ksr_boolean(env, true));
+	}
+
+	return (ksr_boolean(env, false));
+}
+
+napi_value
+KStatReader::Failures(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+	map<kid_t, ksr_failure_t>::iterator it;
+	hrtime_t now = gethrtime();
+	napi_value rval;
+	unsigned int i = 0;
+
+	if (k == NULL)
+		return (NULL);
+
+	rval = ksr_array(env, k->ksr_failures.size());
+
+	for (it = k->ksr_failures.begin(); it != k->ksr_failures.end(); it++) {
+		ksr_failure_t *kfp = &it->second;
+		napi_value f = ksr_object(env);
+		hrtime_t retry = kfp->kf_retry > now ? kfp->kf_retry - now : 0;
+
+		ksr_set(env, f, "class", ksr_string(env, kfp->kf_class.c_str()));
+		ksr_set(env, f, "module", ksr_string(env, kfp->kf_module.c_str()));
+		ksr_set(env, f, "name", ksr_string(env, kfp->kf_name.c_str()));
+		ksr_set(env, f, "instance", ksr_number(env, kfp->kf_instance));
+		ksr_set(env, f, "error", ksr_string(env, strerror(kfp->kf_errno)));
+		ksr_set(env, f, "failures", ksr_number(env, kfp->kf_count));
+		ksr_set(env, f, "retry", ksr_number(env, retry / 1000000));
+		ksr_setelem(env, rval, i++, f);
+	}
+
+	return (rval);
+}
+
+/*
+ * Bring an array previously returned by read() up to date.  Objects are
+ * updated in place; the array itself is only modified where kstats have come
+ * or gone.
+ */
+napi_value
+KStatReader::Refresh(napi_env env, napi_callback_info info)
+{
+	napi_value args[3];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 3);
+	map<kid_t, napi_value> previous;
+	map<kid_t, napi_value>::iterator it;
+	napi_value results;
+	bool indexed = false;
+	unsigned int i, j, length;
+	int flags;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	if (!ksr_isarray(env, args[0])) {
+		return (k->error(env,
+		    "refresh requires an array returned by read()\n"));
+	}
+
+	if (k->update() == -1)
+		return (k->error(env, "failed to update kstat chain"));
+
+	results = args[0];
+	(void) napi_get_array_length(env, results, &length);
+	flags = readflags(env, args[2]);
+
+	string *rmodule = stringMember(env, args[1], "module", "");
+	string *rclass = stringMember(env, args[1], "class", "");
+	string *rname = stringMember(env, args[1], "name", "");
+	int64_t rinstance = intMember(env, args[1], "instance", -1);
+
+	try {
+		for (i = 0, j = 0; i < k->ksr_kstats.size(); i++) {
+			kstat_t *ksp = k->ksr_kstats[i];
+			napi_value rval;
+
+			if (!k->matches(ksp, rmodule, rclass, rname, rinstance) ||
+			    k->backingoff(ksp))
+				continue;
+
+			/*
+			 * As long as the chain hasn't changed, each kstat will
+			 * be where we left it.  If we find otherwise, we index
+			 * what we were given by kstat ID and look them up.
+			 */
+			if (!indexed && j < length) {
+				napi_value v = ksr_getelem(env, results, j);
+
+				if (kidof(env, v) == ksp->ks_kid) {
+					k->refresh(env, v, ksp, flags);
+					j++;
+					continue;
+				}
+
+				for (unsigned int p = j; p < length; p++) {
+					napi_value pv = ksr_getelem(env,
+					    results, p);
+					kid_t kid = kidof(env, pv);
+
+					if (kid != -1)
+						previous[kid] = pv;
+				}
+
+				indexed = true;
+			}
+
+			if ((it = previous.find(ksp->ks_kid)) != previous.end()) {
+				rval = it->second;
+				k->refresh(env, rval, ksp, flags);
+			} else {
+				rval = k->read(env, ksp, flags);
+			}
+
+			ksr_setelem(env, results, j++, rval);
+		}
+	} catch (ksr_pending_t) {
+		delete rmodule;
+		delete rclass;
+		delete rname;
+		return (NULL);
+	}
+
+	delete rmodule;
+	delete rclass;
+	delete rname;
+
+	if (j != length)
+		ksr_set(env, results, "length", ksr_number(env, j));
+
+	k->account(env);
+
+	return (results);
+}
+
+/*
+ * Return the results of the read before last, from the snapshots kept by the
+ * reader, without reading anything.
+ */
+napi_value
+KStatReader::Previous(napi_env env, napi_callback_info info)
+{
+	napi_value args[2], rval;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	unsigned int i, j;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (!k->ksr_snapshots)
+		return (k->error(env, "kstat reader is not keeping snapshots\n"));
+
+	string *rmodule = stringMember(env, args[0], "module", "");
+	string *rclass = stringMember(env, args[0], "class", "");
+	string *rname = stringMember(env, args[0], "name", "");
+	int64_t rinstance = intMember(env, args[0], "instance", -1);
+	int flags = readflags(env, args[1]);
+
+	rval = ksr_array(env);
+
+	try {
+		for (i = 0, j = 0; i < k->ksr_kstats.size(); i++) {
+			kstat_t *ksp = k->ksr_kstats[i];
+			napi_value obj;
+
+			if (!k->matches(ksp, rmodule, rclass, rname, rinstance) ||
+			    (ksp = k->previous(ksp)) == NULL)
+				continue;
+
+			obj = k->header(env, ksp);
+			k->contents(env, obj, ksp, flags);
+			ksr_setelem(env, rval, j++, obj);
+		}
+	} catch (ksr_pending_t) {
+		rval = NULL;
+	}
+
+	delete rmodule;
+	delete rclass;
+	delete rname;
+
+	return (rval);
+}
+
+napi_value
+KStatReader::Prepare(napi_env env, napi_callback_info info)
+{
+	napi_value args[1], self;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 1, &self);
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	return (KStatHandle::New(env, k, self, args[0]));
+}
+
+void
+KStatHandle::Initialize(napi_env env)
+{
+	napi_property_descriptor methods[] = {
+		KSR_METHOD("read", KStatHandle::Read),
+	};
+	napi_value cons;
+
+	(void) napi_define_class(env, "Handle", NAPI_AUTO_LENGTH,
+	    KStatHandle::Construct, NULL,
+	    sizeof (methods) / sizeof (methods[0]), methods, &cons);
+	(void) napi_create_reference(env, cons, 1, &ksr_instdata(env)->ki_handle);
+}
+
+KStatHandle::KStatHandle(napi_env env, KStatReader *reader,
+    napi_value readerobj, string *module, int instance, string *name)
+    : kh_env(env), kh_reader(reader), kh_module(*module),
+    kh_instance(instance), kh_name(*name), kh_ksp(NULL), kh_chain(-1),
+    kh_reopens(0)
+{
+	(void) napi_create_reference(env, readerobj, 1, &kh_readerobj);
+}
+
+KStatHandle::~KStatHandle()
+{
+	(void) napi_delete_reference(kh_env, kh_readerobj);
+}
+
+void
+KStatHandle::finalize(napi_env env, void *data, void *hint)
+{
+	delete (KStatHandle *)data;
+}
+
+/*
+ * Handles are only created by prepare(), never by calling the constructor.
+ */
+napi_value
+KStatHandle::Construct(napi_env env, napi_callback_info info)
+{
+	napi_value self;
+	size_t argc = 0;
+
+	if (napi_get_cb_info(env, info, &argc, NULL, &self, NULL) != napi_ok)
+		return (NULL);
+
+	return (self);
+}
+
+napi_value
+KStatHandle::New(napi_env env, KStatReader *reader, napi_value readerobj,
+    napi_value spec)
+{
+	napi_value cons, obj, fields;
+	uint32_t nfields;
+
+	if (napi_get_reference_value(env, ksr_instdata(env)->ki_handle,
+	    &cons) != napi_ok ||
+	    napi_new_instance(env, cons, 0, NULL, &obj) != napi_ok)
+		return (NULL);
+
+	string *module = KStatReader::stringMember(env, spec, "module", "");
+	string *name = KStatReader::stringMember(env, spec, "name", "");
+	KStatHandle *h = new KStatHandle(env, reader, readerobj, module,
+	    KStatReader::intMember(env, spec, "instance", -1), name);
+
+	delete module;
+	delete name;
+
+	if (ksr_type(env, spec) == napi_object &&
+	    ksr_isarray(env, fields = ksr_get(env, spec, "fields")) &&
+	    napi_get_array_length(env, fields, &nfields) == napi_ok) {
+		for (uint32_t i = 0; i < nfields; i++) {
+			h->kh_fields.push_back(ksr_utf8(env,
+			    ksr_getelem(env, fields, i)));
+		}
+	}
+
+	if (napi_wrap(env, obj, h, finalize, NULL, NULL) != napi_ok) {
+		delete h;
+		return (NULL);
+	}
+
+	return (obj);
+}
+
+kstat_t *
+KStatHandle::resolve()
+{
+	kstat_ctl_t *kc = kh_reader->ksr_ctl;
+
+	if (kh_ksp != NULL && kh_chain == kc->kc_chain_id &&
+	    kh_reopens == kh_reader->ksr_reopens)
+		return (kh_ksp);
+
+	kh_ksp = kstat_lookup(kc, (char *)kh_module.c_str(), kh_instance,
+	    (char *)kh_name.c_str());
+	kh_chain = kc->kc_chain_id;
+	kh_reopens = kh_reader->ksr_reopens;
+	kh_index.clear();
+	kh_reader->ksr_counters.kct_lookups++;
+
+	return (kh_ksp);
+}
+
+/*
+ * Build the result for a handle that has asked for specific fields.
+ */
+napi_value
+KStatHandle::project(napi_env env, kstat_t *ksp)
+{
+	napi_value rval = kh_reader->header(env, ksp);
+	napi_value data = ksr_object(env);
+	size_t i;
+	double value;
+
+	ksr_set(env, rval, "snaptime", ksr_number(env, ksp->ks_snaptime));
+	ksr_set(env, rval, "crtime", ksr_number(env, ksp->ks_crtime));
+
+	if (ksp->ks_type != KSTAT_TYPE_NAMED) {
+		for (i = 0; i < kh_fields.size(); i++) {
+			if (ksr_fieldvalue(ksp, kh_fields[i].c_str(),
+			    &value)) {
+				ksr_set(env, data, kh_fields[i].c_str(),
+				    ksr_number(env, value));
+			}
+		}
+
+		ksr_set(env, rval, "data", data);
+		return (rval);
+	}
+
+	/*
+	 * For named kstats we remember where each field was found, and only
+	 * search for it again if it isn't there next time.
+	 */
+	kstat_named_t *nm = KSTAT_NAMED_PTR(ksp);
+
+	if (kh_index.size() != kh_fields.size())
+		kh_index.assign(kh_fields.size(), -1);
+
+	for (i = 0; i < kh_fields.size(); i++) {
+		const char *field = kh_fields[i].c_str();
+		int ndx = kh_index[i];
+
+		if (ndx < 0 || (unsigned int)ndx >= ksp->ks_ndata ||
+		    strcmp(nm[ndx].name, field) != 0) {
+			for (ndx = 0; (unsigned int)ndx < ksp->ks_ndata; ndx++) {
+				if (strcmp(nm[ndx].name, field) == 0)
+					break;
+			}
+
+			if ((unsigned int)ndx == ksp->ks_ndata)
+				continue;
+
+			kh_index[i] = ndx;
+		}
+
+		ksr_set(env, data, field,
+		    KStatReader::namedvalue(env, ksp, &nm[ndx]));
+	}
+
+	ksr_set(env, rval, "data", data);
+	return (rval);
+}
+
+napi_value
+KStatHandle::Read(napi_env env, napi_callback_info info)
+{
+	napi_value args[1], rval;
+	KStatHandle *h = ksr_unwrap<KStatHandle>(env, info, args, 1);
+	KStatReader *k;
+	kstat_t *ksp;
+	kid_t kid = -1;
+	hrtime_t start;
+
+	if (h == NULL)
+		return (NULL);
+
+	if ((k = h->kh_reader)->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
+
+	/*
+	 * If the kstat has gone away since we looked it up, a read fails with
+	 * ENXIO; bring the chain up to date and look for it again.
+	 */
+	if ((ksp = h->resolve()) != NULL && (kid = k->kread(ksp)) == -1 &&
+	    errno == ENXIO && k->update(true) != -1 &&
+	    (ksp = h->resolve()) != NULL)
+		kid = k->kread(ksp);
+
+	if (ksp == NULL) {
+		rval = ksr_object(env);
+		ksr_set(env, rval, "error", ksr_string(env, "invalid kstat"));
+		ksr_set(env, rval, "module", ksr_string(env, h->kh_module.c_str()));
+		ksr_set(env, rval, "instance", ksr_number(env, h->kh_instance));
+		ksr_set(env, rval, "name", ksr_string(env, h->kh_name.c_str()));
+		return (rval);
+	}
+
+	/*
+	 * As with read(), the header counts as materializing the object and
+	 * the data as decoding it; a projection is all decoding.
+	 */
+	try {
+		start = k->ksr_instrument ? gethrtime() : 0;
+
+		if (kid == -1) {
+			rval = k->header(env, ksp);
+			ksr_set(env, rval, "error",
+			    ksr_string(env, strerror(errno)));
+		} else if (h->kh_fields.empty()) {
+			rval = k->header(env, ksp);
+
+			if (k->ksr_instrument) {
+				k->record(ksp, KSP_MATERIALIZE,
+				    gethrtime() - start);
+				start = gethrtime();
+			}
+
+			k->contents(env, rval, ksp,
+			    KStatReader::readflags(env, args[0]));
+		} else {
+			rval = h->project(env, ksp);
+		}
+
+		if (k->ksr_instrument) {
+			k->record(ksp, kid == -1 ? KSP_MATERIALIZE :
+			    KSP_DECODE, gethrtime() - start);
+		}
+	} catch (ksr_pending_t) {
+		rval = NULL;
 	}
 
-	return (0);
+	k->account(env);
+
+	return (rval);
 }
 
-void
-KStatReader::Initialize(Local<Object> exports)
+napi_value
+KStatReader::Iterate(napi_env env, napi_callback_info info)
 {
-	v8::Isolate* isolate;
-  isolate = exports->GetIsolate();
+	napi_value args[2], self;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2, &self);
 
-	Local<FunctionTemplate> localTempl = FunctionTemplate::New(isolate, KStatReader::New);
-	localTempl->InstanceTemplate()->SetInternalFieldCount(1);
-	localTempl->SetClassName(String::NewFromUtf8(isolate, "Reader", String::kInternalizedString));
+	if (k == NULL)
+		return (NULL);
 
-	NODE_SET_PROTOTYPE_METHOD(localTempl, "read", KStatReader::Read);
-	NODE_SET_PROTOTYPE_METHOD(localTempl, "list", KStatReader::List);
-	NODE_SET_PROTOTYPE_METHOD(localTempl, "close", KStatReader::Close);
-	NODE_SET_PROTOTYPE_METHOD(localTempl, "getkcid", KStatReader::getKCID);
-	NODE_SET_PROTOTYPE_METHOD(localTempl, "getkstat", KStatReader::getKstat);
-	NODE_SET_PROTOTYPE_METHOD(localTempl, "chainupdate", KStatReader::Update);
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
 
-	templ.Reset(isolate, localTempl);
+	if (k->update() == -1)
+		return (k->error(env, "failed to update kstat chain"));
 
-	exports->Set(String::NewFromUtf8(isolate, "Reader", String::kInternalizedString), localTempl->GetFunction(isolate->GetCurrentContext()).ToLocalChecked());
+	return (KStatCursor::New(env, k, self, args[0], args[1]));
 }
 
-string *
-KStatReader::stringMember(Isolate *isolate, Local<Value> value, char *member, char *deflt)
+void
+KStatCursor::Initialize(napi_env env)
 {
-	if (!value->IsObject())
-		return (new string(deflt));
-
-	Local<Object> o = Local<Object>::Cast(value);
-	Local<Value> v = o->Get(String::NewFromUtf8(isolate, member));
-
-	if (!v->IsString())
-		return (new string(deflt));
-
-	String::Utf8Value val(isolate, v);
-	return (new string(*val));
+	napi_property_descriptor methods[] = {
+		KSR_METHOD("next", KStatCursor::Next),
+	};
+	napi_value cons;
+
+	(void) napi_define_class(env, "Cursor", NAPI_AUTO_LENGTH,
+	    KStatCursor::Construct, NULL,
+	    sizeof (methods) / sizeof (methods[0]), methods, &cons);
+	(void) napi_create_reference(env, cons, 1, &ksr_instdata(env)->ki_cursor);
 }
 
-int64_t
-KStatReader::intMember(Isolate *isolate, Local<Value> value, char *member, int64_t deflt)
+KStatCursor::KStatCursor(napi_env env, KStatReader *reader,
+    napi_value readerobj)
+    : kc_env(env), kc_reader(reader),
+    kc_chain(reader->ksr_ctl->kc_chain_id),
+    kc_reopens(reader->ksr_reopens), kc_next(0),
+    kc_batch(KSR_BATCH_DEFAULT), kc_list(false), kc_flags(0)
 {
-	int64_t rval = deflt;
+	(void) napi_create_reference(env, readerobj, 1, &kc_readerobj);
+}
 
-	if (!value->IsObject())
-		return (rval);
+KStatCursor::~KStatCursor()
+{
+	(void) napi_delete_reference(kc_env, kc_readerobj);
+}
 
-	Local<Object> o = Local<Object>::Cast(value);
-	value = o->Get(String::NewFromUtf8(isolate, member));
+void
+KStatCursor::finalize(napi_env env, void *data, void *hint)
+{
+	delete (KStatCursor *)data;
+}
 
-	if (!value->IsNumber())
-		return (rval);
+napi_value
+KStatCursor::Construct(napi_env env, napi_callback_info info)
+{
+	napi_value self;
+	size_t argc = 0;
 
-	Local<Integer> i = Local<Integer>::Cast(value);
+	if (napi_get_cb_info(env, info, &argc, NULL, &self, NULL) != napi_ok)
+		return (NULL);
 
-	return (i->Value());
+	return (self);
 }
 
-void
-KStatReader::New(const FunctionCallbackInfo<Value>& args)
+static bool
+ksr_kstatorder(const kstat_t *l, const kstat_t *r)
 {
-	Isolate *isolate = args.GetIsolate();
-	KStatReader *k = new KStatReader(stringMember(isolate, args[0], "module", ""),
-	    stringMember(isolate, args[0], "class", ""),
-	    stringMember(isolate, args[0], "name", ""),
-	    intMember(isolate, args[0], "instance", -1));
+	int cmp;
+
+	if ((cmp = strcmp(l->ks_module, r->ks_module)) != 0)
+		return (cmp < 0);
 
-	k->Wrap(args.Holder());
+	if (l->ks_instance != r->ks_instance)
+		return (l->ks_instance < r->ks_instance);
 
-	args.GetReturnValue().Set (args.This());
+	return (strcmp(l->ks_name, r->ks_name) < 0);
 }
 
-Local<Value>
-KStatReader::error(Isolate *isolate, const char *fmt, ...)
+napi_value
+KStatCursor::New(napi_env env, KStatReader *k, napi_value readerobj,
+    napi_value spec, napi_value options)
 {
-	char buf[1024], buf2[1024];
-	char *err = buf;
-	va_list ap;
+	napi_value cons, obj;
+	KStatCursor *c;
+	int64_t batch;
+	size_t i;
+
+	if (napi_get_reference_value(env, ksr_instdata(env)->ki_cursor,
+	    &cons) != napi_ok ||
+	    napi_new_instance(env, cons, 0, NULL, &obj) != napi_ok)
+		return (NULL);
+
+	c = new KStatCursor(env, k, readerobj);
+
+	string *rmodule = KStatReader::stringMember(env, spec, "module", "");
+	string *rclass = KStatReader::stringMember(env, spec, "class", "");
+	string *rname = KStatReader::stringMember(env, spec, "name", "");
+	int64_t rinstance = KStatReader::intMember(env, spec, "instance", -1);
+
+	for (i = 0; i < k->ksr_kstats.size(); i++) {
+		if (k->matches(k->ksr_kstats[i], rmodule, rclass, rname,
+		    rinstance))
+			c->kc_kstats.push_back(k->ksr_kstats[i]);
+	}
 
-	va_start(ap, fmt);
-	(void) vsnprintf(buf, sizeof (buf), fmt, ap);
+	delete rmodule;
+	delete rclass;
+	delete rname;
 
-	if (buf[strlen(buf) - 1] != '\n') {
-		/*
-		 * If our error doesn't end in a new-line, we'll append the
-		 * strerror of errno.
-		 */
-		(void) snprintf(err = buf2, sizeof (buf2),
-		    "%s: %s", buf, strerror(errno));
-	} else {
-		buf[strlen(buf) - 1] = '\0';
+	if ((batch = KStatReader::intMember(env, options, "batchSize",
+	    KSR_BATCH_DEFAULT)) > 0)
+		c->kc_batch = batch;
+
+	c->kc_list = KStatReader::boolMember(env, options, "list", false);
+	c->kc_flags = KStatReader::readflags(env, options);
+
+	if (KStatReader::boolMember(env, options, "sort", false)) {
+		std::stable_sort(c->kc_kstats.begin(), c->kc_kstats.end(),
+		    ksr_kstatorder);
 	}
 
-	return (isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, err))));
-}
-
-Local<Object>
-KStatReader::data_raw_cpu_stat(Isolate *isolate, kstat_t *ksp)
-{
-	Local<Object> data = Object::New(isolate);
-
-	assert(ksp->ks_data_size == sizeof (cpu_stat_t));
-
-	cpu_stat_t	  *stat;
-	cpu_sysinfo_t	*sysinfo;
-	cpu_syswait_t	*syswait;
-	cpu_vminfo_t	*vminfo;
-
-	stat    = (cpu_stat_t *)(ksp->ks_data);
-	sysinfo = &stat->cpu_sysinfo;
-	syswait = &stat->cpu_syswait;
-	vminfo  = &stat->cpu_vminfo;
-
-	data->Set(String::NewFromUtf8(isolate, "idle"), Number::New(isolate, sysinfo->cpu[CPU_IDLE]));
-	data->Set(String::NewFromUtf8(isolate, "user"), Number::New(isolate, sysinfo->cpu[CPU_USER]));
-	data->Set(String::NewFromUtf8(isolate, "kernel"), Number::New(isolate, sysinfo->cpu[CPU_KERNEL]));
-	data->Set(String::NewFromUtf8(isolate, "wait"), Number::New(isolate, sysinfo->cpu[CPU_WAIT]));
-	data->Set(String::NewFromUtf8(isolate, "wait_io"), Number::New(isolate, sysinfo->wait[W_IO]));
-	data->Set(String::NewFromUtf8(isolate, "wait_swap"), Number::New(isolate, sysinfo->wait[W_SWAP]));
-	data->Set(String::NewFromUtf8(isolate, "wait_pio"), Number::New(isolate, sysinfo->wait[W_PIO]));
-	data->Set(String::NewFromUtf8(isolate, "bread"), Number::New(isolate, sysinfo->bread));
-	data->Set(String::NewFromUtf8(isolate, "bwrite"), Number::New(isolate, sysinfo->bwrite));
-	data->Set(String::NewFromUtf8(isolate, "lread"), Number::New(isolate, sysinfo->lread));
-	data->Set(String::NewFromUtf8(isolate, "lwrite"), Number::New(isolate, sysinfo->lwrite));
-	data->Set(String::NewFromUtf8(isolate, "phread"), Number::New(isolate, sysinfo->phread));
-	data->Set(String::NewFromUtf8(isolate, "phwrite"), Number::New(isolate, sysinfo->phwrite));
-	data->Set(String::NewFromUtf8(isolate, "pswitch"), Number::New(isolate, sysinfo->pswitch));
-	data->Set(String::NewFromUtf8(isolate, "trap"), Number::New(isolate, sysinfo->trap));
-	data->Set(String::NewFromUtf8(isolate, "intr"), Number::New(isolate, sysinfo->intr));
-	data->Set(String::NewFromUtf8(isolate, "syscall"), Number::New(isolate, sysinfo->syscall));
-	data->Set(String::NewFromUtf8(isolate, "sysread"), Number::New(isolate, sysinfo->sysread));
-	data->Set(String::NewFromUtf8(isolate, "syswrite"), Number::New(isolate, sysinfo->syswrite));
-	data->Set(String::NewFromUtf8(isolate, "sysfork"), Number::New(isolate, sysinfo->sysfork));
-	data->Set(String::NewFromUtf8(isolate, "sysvfork"), Number::New(isolate, sysinfo->sysvfork));
-	data->Set(String::NewFromUtf8(isolate, "sysexec"), Number::New(isolate, sysinfo->sysexec));
-	data->Set(String::NewFromUtf8(isolate, "readch"), Number::New(isolate, sysinfo->readch));
-	data->Set(String::NewFromUtf8(isolate, "writech"), Number::New(isolate, sysinfo->writech));
-	data->Set(String::NewFromUtf8(isolate, "rcvint"), Number::New(isolate, sysinfo->rcvint));
-	data->Set(String::NewFromUtf8(isolate, "xmtint"), Number::New(isolate, sysinfo->xmtint));
-	data->Set(String::NewFromUtf8(isolate, "mdmint"), Number::New(isolate, sysinfo->mdmint));
-	data->Set(String::NewFromUtf8(isolate, "rawch"), Number::New(isolate, sysinfo->rawch));
-	data->Set(String::NewFromUtf8(isolate, "canch"), Number::New(isolate, sysinfo->canch));
-	data->Set(String::NewFromUtf8(isolate, "outch"), Number::New(isolate, sysinfo->outch));
-	data->Set(String::NewFromUtf8(isolate, "msg"), Number::New(isolate, sysinfo->msg));
-	data->Set(String::NewFromUtf8(isolate, "sema"), Number::New(isolate, sysinfo->sema));
-	data->Set(String::NewFromUtf8(isolate, "namei"), Number::New(isolate, sysinfo->namei));
-	data->Set(String::NewFromUtf8(isolate, "ufsiget"), Number::New(isolate, sysinfo->ufsiget));
-	data->Set(String::NewFromUtf8(isolate, "ufsdirblk"), Number::New(isolate, sysinfo->ufsdirblk));
-	data->Set(String::NewFromUtf8(isolate, "ufsipage"), Number::New(isolate, sysinfo->ufsipage));
-	data->Set(String::NewFromUtf8(isolate, "ufsinopage"), Number::New(isolate, sysinfo->ufsinopage));
-	data->Set(String::NewFromUtf8(isolate, "inodeovf"), Number::New(isolate, sysinfo->inodeovf));
-	data->Set(String::NewFromUtf8(isolate, "fileovf"), Number::New(isolate, sysinfo->fileovf));
-	data->Set(String::NewFromUtf8(isolate, "procovf"), Number::New(isolate, sysinfo->procovf));
-	data->Set(String::NewFromUtf8(isolate, "intrthread"), Number::New(isolate, sysinfo->intrthread));
-	data->Set(String::NewFromUtf8(isolate, "intrblk"), Number::New(isolate, sysinfo->intrblk));
-	data->Set(String::NewFromUtf8(isolate, "idlethread"), Number::New(isolate, sysinfo->idlethread));
-	data->Set(String::NewFromUtf8(isolate, "inv_swtch"), Number::New(isolate, sysinfo->inv_swtch));
-	data->Set(String::NewFromUtf8(isolate, "nthreads"), Number::New(isolate, sysinfo->nthreads));
-	data->Set(String::NewFromUtf8(isolate, "cpumigrate"), Number::New(isolate, sysinfo->cpumigrate));
-	data->Set(String::NewFromUtf8(isolate, "xcalls"), Number::New(isolate, sysinfo->xcalls));
-	data->Set(String::NewFromUtf8(isolate, "mutex_adenters"),
-	    Number::New(isolate, sysinfo->mutex_adenters));
-	data->Set(String::NewFromUtf8(isolate, "rw_rdfails"), Number::New(isolate, sysinfo->rw_rdfails));
-	data->Set(String::NewFromUtf8(isolate, "rw_wrfails"), Number::New(isolate, sysinfo->rw_wrfails));
-	data->Set(String::NewFromUtf8(isolate, "modload"), Number::New(isolate, sysinfo->modload));
-	data->Set(String::NewFromUtf8(isolate, "modunload"), Number::New(isolate, sysinfo->modunload));
-	data->Set(String::NewFromUtf8(isolate, "bawrite"), Number::New(isolate, sysinfo->bawrite));
-#ifdef	STATISTICS	/* see header file */
-	data->Set(String::NewFromUtf8(isolate, "rw_enters"), Number::New(isolate, sysinfo->rw_enters));
-	data->Set(String::NewFromUtf8(isolate, "win_uo_cnt"), Number::New(isolate, sysinfo->win_uo_cnt));
-	data->Set(String::NewFromUtf8(isolate, "win_uu_cnt"), Number::New(isolate, sysinfo->win_uu_cnt));
-	data->Set(String::NewFromUtf8(isolate, "win_so_cnt"), Number::New(isolate, sysinfo->win_so_cnt));
-	data->Set(String::NewFromUtf8(isolate, "win_su_cnt"), Number::New(isolate, sysinfo->win_su_cnt));
-	data->Set(String::NewFromUtf8(isolate, "win_suo_cnt"),
-	    Number::New(isolate, sysinfo->win_suo_cnt));
-#endif
-
-	data->Set(String::NewFromUtf8(isolate, "iowait"), Number::New(isolate, syswait->iowait));
-	data->Set(String::NewFromUtf8(isolate, "swap"), Number::New(isolate, syswait->swap));
-	data->Set(String::NewFromUtf8(isolate, "physio"), Number::New(isolate, syswait->physio));
-
-	data->Set(String::NewFromUtf8(isolate, "pgrec"), Number::New(isolate, vminfo->pgrec));
-	data->Set(String::NewFromUtf8(isolate, "pgfrec"), Number::New(isolate, vminfo->pgfrec));
-	data->Set(String::NewFromUtf8(isolate, "pgin"), Number::New(isolate, vminfo->pgin));
-	data->Set(String::NewFromUtf8(isolate, "pgpgin"), Number::New(isolate, vminfo->pgpgin));
-	data->Set(String::NewFromUtf8(isolate, "pgout"), Number::New(isolate, vminfo->pgout));
-	data->Set(String::NewFromUtf8(isolate, "pgpgout"), Number::New(isolate, vminfo->pgpgout));
-	data->Set(String::NewFromUtf8(isolate, "swapin"), Number::New(isolate, vminfo->swapin));
-	data->Set(String::NewFromUtf8(isolate, "pgswapin"), Number::New(isolate, vminfo->pgswapin));
-	data->Set(String::NewFromUtf8(isolate, "swapout"), Number::New(isolate, vminfo->swapout));
-	data->Set(String::NewFromUtf8(isolate, "pgswapout"), Number::New(isolate, vminfo->pgswapout));
-	data->Set(String::NewFromUtf8(isolate, "zfod"), Number::New(isolate, vminfo->zfod));
-	data->Set(String::NewFromUtf8(isolate, "dfree"), Number::New(isolate, vminfo->dfree));
-	data->Set(String::NewFromUtf8(isolate, "scan"), Number::New(isolate, vminfo->scan));
-	data->Set(String::NewFromUtf8(isolate, "rev"), Number::New(isolate, vminfo->rev));
-	data->Set(String::NewFromUtf8(isolate, "hat_fault"), Number::New(isolate, vminfo->hat_fault));
-	data->Set(String::NewFromUtf8(isolate, "as_fault"), Number::New(isolate, vminfo->as_fault));
-	data->Set(String::NewFromUtf8(isolate, "maj_fault"), Number::New(isolate, vminfo->maj_fault));
-	data->Set(String::NewFromUtf8(isolate, "cow_fault"), Number::New(isolate, vminfo->cow_fault));
-	data->Set(String::NewFromUtf8(isolate, "prot_fault"), Number::New(isolate, vminfo->prot_fault));
-	data->Set(String::NewFromUtf8(isolate, "softlock"), Number::New(isolate, vminfo->softlock));
-	data->Set(String::NewFromUtf8(isolate, "kernel_asflt"),
-	    Number::New(isolate, vminfo->kernel_asflt));
-	data->Set(String::NewFromUtf8(isolate, "pgrrun"), Number::New(isolate, vminfo->pgrrun));
-	data->Set(String::NewFromUtf8(isolate, "execpgin"), Number::New(isolate, vminfo->execpgin));
-	data->Set(String::NewFromUtf8(isolate, "execpgout"), Number::New(isolate, vminfo->execpgout));
-	data->Set(String::NewFromUtf8(isolate, "execfree"), Number::New(isolate, vminfo->execfree));
-	data->Set(String::NewFromUtf8(isolate, "anonpgin"), Number::New(isolate, vminfo->anonpgin));
-	data->Set(String::NewFromUtf8(isolate, "anonpgout"), Number::New(isolate, vminfo->anonpgout));
-	data->Set(String::NewFromUtf8(isolate, "anonfree"), Number::New(isolate, vminfo->anonfree));
-	data->Set(String::NewFromUtf8(isolate, "fspgin"), Number::New(isolate, vminfo->fspgin));
-	data->Set(String::NewFromUtf8(isolate, "fspgout"), Number::New(isolate, vminfo->fspgout));
-	data->Set(String::NewFromUtf8(isolate, "fsfree"), Number::New(isolate, vminfo->fsfree));
+	for (i = 0; i < c->kc_kstats.size(); i++)
+		c->kc_ids.push_back(c->kc_kstats[i]->ks_kid);
 
-	return (data);
+	if (napi_wrap(env, obj, c, finalize, NULL, NULL) != napi_ok) {
+		delete c;
+		return (NULL);
+	}
+
+	return (obj);
 }
 
-Local<Object>
-KStatReader::data_raw_var(Isolate *isolate, kstat_t *ksp)
+/*
+ * If the chain has changed since we last looked, our kstat pointers may no
+ * longer be valid; find each kstat again by its ID.
+ */
+void
+KStatCursor::resolve()
 {
-	Local<Object> data = Object::New(isolate);
+	kstat_ctl_t *kc = kc_reader->ksr_ctl;
+	map<kid_t, kstat_t *> chain;
+	map<kid_t, kstat_t *>::iterator it;
+	vector<kstat_t *> kstats;
+	vector<kid_t> ids;
+	kstat_t *ksp;
+	size_t i;
 
-	assert(ksp->ks_data_size == sizeof (struct var));
+	if (kc_chain == kc->kc_chain_id && kc_reopens == kc_reader->ksr_reopens)
+		return;
 
-	struct var	*var = (struct var *)(ksp->ks_data);
+	for (ksp = kc->kc_chain; ksp != NULL; ksp = ksp->ks_next)
+		chain[ksp->ks_kid] = ksp;
 
-	data->Set(String::NewFromUtf8(isolate, "v_buf"), Number::New(isolate, var->v_buf));
-	data->Set(String::NewFromUtf8(isolate, "v_call"), Number::New(isolate, var->v_call));
-	data->Set(String::NewFromUtf8(isolate, "v_proc"), Number::New(isolate, var->v_proc));
-	data->Set(String::NewFromUtf8(isolate, "v_maxupttl"), Number::New(isolate, var->v_maxupttl));
-	data->Set(String::NewFromUtf8(isolate, "v_nglobpris"), Number::New(isolate, var->v_nglobpris));
-	data->Set(String::NewFromUtf8(isolate, "v_maxsyspri"), Number::New(isolate, var->v_maxsyspri));
-	data->Set(String::NewFromUtf8(isolate, "v_clist"), Number::New(isolate, var->v_clist));
-	data->Set(String::NewFromUtf8(isolate, "v_maxup"), Number::New(isolate, var->v_maxup));
-	data->Set(String::NewFromUtf8(isolate, "v_hbuf"), Number::New(isolate, var->v_hbuf));
-	data->Set(String::NewFromUtf8(isolate, "v_hmask"), Number::New(isolate, var->v_hmask));
-	data->Set(String::NewFromUtf8(isolate, "v_pbuf"), Number::New(isolate, var->v_pbuf));
-	data->Set(String::NewFromUtf8(isolate, "v_sptmap"), Number::New(isolate, var->v_sptmap));
-	data->Set(String::NewFromUtf8(isolate, "v_maxpmem"), Number::New(isolate, var->v_maxpmem));
-	data->Set(String::NewFromUtf8(isolate, "v_autoup"), Number::New(isolate, var->v_autoup));
-	data->Set(String::NewFromUtf8(isolate, "v_bufhwm"), Number::New(isolate, var->v_bufhwm));
+	for (i = kc_next; i < kc_kstats.size(); i++) {
+		if ((it = chain.find(kc_ids[i])) != chain.end()) {
+			kstats.push_back(it->second);
+			ids.push_back(it->first);
+		}
+	}
 
-	return (data);
+	kc_kstats.swap(kstats);
+	kc_ids.swap(ids);
+	kc_next = 0;
+	kc_chain = kc->kc_chain_id;
+	kc_reopens = kc_reader->ksr_reopens;
 }
 
-Local<Object>
-KStatReader::data_raw_ncstats(Isolate *isolate, kstat_t *ksp)
+napi_value
+KStatCursor::Next(napi_env env, napi_callback_info info)
 {
-	Local<Object> data = Object::New(isolate);
+	KStatCursor *c = ksr_unwrap<KStatCursor>(env, info, NULL, 0);
+	KStatReader *k;
+	napi_value rval;
+	size_t i, n;
 
-	assert(ksp->ks_data_size == sizeof (struct ncstats));
+	if (c == NULL)
+		return (NULL);
 
-	struct ncstats	*ncstats = (struct ncstats *)(ksp->ks_data);
+	if ((k = c->kc_reader)->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
 
-	data->Set(String::NewFromUtf8(isolate, "hits"), Number::New(isolate, ncstats->hits));
-	data->Set(String::NewFromUtf8(isolate, "misses"), Number::New(isolate, ncstats->misses));
-	data->Set(String::NewFromUtf8(isolate, "enters"), Number::New(isolate, ncstats->enters));
-	data->Set(String::NewFromUtf8(isolate, "dbl_enters"), Number::New(isolate, ncstats->dbl_enters));
-	data->Set(String::NewFromUtf8(isolate, "long_enter"), Number::New(isolate, ncstats->long_enter));
-	data->Set(String::NewFromUtf8(isolate, "long_look"), Number::New(isolate, ncstats->long_look));
-	data->Set(String::NewFromUtf8(isolate, "move_to_front"),
-	    Number::New(isolate, ncstats->move_to_front));
-	data->Set(String::NewFromUtf8(isolate, "purges"), Number::New(isolate, ncstats->purges));
+	c->resolve();
 
-	return (data);
-}
+	if (c->kc_next >= c->kc_kstats.size())
+		return (ksr_null(env));
 
-Local<Object>
-KStatReader::data_raw_sysinfo(Isolate *isolate, kstat_t *ksp)
-{
-	Local<Object> data = Object::New(isolate);
+	n = std::min(c->kc_batch, c->kc_kstats.size() - c->kc_next);
+	rval = ksr_array(env, n);
 
-	assert(ksp->ks_data_size == sizeof (sysinfo_t));
+	try {
+		for (i = 0; i < n; i++) {
+			kstat_t *ksp = c->kc_kstats[c->kc_next++];
 
-	sysinfo_t	*sysinfo = (sysinfo_t *)(ksp->ks_data);
+			ksr_setelem(env, rval, i, c->kc_list ?
+			    k->list(env, ksp) : k->read(env, ksp, c->kc_flags));
+		}
+	} catch (ksr_pending_t) {
+		return (NULL);
+	}
 
-	data->Set(String::NewFromUtf8(isolate, "updates"), Number::New(isolate, sysinfo->updates));
-	data->Set(String::NewFromUtf8(isolate, "runque"), Number::New(isolate, sysinfo->runque));
-	data->Set(String::NewFromUtf8(isolate, "runocc"), Number::New(isolate, sysinfo->runocc));
-	data->Set(String::NewFromUtf8(isolate, "swpque"), Number::New(isolate, sysinfo->swpque));
-	data->Set(String::NewFromUtf8(isolate, "swpocc"), Number::New(isolate, sysinfo->swpocc));
-	data->Set(String::NewFromUtf8(isolate, "waiting"), Number::New(isolate, sysinfo->waiting));
+	k->account(env);
 
-	return (data);
+	return (rval);
 }
 
-Local<Object>
-KStatReader::data_raw_vminfo(Isolate *isolate, kstat_t *ksp)
+napi_value
+KStatReader::Publish(napi_env env, napi_callback_info info)
 {
-	Local<Object> data = Object::New(isolate);
+	napi_value args[2];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	vector<kstat_t *> kstats;
+	string name;
+	int count;
+	size_t i;
 
-	assert(ksp->ks_data_size == sizeof (vminfo_t));
+	if (k == NULL)
+		return (NULL);
 
-	vminfo_t	*vminfo = (vminfo_t *)(ksp->ks_data);
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
 
-	data->Set(String::NewFromUtf8(isolate, "freemem"), Number::New(isolate, vminfo->freemem));
-	data->Set(String::NewFromUtf8(isolate, "swap_resv"), Number::New(isolate, vminfo->swap_resv));
-	data->Set(String::NewFromUtf8(isolate, "swap_alloc"), Number::New(isolate, vminfo->swap_alloc));
-	data->Set(String::NewFromUtf8(isolate, "swap_avail"), Number::New(isolate, vminfo->swap_avail));
-	data->Set(String::NewFromUtf8(isolate, "swap_free"), Number::New(isolate, vminfo->swap_free));
-	data->Set(String::NewFromUtf8(isolate, "updates"), Number::New(isolate, vminfo->updates));
+	if (ksr_type(env, args[0]) != napi_string) {
+		return (k->error(env,
+		    "publish() requires the name of a shared memory segment\n"));
+	}
 
-	return (data);
-}
+	name = ksr_utf8(env, args[0]);
 
-Local<Object>
-KStatReader::data_raw_mntinfo(Isolate *isolate, kstat_t *ksp)
-{
-	Local<Object> data = Object::New(isolate);
-
-	assert(ksp->ks_data_size == sizeof (struct mntinfo_kstat));
-
-	struct mntinfo_kstat *mntinfo = (struct mntinfo_kstat *)(ksp->ks_data);
-
-	data->Set(String::NewFromUtf8(isolate, "mntinfo"),
-	    String::NewFromUtf8(isolate, mntinfo->mik_proto));
-	data->Set(String::NewFromUtf8(isolate, "mik_vers"),
-	    Number::New(isolate, mntinfo->mik_vers));
-	data->Set(String::NewFromUtf8(isolate, "mik_flags"),
-	    Number::New(isolate, mntinfo->mik_flags));
-	data->Set(String::NewFromUtf8(isolate, "mik_secmod"),
-	    Number::New(isolate, mntinfo->mik_secmod));
-	data->Set(String::NewFromUtf8(isolate, "mik_curread"),
-	    Number::New(isolate, mntinfo->mik_curread));
-	data->Set(String::NewFromUtf8(isolate, "mik_curwrite"),
-	    Number::New(isolate, mntinfo->mik_curwrite));
-	data->Set(String::NewFromUtf8(isolate, "mik_timeo"),
-	    Number::New(isolate, mntinfo->mik_timeo));
-	data->Set(String::NewFromUtf8(isolate, "mik_retrans"),
-	    Number::New(isolate, mntinfo->mik_retrans));
-	data->Set(String::NewFromUtf8(isolate, "mik_acregmin"),
-	    Number::New(isolate, mntinfo->mik_acregmin));
-	data->Set(String::NewFromUtf8(isolate, "mik_acregmax"),
-	    Number::New(isolate, mntinfo->mik_acregmax));
-	data->Set(String::NewFromUtf8(isolate, "mik_acdirmin"),
-	    Number::New(isolate, mntinfo->mik_acdirmin));
-	data->Set(String::NewFromUtf8(isolate, "mik_acdirmax"),
-	    Number::New(isolate, mntinfo->mik_acdirmax));
-	data->Set(String::NewFromUtf8(isolate, "lookup_srtt"),
-	    Number::New(isolate, mntinfo->mik_timers[0].srtt));
-	data->Set(String::NewFromUtf8(isolate, "lookup_deviate"),
-	    Number::New(isolate, mntinfo->mik_timers[0].deviate));
-	data->Set(String::NewFromUtf8(isolate, "lookup_rtxcur"),
-	    Number::New(isolate, mntinfo->mik_timers[0].rtxcur));
-	data->Set(String::NewFromUtf8(isolate, "read_srtt"),
-	    Number::New(isolate, mntinfo->mik_timers[1].srtt));
-	data->Set(String::NewFromUtf8(isolate, "read_deviate"),
-	    Number::New(isolate, mntinfo->mik_timers[1].deviate));
-	data->Set(String::NewFromUtf8(isolate, "read_rtxcur"),
-	    Number::New(isolate, mntinfo->mik_timers[1].rtxcur));
-	data->Set(String::NewFromUtf8(isolate, "write_srtt"),
-	    Number::New(isolate, mntinfo->mik_timers[2].srtt));
-	data->Set(String::NewFromUtf8(isolate, "write_deviate"),
-	    Number::New(isolate, mntinfo->mik_timers[2].deviate));
-	data->Set(String::NewFromUtf8(isolate, "write_rtxcur"),
-	    Number::New(isolate, mntinfo->mik_timers[2].rtxcur));
-	data->Set(String::NewFromUtf8(isolate, "mik_noresponse"),
-	    Number::New(isolate, mntinfo->mik_noresponse));
-	data->Set(String::NewFromUtf8(isolate, "mik_failover"),
-	    Number::New(isolate, mntinfo->mik_failover));
-	data->Set(String::NewFromUtf8(isolate, "mik_remap"),
-	    Number::New(isolate, mntinfo->mik_remap));
-	data->Set(String::NewFromUtf8(isolate, "mntinfo"),
-	    String::NewFromUtf8(isolate, mntinfo->mik_curserver));
+	if (!k->ksr_shmname.empty() && k->ksr_shmname != name) {
+		return (k->error(env, "reader is already publishing to \"%s\"\n",
+		    k->ksr_shmname.c_str()));
+	}
 
-	return (data);
+	if (k->update() == -1)
+		return (k->error(env, "failed to update kstat chain"));
+
+	string *rmodule = stringMember(env, args[1], "module", "");
+	string *rclass = stringMember(env, args[1], "class", "");
+	string *rname = stringMember(env, args[1], "name", "");
+	int64_t rinstance = intMember(env, args[1], "instance", -1);
+
+	for (i = 0; i < k->ksr_kstats.size(); i++) {
+		if (k->matches(k->ksr_kstats[i], rmodule, rclass, rname,
+		    rinstance) && !k->backingoff(k->ksr_kstats[i]))
+			kstats.push_back(k->ksr_kstats[i]);
+	}
+
+	delete rmodule;
+	delete rclass;
+	delete rname;
+
+	if ((count = k->publish(name.c_str(), kstats)) == -1)
+		return (k->error(env, "failed to publish to \"%s\"", name.c_str()));
+
+	k->account(env);
+
+	return (ksr_number(env, count));
 }
 
-Local<Object>
-KStatReader::data_raw(Isolate *isolate, kstat_t *ksp)
+napi_value
+KStatReader::Sample(napi_env env, napi_callback_info info)
 {
-	Local<Object> data;
+	napi_value args[2], buffer;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	napi_typedarray_type type;
+	vector<kstat_t *> kstats;
+	size_t length, offset, needed;
+	bool istyped = false;
+	void *values;
+	size_t i;
+
+	if (k == NULL)
+		return (NULL);
+
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
 
-	assert(ksp->ks_type == KSTAT_TYPE_RAW);
+	if (args[0] != NULL)
+		(void) napi_is_typedarray(env, args[0], &istyped);
 
-	if (strcmp(ksp->ks_module, "cpu_stat") == 0) {
-		data = data_raw_cpu_stat(isolate, ksp);
-	} else if (strcmp(ksp->ks_name, "var") == 0) {
-		data = data_raw_var(isolate, ksp);
-	} else if (strcmp(ksp->ks_name, "ncstats") == 0) {
-		data = data_raw_ncstats(isolate, ksp);
-	} else if (strcmp(ksp->ks_name, "sysinfo") == 0) {
-		data = data_raw_sysinfo(isolate, ksp);
-	} else if (strcmp(ksp->ks_name, "vminfo") == 0) {
-		data = data_raw_vminfo(isolate, ksp);
-	} else if (strcmp(ksp->ks_name, "mntinfo") == 0) {
-		data = data_raw_mntinfo(isolate, ksp);
-	} else {
-		data = Object::New(isolate);
+	if (!istyped || napi_get_typedarray_info(env, args[0], &type, &length,
+	    &values, &buffer, &offset) != napi_ok ||
+	    type != napi_float64_array) {
+		return (k->error(env, "sample() requires a Float64Array\n"));
 	}
 
-	return (data);
-}
+	if (k->update() == -1)
+		return (k->error(env, "failed to update kstat chain"));
 
-Local<Object>
-KStatReader::data_named(Isolate *isolate, kstat_t *ksp)
-{
-	Local<Object> data = Object::New(isolate);
-	kstat_named_t *nm = KSTAT_NAMED_PTR(ksp);
-	unsigned int i;
+	string *rmodule = stringMember(env, args[1], "module", "");
+	string *rclass = stringMember(env, args[1], "class", "");
+	string *rname = stringMember(env, args[1], "name", "");
+	int64_t rinstance = intMember(env, args[1], "instance", -1);
+
+	for (i = 0; i < k->ksr_kstats.size(); i++) {
+		if (k->matches(k->ksr_kstats[i], rmodule, rclass, rname,
+		    rinstance))
+			kstats.push_back(k->ksr_kstats[i]);
+	}
 
-	assert(ksp->ks_type == KSTAT_TYPE_NAMED);
+	delete rmodule;
+	delete rclass;
+	delete rname;
 
-	for (i = 0; i < ksp->ks_ndata; i++, nm++) {
-		Local<Value> val;
+	/*
+	 * Accounting may evict, reopening the chain under the kstats that we
+	 * have just read, so it must wait until we have written the sample.
+	 */
+	if ((needed = k->sampleread(kstats, length)) > length) {
+		k->account(env);
+		return (k->error(env, "sample() requires a Float64Array of at "
+		    "least %u elements\n", (unsigned int)needed));
+	}
 
-		switch (nm->data_type) {
-		case KSTAT_DATA_CHAR:
-			val = Number::New(isolate, nm->value.c[0]);
-			break;
+	k->samplewrite((double *)values);
+	k->account(env);
 
-		case KSTAT_DATA_INT32:
-			val = Number::New(isolate, nm->value.i32);
-			break;
+	return (ksr_number(env, k->ksr_generation));
+}
 
-		case KSTAT_DATA_UINT32:
-			val = Number::New(isolate, nm->value.ui32);
-			break;
+/*
+ * Describe where the last sample put each kstat and field.
+ */
+napi_value
+KStatReader::Layout(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+	napi_value rval, slots;
+	size_t i, f;
 
-		case KSTAT_DATA_INT64:
-			val = Number::New(isolate, nm->value.i64);
-			break;
+	if (k == NULL)
+		return (NULL);
 
-		case KSTAT_DATA_UINT64:
-			val = Number::New(isolate, nm->value.ui64);
-			break;
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
 
-		case KSTAT_DATA_STRING:
-			val = String::NewFromUtf8(isolate, KSTAT_NAMED_STR_PTR(nm));
-			break;
+	rval = ksr_object(env);
+	slots = ksr_array(env, k->ksr_slots.size());
+
+	for (i = 0; i < k->ksr_slots.size(); i++) {
+		ksr_sampleslot_t *ksl = &k->ksr_slots[i];
+		napi_value slot = ksr_object(env);
+		napi_value fields = ksr_array(env, ksl->ksl_fields.size());
 
-		default:
-			throw (error(isolate, "unrecognized data type %d for member "
-			    "\"%s\" in instance %d of stat \"%s\" (module "
-			    "\"%s\", class \"%s\")\n", nm->data_type,
-			    nm->name, ksp->ks_instance, ksp->ks_name,
-			    ksp->ks_module, ksp->ks_class));
+		for (f = 0; f < ksl->ksl_fields.size(); f++) {
+			ksr_setelem(env, fields, f,
+			    ksr_string(env, ksl->ksl_fields[f].c_str()));
 		}
 
-		data->Set(String::NewFromUtf8(isolate, nm->name), val);
+		ksr_set(env, slot, "class", ksr_string(env, ksl->ksl_class.c_str()));
+		ksr_set(env, slot, "module", ksr_string(env, ksl->ksl_module.c_str()));
+		ksr_set(env, slot, "name", ksr_string(env, ksl->ksl_name.c_str()));
+		ksr_set(env, slot, "instance", ksr_number(env, ksl->ksl_instance));
+		ksr_set(env, slot, "offset", ksr_number(env, ksl->ksl_offset));
+		ksr_set(env, slot, "fields", fields);
+		ksr_setelem(env, slots, i, slot);
 	}
 
-	return (data);
+	ksr_set(env, rval, "generation", ksr_number(env, k->ksr_generation));
+	ksr_set(env, rval, "length", ksr_number(env, k->ksr_samplevalues));
+	ksr_set(env, rval, "slots", slots);
+
+	return (rval);
 }
 
-Local<Object>
-KStatReader::data_intr(Isolate *isolate, kstat_t *ksp)
+/*
+ * Read the kstats that match a specification into a table for each kstat name,
+ * and return an object that maps each name to an Arrow IPC stream holding its
+ * table -- in a Buffer, or written to a file in the given directory.
+ */
+napi_value
+KStatReader::Arrow(napi_env env, napi_callback_info info)
 {
-	Local<Object> data = Object::New(isolate);
-	kstat_intr_t *intr = KSTAT_INTR_PTR(ksp);
+	napi_value args[2], rval, buf;
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 2);
+	map<string, ksr_arrowbatch> batches;
+	map<string, ksr_arrowbatch>::iterator it;
+	ksr_arrowbatch *batch;
+	kstat_named_t *nm;
+	string *dir;
+	size_t i;
+
+	if (k == NULL)
+		return (NULL);
 
-	assert(ksp->ks_type == KSTAT_TYPE_INTR);
+	if (k->ksr_ctl == NULL)
+		return (k->error(env, "kstat reader has already been closed\n"));
 
-	data->Set(String::NewFromUtf8(isolate, "KSTAT_INTR_HARD"),
-	    Number::New(isolate, intr->intrs[KSTAT_INTR_HARD]));
-	data->Set(String::NewFromUtf8(isolate, "KSTAT_INTR_SOFT"),
-	    Number::New(isolate, intr->intrs[KSTAT_INTR_SOFT]));
-	data->Set(String::NewFromUtf8(isolate, "KSTAT_INTR_WATCHDOG"),
-	    Number::New(isolate, intr->intrs[KSTAT_INTR_WATCHDOG]));
-	data->Set(String::NewFromUtf8(isolate, "KSTAT_INTR_SPURIOUS"),
-	    Number::New(isolate, intr->intrs[KSTAT_INTR_SPURIOUS]));
-	data->Set(String::NewFromUtf8(isolate, "KSTAT_INTR_MULTSVC"),
-	    Number::New(isolate, intr->intrs[KSTAT_INTR_MULTSVC]));
+	if (k->update() == -1)
+		return (k->error(env, "failed to update kstat chain"));
 
-	return (data);
-}
+	string *rmodule = stringMember(env, args[0], "module", "");
+	string *rclass = stringMember(env, args[0], "class", "");
+	string *rname = stringMember(env, args[0], "name", "");
+	int64_t rinstance = intMember(env, args[0], "instance", -1);
 
-Local<Object>
-KStatReader::data_io(Isolate *isolate, kstat_t *ksp)
-{
-	Local<Object> data = Object::New(isolate);
-	kstat_io_t *io = KSTAT_IO_PTR(ksp);
+	for (i = 0; i < k->ksr_kstats.size(); i++) {
+		kstat_t *ksp = k->ksr_kstats[i];
 
-	assert(ksp->ks_type == KSTAT_TYPE_IO);
+		if (!k->matches(ksp, rmodule, rclass, rname, rinstance) ||
+		    k->backingoff(ksp) || k->kread(ksp) == -1)
+			continue;
 
-	data->Set(String::NewFromUtf8(isolate, "nread"), Number::New(isolate, io->nread));
-	data->Set(String::NewFromUtf8(isolate, "nwritten"), Number::New(isolate, io->nwritten));
-	data->Set(String::NewFromUtf8(isolate, "reads"), Integer::New(isolate, io->reads));
-	data->Set(String::NewFromUtf8(isolate, "writes"), Integer::New(isolate, io->writes));
+		batch = &batches[ksp->ks_name];
 
-	data->Set(String::NewFromUtf8(isolate, "wtime"), Number::New(isolate, io->wtime));
-	data->Set(String::NewFromUtf8(isolate, "wlentime"), Number::New(isolate, io->wlentime));
-	data->Set(String::NewFromUtf8(isolate, "wlastupdate"), Number::New(isolate, io->wlastupdate));
+		if (batch->add(ksp, &nm) == 0)
+			continue;
 
-	data->Set(String::NewFromUtf8(isolate, "rtime"), Number::New(isolate, io->rtime));
-	data->Set(String::NewFromUtf8(isolate, "rlentime"), Number::New(isolate, io->rlentime));
-	data->Set(String::NewFromUtf8(isolate, "rlastupdate"), Number::New(isolate, io->rlastupdate));
+		/*
+		 * A kstat we can't decode adds no row, so don't leave behind
+		 * an empty table for it.  As with read(), a named statistic
+		 * of a type we don't know is an error; other kstats that we
+		 * can't decode are skipped.
+		 */
+		if (batch->rows() == 0)
+			batches.erase(ksp->ks_name);
 
-	data->Set(String::NewFromUtf8(isolate, "wcnt"), Integer::New(isolate, io->wcnt));
-	data->Set(String::NewFromUtf8(isolate, "rcnt"), Integer::New(isolate, io->rcnt));
+		if (nm == NULL)
+			continue;
 
-	return (data);
-}
+		delete rmodule;
+		delete rclass;
+		delete rname;
 
-Local<Object>
-KStatReader::data_timer(Isolate *isolate, kstat_t *ksp)
-{
-	Local<Object> data = Object::New(isolate);
-	kstat_timer_t *timer = KSTAT_TIMER_PTR(ksp);
+		return (k->error(env, "unrecognized data type %d for member "
+		    "\"%s\" in instance %d of stat \"%s\" (module "
+		    "\"%s\", class \"%s\")\n", nm->data_type,
+		    nm->name, ksp->ks_instance, ksp->ks_name,
+		    ksp->ks_module, ksp->ks_class));
+	}
 
-	assert(ksp->ks_type == KSTAT_TYPE_TIMER);
+	delete rmodule;
+	delete rclass;
+	delete rname;
 
-	data->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, timer->name));
-	data->Set(String::NewFromUtf8(isolate, "num_events"), Number::New(isolate, timer->num_events));
-	data->Set(String::NewFromUtf8(isolate, "elapsed_time"),
-	    Number::New(isolate, timer->elapsed_time));
-	data->Set(String::NewFromUtf8(isolate, "min_time"), Number::New(isolate, timer->min_time));
-	data->Set(String::NewFromUtf8(isolate, "max_time"), Number::New(isolate, timer->max_time));
-	data->Set(String::NewFromUtf8(isolate, "start_time"), Number::New(isolate, timer->start_time));
-	data->Set(String::NewFromUtf8(isolate, "stop_time"), Number::New(isolate, timer->stop_time));
+	dir = stringMember(env, args[1], "directory", "");
+	rval = ksr_object(env);
 
-	return (data);
-}
+	for (it = batches.begin(); it != batches.end(); it++) {
+		vector<char> stream;
 
-Local<Value>
-KStatReader::read(Isolate *isolate, kstat_t *ksp)
-{
-	Local<Object> rval = Object::New(isolate);
-	Local<Object> data;
+		it->second.write(&stream);
 
-	rval->Set(String::NewFromUtf8(isolate, "class"), String::NewFromUtf8(isolate, ksp->ks_class));
-	rval->Set(String::NewFromUtf8(isolate, "module"), String::NewFromUtf8(isolate, ksp->ks_module));
-	rval->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, ksp->ks_name));
-	rval->Set(String::NewFromUtf8(isolate, "instance"), Integer::New(isolate, ksp->ks_instance));
-	rval->Set(String::NewFromUtf8(isolate, "type"), Integer::New(isolate, ksp->ks_type));
+		if (dir->empty()) {
+			if (napi_create_buffer_copy(env, stream.size(),
+			    stream.data(), NULL, &buf) != napi_ok)
+				break;
+
+			ksr_set(env, rval, it->first.c_str(), buf);
+			continue;
+		}
 
-	if (kstat_read(ksr_ctl, ksp, NULL) == -1) {
 		/*
-		 * It is deeply annoying, but some kstats can return errors
-		 * under otherwise routine conditions.  (ACPI is one
-		 * offender; there are surely others.)  To prevent these
-		 * fouled kstats from completely ruining our day, we assign
-		 * an "error" member to the return value that consists of
-		 * the strerror().
+		 * Kstat names may contain slashes; they can't in a file name.
 		 */
-		rval->Set(String::NewFromUtf8(isolate, "error"), String::NewFromUtf8(isolate, strerror(errno)));
-		return (rval);
-	}
-
-	rval->Set(String::NewFromUtf8(isolate, "instance"), Integer::New(isolate, ksp->ks_instance));
-	rval->Set(String::NewFromUtf8(isolate, "snaptime"), Number::New(isolate, ksp->ks_snaptime));
-	rval->Set(String::NewFromUtf8(isolate, "crtime"), Number::New(isolate, ksp->ks_crtime));
-
-	switch (ksp->ks_type) {
-		case KSTAT_TYPE_RAW:
-			data = data_raw(isolate, ksp);
+		string path = it->first;
+		ssize_t len = 0;
+		size_t off;
+		int fd, err;
+
+		std::replace(path.begin(), path.end(), '/', '_');
+		path = *dir + "/" + path + ".arrows";
+
+		if ((fd = open(path.c_str(),
+		    O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+			k->error(env, "could not open %s", path.c_str());
+			rval = NULL;
 			break;
+		}
 
-		case KSTAT_TYPE_NAMED:
-			data = data_named(isolate, ksp);
-			break;
+		for (off = 0; off < stream.size(); off += len) {
+			if ((len = write(fd, stream.data() + off,
+			    stream.size() - off)) == -1)
+				break;
+		}
 
-		case KSTAT_TYPE_INTR:
-			data = data_intr(isolate, ksp);
-			break;
+		err = len == -1 ? errno : 0;
 
-		case KSTAT_TYPE_IO:
-			data = data_io(isolate, ksp);
-			break;
+		if (::close(fd) == -1 && err == 0)
+			err = errno;
 
-		case KSTAT_TYPE_TIMER:
-			data = data_timer(isolate, ksp);
+		if (err != 0) {
+			errno = err;
+			k->error(env, "could not write %s", path.c_str());
+			rval = NULL;
 			break;
+		}
 
-		default:
-			return (rval);
+		ksr_set(env, rval, it->first.c_str(),
+		    ksr_string(env, path.c_str()));
 	}
 
-	rval->Set(String::NewFromUtf8(isolate, "data"), data);
+	delete dir;
+	k->account(env);
 
 	return (rval);
 }
 
-
-Local<Value>
-KStatReader::list(Isolate *isolate, kstat_t *ksp)
+napi_value
+KStatReader::Stats(napi_env env, napi_callback_info info)
 {
-	Local<Object> rval = Object::New(isolate);
-	Local<Object> data;
+	napi_value args[1];
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, args, 1);
+	map<string, ksr_modstats_t>::iterator it;
+	napi_value rval, modules;
+	ksr_counters_t *kct;
+	unsigned int i = 0;
+	int phase, b;
+
+	if (k == NULL)
+		return (NULL);
+
+	rval = ksr_object(env);
+	modules = ksr_array(env, k->ksr_modstats.size());
+	kct = &k->ksr_counters;
+
+	ksr_set(env, rval, "reads", ksr_number(env, kct->kct_reads));
+	ksr_set(env, rval, "coalesced", ksr_number(env, kct->kct_coalesced));
+	ksr_set(env, rval, "errors", ksr_number(env, kct->kct_errors));
+	ksr_set(env, rval, "chainupdates", ksr_number(env, kct->kct_updates));
+	ksr_set(env, rval, "chainchanges", ksr_number(env, kct->kct_changes));
+	ksr_set(env, rval, "chainskips", ksr_number(env, kct->kct_skipped));
+	ksr_set(env, rval, "lookups", ksr_number(env, kct->kct_lookups));
+
+	for (it = k->ksr_modstats.begin(); it != k->ksr_modstats.end(); it++) {
+		ksr_modstats_t *kms = &it->second;
+		napi_value m = ksr_object(env);
+
+		ksr_set(env, m, "module", ksr_string(env, kms->kms_module.c_str()));
+		ksr_set(env, m, "class", ksr_string(env, kms->kms_class.c_str()));
+		ksr_set(env, m, "errors", ksr_number(env, kms->kms_errors));
+
+		for (phase = 0; phase < KSP_NPHASES; phase++) {
+			ksr_hist_t *hist = &kms->kms_hist[phase];
+			napi_value h = ksr_object(env);
+			napi_value buckets = ksr_array(env);
+			unsigned int j = 0;
+
+			/*
+			 * Only the buckets that have counts are returned, each
+			 * as an array of its upper bound and its count.
+			 */
+			for (b = 0; b < KSR_HIST_BUCKETS; b++) {
+				napi_value bucket;
+
+				if (hist->kh_buckets[b] == 0)
+					continue;
+
+				bucket = ksr_array(env, 2);
+				ksr_setelem(env, bucket, 0,
+				    b == KSR_HIST_BUCKETS - 1 ? ksr_null(env) :
+				    ksr_number(env, 1LL << b));
+				ksr_setelem(env, bucket, 1,
+				    ksr_number(env, hist->kh_buckets[b]));
+				ksr_setelem(env, buckets, j++, bucket);
+			}
+
+			ksr_set(env, h, "count", ksr_number(env, hist->kh_count));
+			ksr_set(env, h, "total", ksr_number(env, hist->kh_total));
+			ksr_set(env, h, "max", ksr_number(env, hist->kh_max));
+			ksr_set(env, h, "buckets", buckets);
+			ksr_set(env, m, ksr_phases[phase], h);
+		}
+
+		ksr_setelem(env, modules, i++, m);
+	}
 
-	rval->Set(String::NewFromUtf8(isolate, "class"), String::NewFromUtf8(isolate, ksp->ks_class));
-	rval->Set(String::NewFromUtf8(isolate, "module"), String::NewFromUtf8(isolate, ksp->ks_module));
-	rval->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, ksp->ks_name));
-	rval->Set(String::NewFromUtf8(isolate, "instance"), Integer::New(isolate, ksp->ks_instance));
-	rval->Set(String::NewFromUtf8(isolate, "type"), Integer::New(isolate, ksp->ks_type));
-	rval->Set(String::NewFromUtf8(isolate, "snaptime"), Number::New(isolate, ksp->ks_snaptime));
-	rval->Set(String::NewFromUtf8(isolate, "crtime"), Number::New(isolate, ksp->ks_crtime));
+	if (k->ksr_instrument)
+		ksr_set(env, rval, "modules", modules);
+
+	if (boolMember(env, args[0], "reset", false)) {
+		k->ksr_modstats.clear();
+		(void) memset(kct, 0, sizeof (*kct));
+	}
+
+	return (rval);
+}
+
+napi_value
+KStatReader::MemoryUsage(napi_env env, napi_callback_info info)
+{
+	KStatReader *k = ksr_unwrap<KStatReader>(env, info, NULL, 0);
+	napi_value rval;
+	ksr_memory_t km;
+	size_t coalesced;
+
+	if (k == NULL)
+		return (NULL);
+
+	k->memory(&km);
+
+	uv_mutex_lock(&ksr_coalesce_lock);
+	coalesced = ksr_coalesce_mem;
+	uv_mutex_unlock(&ksr_coalesce_lock);
+
+	rval = ksr_object(env);
+	ksr_set(env, rval, "chain", ksr_number(env, km.km_chain));
+	ksr_set(env, rval, "data", ksr_number(env, km.km_data));
+	ksr_set(env, rval, "snapshots", ksr_number(env, km.km_snapshots));
+	ksr_set(env, rval, "caches", ksr_number(env, km.km_caches));
+	ksr_set(env, rval, "publish", ksr_number(env, km.km_publish));
+	ksr_set(env, rval, "total", ksr_number(env, km.km_chain +
+	    km.km_data + km.km_snapshots + km.km_caches + km.km_publish));
+	ksr_set(env, rval, "coalesced", ksr_number(env, coalesced));
+
+	if (k->ksr_memlimit != 0) {
+		ksr_set(env, rval, "limit", ksr_number(env, k->ksr_memlimit));
+		ksr_set(env, rval, "overlimit",
+		    ksr_boolean(env, k->ksr_overlimit));
+	}
 
 	return (rval);
 }
 
 void
-KStatReader::Close(const FunctionCallbackInfo<Value>& args)
+KStatSubscriber::Initialize(napi_env env, napi_value exports)
 {
-	KStatReader *k = ObjectWrap::Unwrap<KStatReader>(args.Holder());
-	Isolate *isolate = args.GetIsolate();
+	napi_property_descriptor methods[] = {
+		KSR_METHOD("read", KStatSubscriber::Read),
+		KSR_METHOD("close", KStatSubscriber::Close),
+	};
+	napi_value cons;
+
+	(void) napi_define_class(env, "Subscriber", NAPI_AUTO_LENGTH,
+	    KStatSubscriber::New, NULL,
+	    sizeof (methods) / sizeof (methods[0]), methods, &cons);
+	ksr_set(env, exports, "Subscriber", cons);
+}
 
-	if (k->ksr_ctl == NULL)
-		args.GetReturnValue().Set (k->error(isolate, "kstat reader has already been closed\n"));
+KStatSubscriber::KStatSubscriber(string *name)
+    : kss_name(name), kss_fd(-1), kss_shm(NULL), kss_size(0)
+{
+}
 
-	k->close();
-	args.GetReturnValue().SetUndefined();
+KStatSubscriber::~KStatSubscriber()
+{
+	this->close();
+	delete kss_name;
 }
 
 void
-KStatReader::getKCID(const FunctionCallbackInfo<Value>& args)
+KStatSubscriber::finalize(napi_env env, void *data, void *hint)
 {
-	KStatReader *k = ObjectWrap::Unwrap<KStatReader>(args.Holder());
-	args.GetReturnValue().Set(k->getkcid());
+	delete (KStatSubscriber *)data;
 }
 
 void
-KStatReader::getKstat(const FunctionCallbackInfo<Value>& args)
+KStatSubscriber::close()
 {
-	KStatReader *k = ObjectWrap::Unwrap<KStatReader>(args.Holder());
-	Isolate *isolate = args.GetIsolate();
+	if (kss_shm != NULL)
+		(void) munmap(kss_shm, kss_size);
 
-	string *imodule = stringMember(isolate, args[0], "module", "");
-	string module = *imodule;
-	int64_t instance = intMember(isolate, args[0], "instance", -1);
-	string *iname = stringMember(isolate, args[0], "name", "");
-	string name = *iname;
-	kstat_t *ksp = kstat_lookup(k->ksr_ctl, (char *)module.c_str(), instance, (char *)name.c_str());
-	if (ksp == NULL) {
-		Local<Object> rval = Object::New(isolate);
-		rval->Set(String::NewFromUtf8(isolate, "error"), String::NewFromUtf8(isolate, "invalid kstat"));
-		rval->Set(String::NewFromUtf8(isolate, "module"), String::NewFromUtf8(isolate, module.c_str()));
-		rval->Set(String::NewFromUtf8(isolate, "instance"), Number::New(isolate, instance));
-		rval->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, name.c_str()));
-		args.GetReturnValue().Set(rval);
-	} else {
-		args.GetReturnValue().Set(k->read(isolate, ksp));
+	if (kss_fd != -1)
+		(void) ::close(kss_fd);
+
+	kss_shm = NULL;
+	kss_size = 0;
+	kss_fd = -1;
+}
+
+/*
+ * (Re)map the segment at its current size.
+ */
+int
+KStatSubscriber::map()
+{
+	struct stat st;
+	char *shm;
+
+	if (fstat(kss_fd, &st) == -1)
+		return (-1);
+
+	if ((size_t)st.st_size == kss_size)
+		return (0);
+
+	if (st.st_size == 0) {
+		shm = NULL;
+	} else if ((shm = (char *)mmap(NULL, st.st_size, PROT_READ,
+	    MAP_SHARED, kss_fd, 0)) == MAP_FAILED) {
+		return (-1);
 	}
-	delete imodule;
-	delete iname;
+
+	if (kss_shm != NULL)
+		(void) munmap(kss_shm, kss_size);
+
+	kss_shm = shm;
+	kss_size = st.st_size;
+
+	return (0);
 }
 
-void
-KStatReader::Update(const FunctionCallbackInfo<Value>& args)
+/*
+ * Copy a consistent image of the segment into kss_buf, which is left empty if
+ * nothing has been published yet.
+ */
+int
+KStatSubscriber::copy()
 {
-	KStatReader *k = ObjectWrap::Unwrap<KStatReader>(args.Holder());
-	args.GetReturnValue().Set(k->update());
+	ksr_shmhdr_t *hdr;
+	uint64_t seq, size;
+	int i;
+
+	for (i = 0; i < KSR_SHM_RETRIES; i++) {
+		if (i != 0)
+			(void) sched_yield();
+
+		if (kss_size < sizeof (ksr_shmhdr_t)) {
+			if (this->map() == -1)
+				return (-1);
+
+			if (kss_size < sizeof (ksr_shmhdr_t)) {
+				kss_buf.clear();
+				return (0);
+			}
+		}
+
+		hdr = (ksr_shmhdr_t *)kss_shm;
+		seq = __atomic_load_n(&hdr->ksh_seq, __ATOMIC_ACQUIRE);
+
+		if (seq & 1)
+			continue;
+
+		size = __atomic_load_n(&hdr->ksh_size, __ATOMIC_RELAXED);
+
+		if (size > kss_size) {
+			/*
+			 * The publisher has grown the segment since we mapped
+			 * it.
+			 */
+			if (this->map() == -1)
+				return (-1);
+			continue;
+		}
+
+		kss_buf.resize(size);
+		(void) memcpy(kss_buf.data(), kss_shm, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&hdr->ksh_seq, __ATOMIC_RELAXED) == seq)
+			return (0);
+	}
+
+	errno = ETIMEDOUT;
+	return (-1);
 }
 
-void
-KStatReader::List(const FunctionCallbackInfo<Value>& args)
+napi_value
+KStatSubscriber::New(napi_env env, napi_callback_info info)
 {
-	KStatReader *k = ObjectWrap::Unwrap<KStatReader>(args.Holder());
-	Local<Array> rval;
-	Isolate *isolate = args.GetIsolate();
-	ReturnValue<Value> returnValue = args.GetReturnValue();
-	unsigned int i;
+	napi_value args[1], self;
+	size_t argc = 1;
+	KStatSubscriber *s;
+	string name;
 
-	if (k->update() == -1)
-		returnValue.Set (k->error(isolate, "failed to update kstat chain"));
+	if (napi_get_cb_info(env, info, &argc, args, &self, NULL) != napi_ok)
+		return (NULL);
+
+	if (ksr_type(env, args[0]) != napi_string) {
+		return (KStatReader::error(env, "Subscriber() requires the name "
+		    "of a shared memory segment\n"));
+	}
 
-	rval = Array::New(isolate, k->ksr_kstats.size());
+	name = ksr_utf8(env, args[0]);
+	s = new KStatSubscriber(new string(name));
 
-	try {
-		for (i = 0; i < k->ksr_kstats.size(); i++)
-			rval->Set(i, k->list(isolate, k->ksr_kstats[i]));
-	} catch (Local<Value> err) {
-		returnValue.Set (err);
+	if ((s->kss_fd = shm_open(name.c_str(), O_RDONLY, 0)) == -1) {
+		delete s;
+		return (KStatReader::error(env, "could not open shared memory "
+		    "segment \"%s\"", name.c_str()));
 	}
 
-	returnValue.Set (rval);
+	if (napi_wrap(env, self, s, finalize, NULL, NULL) != napi_ok) {
+		delete s;
+		return (KStatReader::error(env,
+		    "Subscriber() must be called as a constructor\n"));
+	}
+
+	return (self);
 }
 
-void
-KStatReader::Read(const FunctionCallbackInfo<Value>& args)
+napi_value
+KStatSubscriber::Read(napi_env env, napi_callback_info info)
 {
-	KStatReader *k = ObjectWrap::Unwrap<KStatReader>(args.Holder());
-	Local<Array> rval;
-	Isolate *isolate = args.GetIsolate();
-	ReturnValue<Value> returnValue = args.GetReturnValue();
+	napi_value args[2], rval;
+	KStatSubscriber *s = ksr_unwrap<KStatSubscriber>(env, info, args, 2);
+	vector<kstat_t *> kstats;
+	ksr_shmhdr_t *hdr;
+	size_t off, len, size;
 	unsigned int i, j;
 
-	if (k->ksr_ctl == NULL)
-		returnValue.Set (k->error(isolate, "kstat reader has already been closed\n"));
+	if (s == NULL)
+		return (NULL);
 
-	if (k->update() == -1)
-		returnValue.Set (k->error(isolate, "failed to update kstat chain"));
+	if (s->kss_fd == -1) {
+		return (KStatReader::error(env,
+		    "subscriber has already been closed\n"));
+	}
+
+	if (s->copy() == -1) {
+		return (KStatReader::error(env,
+		    "failed to read shared memory segment \"%s\"",
+		    s->kss_name->c_str()));
+	}
 
-	string *rmodule = stringMember(isolate, args[0], "module", "");
-	string *rclass = stringMember(isolate, args[0], "class", "");
-	string *rname = stringMember(isolate, args[0], "name", "");
-	int64_t rinstance = intMember(isolate, args[0], "instance", -1);
+	rval = ksr_array(env);
 
-	rval = Array::New(isolate);
+	if ((size = s->kss_buf.size()) < sizeof (ksr_shmhdr_t))
+		return (rval);
+
+	hdr = (ksr_shmhdr_t *)s->kss_buf.data();
+
+	if (hdr->ksh_magic != KSR_SHM_MAGIC ||
+	    hdr->ksh_version != KSR_SHM_VERSION ||
+	    hdr->ksh_hdrsize != sizeof (ksr_shmhdr_t) ||
+	    hdr->ksh_kstatsize != sizeof (kstat_t) ||
+	    hdr->ksh_namedsize != sizeof (kstat_named_t)) {
+		return (KStatReader::error(env,
+		    "shared memory segment \"%s\" has an unrecognized layout\n",
+		    s->kss_name->c_str()));
+	}
+
+	/*
+	 * Turn each record back into a kstat that our decoders understand.
+	 */
+	for (i = 0, off = sizeof (ksr_shmhdr_t); i < hdr->ksh_count; i++) {
+		char *rec = s->kss_buf.data() + off;
+		kstat_t *ksp = (kstat_t *)(rec + sizeof (uint64_t));
+		kstat_named_t *nm;
+		char *data;
+
+		if (off + sizeof (uint64_t) > size ||
+		    (len = *(uint64_t *)rec) > size - off ||
+		    len < sizeof (uint64_t) + sizeof (kstat_t) ||
+		    ksp->ks_data_size >
+		    len - sizeof (uint64_t) - sizeof (kstat_t) ||
+		    (ksp->ks_type == KSTAT_TYPE_NAMED && ksp->ks_ndata >
+		    ksp->ks_data_size / sizeof (kstat_named_t))) {
+			return (KStatReader::error(env,
+			    "shared memory segment \"%s\" is corrupt\n",
+			    s->kss_name->c_str()));
+		}
+
+		off += len;
+		data = (char *)(ksp + 1);
+		ksp->ks_data = data;
+		ksp->ks_next = NULL;
+		kstats.push_back(ksp);
+
+		if (ksp->ks_type != KSTAT_TYPE_NAMED)
+			continue;
+
+		for (j = 0, nm = KSTAT_NAMED_PTR(ksp); j < ksp->ks_ndata;
+		    j++, nm++) {
+			size_t stroff = (size_t)KSTAT_NAMED_STR_PTR(nm);
+
+			if (nm->data_type != KSTAT_DATA_STRING)
+				continue;
+
+			KSTAT_NAMED_STR_PTR(nm) = stroff < ksp->ks_data_size &&
+			    memchr(data + stroff, '\0',
+			    ksp->ks_data_size - stroff) != NULL ?
+			    data + stroff : (char *)"";
+		}
+	}
+
+	string *rmodule = KStatReader::stringMember(env, args[0], "module", "");
+	string *rclass = KStatReader::stringMember(env, args[0], "class", "");
+	string *rname = KStatReader::stringMember(env, args[0], "name", "");
+	int64_t rinstance = KStatReader::intMember(env, args[0], "instance", -1);
+	int flags = KStatReader::readflags(env, args[1]);
 
 	try {
-		for (i = 0, j = 0; i < k->ksr_kstats.size(); i++) {
-			if (!k->matches(k->ksr_kstats[i],
-			    rmodule, rclass, rname, rinstance))
+		for (i = 0, j = 0; i < kstats.size(); i++) {
+			napi_value ks;
+
+			if (!KStatReader::matches(kstats[i], rmodule, rclass,
+			    rname, rinstance))
 				continue;
 
-			rval->Set(j++, k->read(isolate, k->ksr_kstats[i]));
+			ks = KStatReader::header(env, kstats[i]);
+			KStatReader::contents(env, ks, kstats[i], flags);
+			ksr_setelem(env, rval, j++, ks);
 		}
-	} catch (Local<Value> err) {
-		delete rmodule;
-		delete rclass;
-		delete rname;
-		returnValue.Set (err);
+	} catch (ksr_pending_t) {
+		rval = NULL;
 	}
 
 	delete rmodule;
 	delete rclass;
 	delete rname;
-	returnValue.Set (rval);
+
+	return (rval);
 }
 
-extern "C" void
-init(Local<Object> exports)
+napi_value
+KStatSubscriber::Close(napi_env env, napi_callback_info info)
 {
-	KStatReader::Initialize(exports);
+	KStatSubscriber *s = ksr_unwrap<KStatSubscriber>(env, info, NULL, 0);
+
+	if (s == NULL)
+		return (NULL);
+
+	if (s->kss_fd == -1) {
+		return (KStatReader::error(env,
+		    "subscriber has already been closed\n"));
+	}
+
+	s->close();
+
+	return (NULL);
 }
 
-NODE_MODULE(kstat, init);
+NAPI_MODULE_INIT()
+{
+	return (KStatReader::Initialize(env, exports));
+}
@@ -0,0 +1,36 @@
+/*
+ * What the tests share.  Each test is a script of its own, run by run.js in a
+ * process of its own against the synthetic kstat chain of kssim.so (see
+ * README), so that what it reads is the same on every system.  The addon
+ * under test is build/Release/kstat.node, unless KSTAT_ADDON names another.
+ */
+
+var path = require('path');
+
+var release = path.join(__dirname, '..', 'build', 'Release');
+
+exports.addon = process.env.KSTAT_ADDON ?
+    path.resolve(process.env.KSTAT_ADDON) : path.join(release, 'kstat.node');
+exports.sim = process.env.KSTAT_SIM ?
+    path.resolve(process.env.KSTAT_SIM) : path.join(release, 'kssim.so');
+
+/*
+ * Load the addon.  Anything that the synthetic chain is to be made with (its
+ * KSSIM_* variables) must be set before the first reader is created.
+ */
+exports.kstat = function ()
+{
+	return (require(exports.addon));
+};
+
+/*
+ * Wait for at least the given number of milliseconds, so that the synthetic
+ * counters (which advance with time) have moved on.
+ */
+exports.sleep = function (ms)
+{
+	var end = Date.now() + ms;
+
+	while (Date.now() < end)
+		continue;
+};
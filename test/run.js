@@ -0,0 +1,57 @@
+/*
+ * Run the tests:  each test-*.js here (or each named on the command line) in
+ * a process of its own, with kssim.so preloaded to serve a small synthetic
+ * chain of 4 CPUs, 4 disks and 2 NICs.  A test passes if it exits 0.
+ *
+ * Usage: node test/run.js [test ...]
+ */
+
+var child_process = require('child_process');
+var fs = require('fs');
+var path = require('path');
+var common = require('./common');
+
+function
+run(tests)
+{
+	var failed = 0;
+
+	[ common.addon, common.sim ].forEach(function (f) {
+		if (!fs.existsSync(f)) {
+			console.error('run: %s not found; build it first', f);
+			process.exit(2);
+		}
+	});
+
+	tests.forEach(function (t) {
+		var env = Object.assign({ KSSIM_CPUS: '4', KSSIM_DISKS: '4',
+		    KSSIM_NICS: '2' }, process.env, { LD_PRELOAD: common.sim });
+		var res = child_process.spawnSync(process.execPath,
+		    [ path.resolve(__dirname, t) ], { env: env,
+		    encoding: 'utf8' });
+
+		if (res.status === 0) {
+			console.log('ok - %s', t);
+			return;
+		}
+
+		failed++;
+		console.log('not ok - %s (%s)', t, res.status !== null ?
+		    'exit ' + res.status : res.signal);
+		process.stdout.write(res.stdout + res.stderr);
+	});
+
+	console.log('%d of %d tests passed', tests.length - failed,
+	    tests.length);
+	process.exit(failed === 0 ? 0 : 1);
+}
+
+var tests = process.argv.slice(2);
+
+if (tests.length === 0) {
+	tests = fs.readdirSync(__dirname).filter(function (f) {
+		return (/^test-.*\.js$/.test(f));
+	}).sort();
+}
+
+run(tests);
@@ -0,0 +1,148 @@
+/*
+ * arrow() returns an Arrow IPC stream for each kstat name:  a schema message
+ * naming the columns, then a record batch with a row for each kstat, then
+ * the end-of-stream marker.  The messages' metadata is read here with just
+ * enough of a FlatBuffer reader to check what they say.
+ */
+
+var assert = require('assert');
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var common = require('./common');
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+
+/*
+ * The field of a FlatBuffer table at "table" with the given ID, as the
+ * position of its value, or -1 if it's absent.
+ */
+function
+field(buf, table, id)
+{
+	var vtable = table - buf.readInt32LE(table);
+	var off = 4 + 2 * id;
+
+	if (off >= buf.readUInt16LE(vtable))
+		return (-1);
+
+	off = buf.readUInt16LE(vtable + off);
+
+	return (off === 0 ? -1 : table + off);
+}
+
+function
+deref(buf, at)
+{
+	return (at + buf.readUInt32LE(at));
+}
+
+function
+string(buf, at)
+{
+	at = deref(buf, at);
+
+	return (buf.toString('utf8', at + 4, at + 4 + buf.readUInt32LE(at)));
+}
+
+/*
+ * Split a stream into its messages, each with its header type, its header
+ * table and its body.
+ */
+function
+messages(buf)
+{
+	var rval = [], pos = 0;
+
+	for (;;) {
+		var len, meta, msg, body;
+
+		assert.strictEqual(buf.readUInt32LE(pos), 0xffffffff);
+		len = buf.readInt32LE(pos + 4);
+		pos += 8;
+
+		if (len === 0)
+			break;
+
+		assert.strictEqual(len % 8, 0, 'metadata is padded');
+		meta = buf.slice(pos, pos + len);
+		msg = deref(meta, 0);
+		body = Number(meta.readBigInt64LE(field(meta, msg, 3)));
+		rval.push({ type: meta.readUInt8(field(meta, msg, 1)),
+		    meta: meta, header: deref(meta, field(meta, msg, 2)),
+		    body: buf.slice(pos + len, pos + len + body) });
+		pos += len + body;
+	}
+
+	assert.strictEqual(pos, buf.length, 'nothing after the end');
+
+	return (rval);
+}
+
+function
+check(buf, names, rows)
+{
+	var msgs = messages(buf), meta, fields, cols = [];
+
+	assert.strictEqual(msgs.length, 2);
+	assert.strictEqual(msgs[0].type, 1, 'a Schema');
+	assert.strictEqual(msgs[1].type, 3, 'a RecordBatch');
+
+	meta = msgs[0].meta;
+	fields = deref(meta, field(meta, msgs[0].header, 1));
+
+	for (var i = 0; i < meta.readUInt32LE(fields); i++)
+		cols.push(string(meta, field(meta,
+		    deref(meta, fields + 4 + 4 * i), 0)));
+
+	assert.deepStrictEqual(cols,
+	    [ 'module', 'instance', 'snaptime' ].concat(names));
+
+	meta = msgs[1].meta;
+	assert.strictEqual(Number(meta.readBigInt64LE(field(meta,
+	    msgs[1].header, 0))), rows);
+}
+
+var expect = reader.read({ module: 'cpu', name: 'sys' });
+var names = Object.keys(expect[0].data);
+var streams, dir, files;
+
+streams = reader.arrow({ module: 'cpu', name: 'sys' });
+assert.deepStrictEqual(Object.keys(streams), [ 'sys' ]);
+assert.ok(Buffer.isBuffer(streams.sys));
+check(streams.sys, names, 4);
+
+/*
+ * A table for each name:  the CPUs' cpu_info kstats are each named apart.
+ */
+streams = reader.arrow({ module: 'cpu_info' });
+assert.strictEqual(Object.keys(streams).length, 4);
+check(streams.cpu_info0, [ 'brand', 'state', 'clock_MHz', 'chip_id',
+    'core_id' ], 1);
+
+/*
+ * I/O kstats have the fields of a kstat_io_t.
+ */
+streams = reader.arrow({ module: 'sd' });
+assert.strictEqual(Object.keys(streams).length, 4);
+Object.keys(streams).forEach(function (n) {
+	check(streams[n], [ 'nread', 'nwritten', 'reads', 'writes', 'wtime',
+	    'wlentime', 'wlastupdate', 'rtime', 'rlentime', 'rlastupdate',
+	    'wcnt', 'rcnt' ], 1);
+});
+
+dir = fs.mkdtempSync(path.join(os.tmpdir(), 'kstat-arrow-'));
+
+try {
+	files = reader.arrow({ module: 'cpu', name: 'sys' }, { directory: dir });
+	assert.deepStrictEqual(files, { sys: path.join(dir, 'sys.arrows') });
+	check(fs.readFileSync(files.sys), names, 4);
+} finally {
+	fs.readdirSync(dir).forEach(function (f) {
+		fs.unlinkSync(path.join(dir, f));
+	});
+	fs.rmdirSync(dir);
+}
+
+reader.close();
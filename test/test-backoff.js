@@ -0,0 +1,69 @@
+/*
+ * A kstat whose reads fail is reported once, then left alone (and listed by
+ * failures()) until it's due to be retried, at exponentially longer intervals
+ * up to the reader's backoff; once it reads again, it's forgotten.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+var kstat = common.kstat();
+var reader = new kstat.Reader({ module: 'cpu', name: 'sys', backoff: 300 });
+var results, failures, errors;
+
+function
+instances(r)
+{
+	return (r.map(function (k) { return (k.instance); }));
+}
+
+process.env.KSSIM_FAIL = 'cpu:1:sys';
+
+results = reader.read();
+assert.deepStrictEqual(instances(results), [ 0, 1, 2, 3 ]);
+assert.strictEqual(results[1].error, 'Input/output error');
+assert.strictEqual(results[1].data, undefined);
+assert.strictEqual(typeof (results[0].data.syscall), 'number');
+errors = reader.stats().errors;
+assert.strictEqual(errors, 1);
+
+/*
+ * Until the retry is due, the kstat is neither read nor reported.
+ */
+results = reader.read();
+assert.deepStrictEqual(instances(results), [ 0, 2, 3 ]);
+assert.strictEqual(reader.stats().errors, errors, 'not read again');
+
+failures = reader.failures();
+assert.strictEqual(failures.length, 1);
+assert.strictEqual(failures[0].module, 'cpu');
+assert.strictEqual(failures[0].instance, 1);
+assert.strictEqual(failures[0].error, 'Input/output error');
+assert.strictEqual(failures[0].failures, 1);
+assert.ok(failures[0].retry > 0 && failures[0].retry <= 300,
+    'retry in ' + failures[0].retry);
+
+/*
+ * Once it's due, it's tried again; while it keeps failing, the count grows
+ * (and the interval stays within the backoff).
+ */
+common.sleep(failures[0].retry + 50);
+results = reader.read();
+assert.deepStrictEqual(instances(results), [ 0, 1, 2, 3 ]);
+assert.strictEqual(reader.stats().errors, errors + 1);
+failures = reader.failures();
+assert.strictEqual(failures[0].failures, 2);
+assert.ok(failures[0].retry <= 300, 'retry in ' + failures[0].retry);
+
+/*
+ * When it reads again, it's back, and no longer a failure.
+ */
+delete process.env.KSSIM_FAIL;
+common.sleep(failures[0].retry + 50);
+results = reader.read();
+assert.deepStrictEqual(instances(results), [ 0, 1, 2, 3 ]);
+assert.strictEqual(results[1].error, undefined);
+assert.strictEqual(typeof (results[1].data.syscall), 'number');
+assert.deepStrictEqual(reader.failures(), []);
+
+reader.close();
@@ -0,0 +1,81 @@
+/*
+ * A read with a time budget returns what it has read when the budget runs
+ * out, with a continuation from which the next read resumes on the same
+ * chain; a pass across a chain update must be started again.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_CHURN = 'call';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var full, pass, parts, r, opts, kid;
+
+function
+key(ks)
+{
+	return (ks.module + ':' + ks.instance + ':' + ks.name);
+}
+
+function
+vnics(kstats)
+{
+	return (kstats.filter(function (ks) {
+		return (ks.module == 'vnic');
+	}).map(key).sort());
+}
+
+full = reader.read();
+assert.strictEqual(full.continuation, undefined, 'no budget, no continuation');
+
+/*
+ * With a budget of a microsecond, each read gets through little of the
+ * chain; the pieces together are one whole read of a single chain, even
+ * though every chain update here replaces VNICs.
+ */
+pass = [];
+parts = 0;
+opts = { budgetUs: 1 };
+kid = -1;
+
+do {
+	r = reader.read({}, opts);
+	assert.ok(r.length > 0);
+	pass = pass.concat(r);
+	parts++;
+
+	if (kid == -1)
+		kid = reader.getkcid();
+	else
+		assert.strictEqual(reader.getkcid(), kid, 'chain updated');
+
+	opts = { budgetUs: 1, continuation: r.continuation };
+} while (r.continuation !== undefined);
+
+assert.ok(parts > 1);
+assert.strictEqual(pass.length, full.length);
+assert.strictEqual(new Set(pass.map(key)).size, pass.length, 'duplicates');
+assert.strictEqual(vnics(pass).length, vnics(full).length);
+assert.notDeepStrictEqual(vnics(pass), vnics(full));
+
+/*
+ * A continuation is only good for the chain it was made on.
+ */
+r = reader.read({ module: 'cpu' }, { budgetUs: 1 });
+assert.ok(r.continuation);
+reader.chainupdate();
+assert.throws(function () {
+	reader.read({ module: 'cpu' }, { continuation: r.continuation });
+}, /has been updated/);
+
+assert.throws(function () {
+	reader.read({}, { continuation: 'bogus' });
+}, /invalid continuation/);
+
+assert.throws(function () {
+	reader.read({}, { budgetUs: 1, topN: 2, by: 'syscall' });
+});
+
+reader.close();
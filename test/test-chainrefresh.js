@@ -0,0 +1,98 @@
+/*
+ * Under a refresh policy other than "always", reads don't update the chain
+ * unless it's due:  after an interval, or once the chain watcher has seen
+ * the chain change, in which case the update happens in the background, and
+ * what it frees is accounted for there and then.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_CHURN = 'call';
+
+var kstat = common.kstat();
+var other = new kstat.Reader();
+var timed = new kstat.Reader({ refresh: 200 });
+var before, s;
+
+function
+vnics(reader)
+{
+	return (reader.read({ module: 'vnic' }).map(function (ks) {
+		return (ks.name);
+	}));
+}
+
+assert.throws(function () { new kstat.Reader({ refresh: 'never' }); },
+    /unrecognized refresh policy/);
+
+/*
+ * Within the interval, reads skip the update, and so see the same VNICs.
+ */
+before = vnics(timed);
+assert.deepStrictEqual(vnics(timed), before);
+assert.deepStrictEqual(vnics(timed), before);
+s = timed.stats();
+assert.strictEqual(s.chainupdates, 1);
+assert.strictEqual(s.chainskips, 2);
+
+common.sleep(250);
+assert.notDeepStrictEqual(vnics(timed), before);
+assert.strictEqual(timed.stats().chainupdates, 2);
+timed.close();
+
+/*
+ * With the watcher, reads never update the chain themselves (beyond the
+ * first, which loads it).  A watch on the VNICs keeps state for each of them,
+ * which an update lets go of.  Under churn on every update, each background
+ * update makes the next, so there is no saying how many there have been.
+ */
+function
+watch(options, check)
+{
+	var watched = new kstat.Reader(options), s, before, caches;
+
+	watched.watch({ module: 'vnic', statistic: 'link_up', op: '==',
+	    value: 1 });
+	watched.checkwatch();
+	before = vnics(watched);
+	assert.deepStrictEqual(vnics(watched), before);
+	s = watched.stats();
+	assert.strictEqual(s.chainupdates, 1);
+	assert.strictEqual(s.chainskips, 2);
+	caches = watched.memoryUsage().caches;
+
+	if (options.memoryLimit !== undefined)
+		assert.strictEqual(watched.memoryUsage().overlimit, true);
+
+	other.chainupdate();
+
+	setTimeout(function () {
+		s = watched.stats();
+		assert.ok(s.chainupdates > 1, 'not updated in the background');
+		assert.strictEqual(s.chainchanges, s.chainupdates);
+		assert.ok(watched.memoryUsage().caches < caches,
+		    'watch state of departed VNICs kept');
+
+		check(watched);
+		assert.notDeepStrictEqual(vnics(watched), before);
+		watched.close();
+	}, 200);
+}
+
+/*
+ * Then, with a limit that the reader can only meet once its watch state has
+ * been let go, what the background update freed must be accounted for (and
+ * the limit seen to be met) without waiting for another call.
+ */
+watch({ refresh: 'watch', refreshPoll: 10 }, function (watched) {
+	var u = watched.memoryUsage();
+
+	assert.strictEqual(u.data, 0);
+
+	watch({ refresh: 'watch', refreshPoll: 10,
+	    memoryLimit: u.chain + u.caches }, function (limited) {
+		assert.strictEqual(limited.memoryUsage().overlimit, false);
+		other.close();
+	});
+});
@@ -0,0 +1,61 @@
+/*
+ * Readers created with a coalescing window use a copy of what any of them has
+ * read within it, instead of reading the kstat again; readers without one
+ * always read.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var spec = { module: 'cpu', name: 'sys' };
+var a = new kstat.Reader({ coalesce: 60000 });
+var b = new kstat.Reader({ coalesce: 60000 });
+var brief = new kstat.Reader({ coalesce: 50 });
+var plain = new kstat.Reader();
+
+function
+syscalls(reader)
+{
+	return (reader.read(spec).map(function (k) {
+		return (k.data.syscall);
+	}));
+}
+
+/*
+ * A reader's first read of a kstat always goes to the kernel.
+ */
+assert.deepStrictEqual(syscalls(a), [ 5000, 10000, 15000, 20000 ]);
+assert.deepStrictEqual(syscalls(b), [ 5000, 10000, 15000, 20000 ]);
+assert.strictEqual(a.stats().coalesced, 0);
+assert.strictEqual(b.stats().coalesced, 0);
+
+/*
+ * Later, within the window, both have what was last read, and so does the
+ * reader with a narrow window; the reader without a window sees time move.
+ */
+process.env.KSSIM_TIME = '2';
+assert.deepStrictEqual(syscalls(b), [ 5000, 10000, 15000, 20000 ]);
+assert.deepStrictEqual(syscalls(a), [ 5000, 10000, 15000, 20000 ]);
+assert.deepStrictEqual(syscalls(plain), [ 10000, 20000, 30000, 40000 ]);
+assert.strictEqual(a.stats().reads, 8);
+assert.strictEqual(a.stats().coalesced, 4);
+assert.strictEqual(b.stats().coalesced, 4);
+assert.strictEqual(plain.stats().coalesced, 0);
+assert.ok(a.memoryUsage().coalesced > 0);
+
+/*
+ * The narrow window's first read is its own; past its window, the next is
+ * too, and what it reads is then offered to the others.
+ */
+process.env.KSSIM_TIME = '3';
+assert.deepStrictEqual(syscalls(brief), [ 15000, 30000, 45000, 60000 ]);
+common.sleep(100);
+process.env.KSSIM_TIME = '4';
+assert.deepStrictEqual(syscalls(brief), [ 20000, 40000, 60000, 80000 ]);
+assert.strictEqual(brief.stats().coalesced, 0);
+assert.deepStrictEqual(syscalls(a), [ 20000, 40000, 60000, 80000 ]);
+
+[ a, b, brief, plain ].forEach(function (r) { r.close(); });
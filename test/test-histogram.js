@@ -0,0 +1,114 @@
+/*
+ * Histograms record how much a statistic changes between reads, as a rate or
+ * as a change, to within the precision of their buckets, and can be kept in
+ * windows of time.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var spec = { module: 'cpu', name: 'sys' };
+var rates, changes, windowed, h, total;
+
+/*
+ * Within 1 part in 64.
+ */
+function
+near(actual, expected)
+{
+	assert.ok(Math.abs(actual - expected) <= expected / 64,
+	    actual + ' is not near ' + expected);
+}
+
+rates = reader.histogram({ module: 'cpu', name: 'sys',
+    statistic: 'syscall' });
+changes = reader.histogram({ module: 'cpu', instance: 1, name: 'sys',
+    statistic: 'syscall', rate: false, scale: 0.001 });
+assert.notStrictEqual(rates, changes);
+
+/*
+ * The first read of each kstat only sets the baseline.
+ */
+reader.read(spec);
+h = reader.gethistogram(rates);
+assert.strictEqual(h.count, 0);
+assert.strictEqual(h.min, null);
+assert.strictEqual(h.max, null);
+assert.strictEqual(h.mean, null);
+
+/*
+ * CPU n's syscall rate is 5000 * (n + 1) per second.
+ */
+process.env.KSSIM_TIME = '3';
+reader.read(spec);
+h = reader.gethistogram(rates, { percentiles: [ 25, 100 ],
+    buckets: true });
+assert.strictEqual(h.count, 4);
+assert.strictEqual(h.discarded, 0);
+near(h.min, 5000);
+near(h.max, 20000);
+assert.strictEqual(h.mean, 12500);
+assert.deepStrictEqual(Object.keys(h.percentiles).sort(), [ '100', '25' ]);
+near(h.percentiles['25'], 5000);
+near(h.percentiles['100'], 20000);
+assert.ok(typeof (h.start) == 'number' && h.start <= Date.now());
+
+total = 0;
+h.buckets.forEach(function (b) {
+	assert.ok(b[1] === null || b[0] < b[1]);
+	total += b[2];
+});
+assert.strictEqual(total, 4);
+
+/*
+ * Over two seconds, CPU 1 made 20000 syscalls; scaled, that's 20.
+ */
+h = reader.gethistogram(changes);
+assert.strictEqual(h.count, 1);
+assert.strictEqual(h.min, 20);
+assert.strictEqual(h.max, 20);
+
+/*
+ * Reads of the kstats by any means count, but not a read that sees the same
+ * snapshot again.
+ */
+reader.read(spec);
+reader.prepare({ module: 'cpu', instance: 1, name: 'sys' }).read();
+process.env.KSSIM_TIME = '4';
+reader.getkstat({ module: 'cpu', instance: 1, name: 'sys' });
+h = reader.gethistogram(changes, { reset: true });
+assert.strictEqual(h.count, 2);
+assert.strictEqual(h.min, 10);
+assert.strictEqual(reader.gethistogram(changes).count, 0);
+assert.strictEqual(reader.gethistogram(rates).count, 5);
+
+/*
+ * A window starts the histogram again, keeping the one before.
+ */
+windowed = reader.histogram({ module: 'cpu', instance: 0, name: 'sys',
+    statistic: 'syscall', window: 100 });
+assert.strictEqual(reader.gethistogram(windowed, { previous: true }), null);
+
+process.env.KSSIM_TIME = '5';
+reader.read(spec);
+process.env.KSSIM_TIME = '6';
+reader.read(spec);
+assert.strictEqual(reader.gethistogram(windowed).count, 1);
+
+common.sleep(150);
+process.env.KSSIM_TIME = '7';
+reader.read(spec);
+assert.strictEqual(reader.gethistogram(windowed).count, 1);
+h = reader.gethistogram(windowed, { previous: true });
+assert.strictEqual(h.count, 1);
+assert.strictEqual(h.max, 5000);
+
+assert.strictEqual(reader.unhistogram(windowed), true);
+assert.strictEqual(reader.unhistogram(windowed), false);
+assert.throws(function () { reader.gethistogram(windowed); });
+
+reader.close();
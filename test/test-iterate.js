@@ -0,0 +1,75 @@
+/*
+ * A cursor returns the matching kstats in batches, following them across
+ * chain changes and skipping any that have gone by the time they're reached.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_CHURN = 'call';
+process.env.KSSIM_CHURN_SIZE = '2';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var cursor, batch, seen, names, vnics;
+
+function
+drain(c, sizes)
+{
+	var rval = [], b;
+
+	while ((b = c.next()) !== null) {
+		if (sizes)
+			sizes.push(b.length);
+
+		rval = rval.concat(b);
+	}
+
+	assert.strictEqual(c.next(), null, 'stays finished');
+
+	return (rval);
+}
+
+/*
+ * The 4 CPUs have 8 kstats of module "cpu":  sys and vm.
+ */
+seen = [];
+batch = drain(reader.iterate({ module: 'cpu' }, { batchSize: 3 }), seen);
+assert.deepStrictEqual(seen, [ 3, 3, 2 ]);
+assert.strictEqual(batch.length, 8);
+batch.forEach(function (k) {
+	assert.strictEqual(k.module, 'cpu');
+	assert.strictEqual(typeof (k.data), 'object');
+});
+
+names = drain(reader.iterate({ module: 'cpu' }, { sort: true })).map(
+    function (k) { return (k.instance + ':' + k.name); });
+assert.deepStrictEqual(names, [ '0:sys', '0:vm', '1:sys', '1:vm', '2:sys',
+    '2:vm', '3:sys', '3:vm' ]);
+
+batch = drain(reader.iterate({ module: 'cpu', name: 'sys' },
+    { list: true }));
+assert.strictEqual(batch.length, 4);
+batch.forEach(function (k) { assert.strictEqual(k.data, undefined); });
+
+/*
+ * A cursor part way through a pass carries on over a changed chain; the
+ * kstats it has yet to reach are found again on it.
+ */
+cursor = reader.iterate({ module: 'cpu' }, { batchSize: 3 });
+seen = cursor.next();
+reader.chainupdate();
+seen = seen.concat(drain(cursor));
+assert.strictEqual(seen.length, 8);
+
+/*
+ * Every chain update replaces the VNICs, so a cursor over them finds that
+ * they have all gone.
+ */
+cursor = reader.iterate({ module: 'vnic' }, { batchSize: 1 });
+vnics = cursor.next();
+assert.strictEqual(vnics.length, 1);
+reader.chainupdate();
+assert.deepStrictEqual(drain(cursor), []);
+
+reader.close();
@@ -0,0 +1,42 @@
+/*
+ * A lazy read copies each kstat when it's read, but only decodes the copy
+ * when its data is first looked at; what it decodes is what was read then.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader({ module: 'cpu', name: 'sys' });
+var eager = reader.read();
+var lazy = reader.read({}, { lazy: true });
+var desc, one;
+
+assert.strictEqual(lazy.length, 4);
+
+desc = Object.getOwnPropertyDescriptor(lazy[0], 'data');
+assert.strictEqual(typeof (desc.get), 'function', 'not yet decoded');
+assert.ok(desc.enumerable);
+
+process.env.KSSIM_TIME = '2';
+
+lazy.forEach(function (k, i) {
+	assert.deepStrictEqual(k.data, eager[i].data);
+	assert.strictEqual(k.data.syscall, 5000 * (k.instance + 1));
+});
+
+desc = Object.getOwnPropertyDescriptor(lazy[0], 'data');
+assert.strictEqual(desc.get, undefined, 'decoded once, then a value');
+assert.strictEqual(lazy[0].data, lazy[0].data);
+
+/*
+ * The same goes for getkstat(), and for kstats that are only serialized.
+ */
+one = reader.getkstat({ module: 'cpu', instance: 2, name: 'sys' },
+    { lazy: true });
+process.env.KSSIM_TIME = '3';
+assert.strictEqual(JSON.parse(JSON.stringify(one)).data.syscall, 30000);
+
+reader.close();
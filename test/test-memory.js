@@ -0,0 +1,79 @@
+/*
+ * A reader with a memory limit gives back what it can to get under it:  its
+ * snapshots first, then (by reopening the chain) its data buffers.  If even
+ * that wouldn't be enough, it keeps its data, and says that it's over.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var spec = { module: 'cpu', name: 'sys' };
+var measure = new kstat.Reader();
+var base, full, nkstats, reader, handle, u;
+
+nkstats = measure.read().length;
+full = measure.memoryUsage();
+measure.close();
+
+assert.ok(full.data > 0);
+assert.strictEqual(full.limit, undefined);
+assert.strictEqual(full.overlimit, undefined);
+base = full.chain + full.caches;
+
+/*
+ * A limit that can be met only by freeing the data:  reads are as without
+ * one, but the data buffers are freed after each, and a prepared handle
+ * follows its kstat into the reopened chain.
+ */
+reader = new kstat.Reader({ memoryLimit: base + full.data / 2 });
+handle = reader.prepare({ module: 'cpu', instance: 2, name: 'sys' });
+
+assert.strictEqual(reader.read().length, nkstats);
+u = reader.memoryUsage();
+assert.strictEqual(u.limit, base + full.data / 2);
+assert.strictEqual(u.data, 0);
+assert.strictEqual(u.overlimit, false);
+assert.ok(u.total <= u.limit);
+
+assert.strictEqual(handle.read().data.syscall, 15000);
+process.env.KSSIM_TIME = '2';
+assert.deepStrictEqual(reader.read(spec).map(function (k) {
+	return (k.data.syscall);
+}), [ 10000, 20000, 30000, 40000 ]);
+assert.strictEqual(handle.read().data.syscall, 30000);
+assert.strictEqual(reader.memoryUsage().overlimit, false);
+reader.close();
+
+/*
+ * When dropping the snapshots is enough, the data is kept.
+ */
+reader = new kstat.Reader({ snapshots: true,
+    memoryLimit: full.total + 1024 });
+reader.read();
+u = reader.memoryUsage();
+assert.strictEqual(u.snapshots, 0);
+assert.strictEqual(u.data, full.data);
+assert.strictEqual(u.overlimit, false);
+assert.strictEqual(reader.previous(spec).length, 0);
+reader.close();
+
+/*
+ * A limit that can't be met:  the reader doesn't reopen its chain to no
+ * purpose, and reads (and handles) go on working from the data it has.
+ */
+reader = new kstat.Reader({ memoryLimit: full.chain / 2 });
+handle = reader.prepare({ module: 'cpu', instance: 2, name: 'sys' });
+reader.read();
+
+for (var i = 0; i < 3; i++) {
+	u = reader.memoryUsage();
+	assert.strictEqual(u.data, full.data);
+	assert.strictEqual(u.overlimit, true);
+	assert.strictEqual(handle.read().data.syscall, 30000);
+	reader.read(spec);
+}
+
+reader.close();
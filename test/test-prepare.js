@@ -0,0 +1,62 @@
+/*
+ * A prepared handle follows its kstat across chain changes, and says so when
+ * the kstat has gone.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_CHURN = 'call';
+process.env.KSSIM_CHURN_SIZE = '2';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var other = new kstat.Reader();
+var vnics, sys, gone, next, r, before;
+
+vnics = reader.list().filter(function (k) { return (k.module == 'vnic'); });
+assert.strictEqual(vnics.length, 2);
+
+sys = reader.prepare({ module: 'cpu', instance: 1, name: 'sys' });
+gone = reader.prepare({ module: 'vnic', instance: vnics[0].instance,
+    name: vnics[0].name });
+
+r = gone.read();
+assert.strictEqual(r.error, undefined);
+assert.strictEqual(r.name, vnics[0].name);
+assert.strictEqual(typeof (r.data.ipackets64), 'number');
+
+before = sys.read().data.syscall;
+
+/*
+ * Updating the chain replaces both VNICs; the handle to one of them must
+ * notice, rather than read what the chain no longer has.
+ */
+reader.chainupdate();
+r = gone.read();
+assert.strictEqual(r.error, 'invalid kstat');
+assert.strictEqual(r.module, 'vnic');
+assert.strictEqual(r.name, vnics[0].name);
+
+r = sys.read();
+assert.strictEqual(r.error, undefined);
+assert.strictEqual(r.instance, 1);
+assert.ok(r.data.syscall >= before);
+
+/*
+ * If the kstat goes while this reader's chain still has it, the read fails,
+ * and the handle brings the chain up to date and finds it gone.
+ */
+vnics = reader.list().filter(function (k) { return (k.module == 'vnic'); });
+next = reader.prepare({ module: 'vnic', instance: vnics[0].instance,
+    name: vnics[0].name, fields: [ 'rbytes64', 'obytes64' ] });
+
+r = next.read();
+assert.deepStrictEqual(Object.keys(r.data), [ 'rbytes64', 'obytes64' ]);
+
+other.chainupdate();
+r = next.read();
+assert.strictEqual(r.error, 'invalid kstat');
+
+reader.close();
+other.close();
@@ -0,0 +1,55 @@
+/*
+ * A reader with "snapshots" keeps the last two reads of each kstat, and
+ * previous() returns the one before last, without reading anything.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader({ snapshots: true });
+var spec = { module: 'cpu', name: 'sys' };
+var cur, prev, info, reads;
+
+assert.throws(function () { new kstat.Reader().previous(spec); });
+
+reader.read(spec);
+assert.deepStrictEqual(reader.previous(spec), [], 'nothing before');
+
+process.env.KSSIM_TIME = '2';
+cur = reader.read(spec);
+prev = reader.previous(spec);
+assert.strictEqual(prev.length, 4);
+prev.forEach(function (k, i) {
+	assert.strictEqual(k.instance, cur[i].instance);
+	assert.strictEqual(k.data.syscall, 5000 * (k.instance + 1));
+	assert.strictEqual(k.snaptime, cur[i].snaptime - 1e9);
+});
+
+/*
+ * previous() reads nothing, however often it's called.
+ */
+reads = reader.stats().reads;
+process.env.KSSIM_TIME = '3';
+prev = reader.previous(spec);
+assert.strictEqual(reader.stats().reads, reads);
+assert.strictEqual(prev[3].data.syscall, 20000);
+
+reader.read(spec);
+assert.strictEqual(reader.previous(spec)[3].data.syscall, 40000);
+
+/*
+ * Strings are copied with the rest of the snapshot.
+ */
+reader.read({ module: 'cpu_info' });
+reader.read({ module: 'cpu_info' });
+info = reader.previous({ module: 'cpu_info' });
+assert.strictEqual(info.length, 4);
+info.forEach(function (k) {
+	assert.strictEqual(k.data.brand, 'Synthetic CPU');
+	assert.strictEqual(k.data.state, 'on-line');
+});
+
+reader.close();
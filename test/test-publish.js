@@ -0,0 +1,108 @@
+/*
+ * A reader publishes its kstats to shared memory, and subscribers (here, in
+ * another process) read them from there.  The subscriber reads while the
+ * reader keeps publishing, and every read must be one whole publication:
+ * all the CPUs' counters from the same point in time.
+ */
+
+var assert = require('assert');
+var child_process = require('child_process');
+var common = require('./common');
+
+var segment = process.argv[3] || '/kstat-test-' + process.pid;
+var spec = { module: 'cpu', name: 'sys' };
+var duration = 1000;
+
+/*
+ * The subscribing side:  read for the given time, checking each read, and
+ * report how many reads were made and how many publications seen.
+ */
+function
+subscribe()
+{
+	var kstat = common.kstat();
+	var sub = new kstat.Subscriber(segment);
+	var end = Date.now() + duration, reads = 0, times = {};
+
+	while (Date.now() < end) {
+		var r = sub.read(spec), t;
+
+		assert.strictEqual(r.length, 4);
+		t = r[0].data.syscall / 5000;
+
+		r.forEach(function (k) {
+			assert.strictEqual(k.data.syscall, 5000 * t *
+			    (k.instance + 1), 'torn read');
+			assert.strictEqual(k.snaptime, r[0].snaptime);
+		});
+
+		times[t] = true;
+		reads++;
+	}
+
+	sub.close();
+	console.log(JSON.stringify({ reads: reads,
+	    publications: Object.keys(times).length }));
+}
+
+function
+publish()
+{
+	var kstat = common.kstat();
+	var reader = new kstat.Reader();
+	var child, out = '', t = 1;
+
+	process.env.KSSIM_TIME = String(t);
+	assert.strictEqual(reader.publish(segment, spec), 4);
+
+	assert.throws(function () { reader.publish('/kstat-test-other'); },
+	    'one segment per reader');
+
+	/*
+	 * Before the child starts, check what a subscriber sees here.
+	 */
+	var sub = new kstat.Subscriber(segment);
+	var r = sub.read(spec);
+
+	assert.strictEqual(r.length, 4);
+	assert.strictEqual(r[3].data.syscall, 20000);
+	assert.strictEqual(sub.read({ module: 'sd' }).length, 0,
+	    'only what was published');
+	sub.close();
+	assert.throws(function () { sub.read(); });
+
+	child = child_process.spawn(process.execPath, [ __filename, 'sub', segment ],
+	    { stdio: [ 'ignore', 'pipe', 'inherit' ] });
+	child.stdout.on('data', function (d) { out += d; });
+	child.on('exit', function (code) {
+		var res;
+
+		clearInterval(timer);
+		assert.strictEqual(code, 0, 'subscriber failed');
+		res = JSON.parse(out);
+		assert.ok(res.reads > 0);
+		assert.ok(res.publications > 1, out);
+
+		reader.close();
+		assert.throws(function () { new kstat.Subscriber(segment); },
+		    'removed when the reader is closed');
+	});
+
+	/*
+	 * Publish as fast as we can (yielding only so that we see the child
+	 * exit), so that the child's reads race with our writes.
+	 */
+	var timer = setInterval(function () {
+		var end = Date.now() + 20;
+
+		while (Date.now() < end) {
+			process.env.KSSIM_TIME = String(++t);
+			reader.publish(segment, spec);
+		}
+	}, 0);
+}
+
+if (process.argv[2] == 'sub')
+	subscribe();
+else
+	publish();
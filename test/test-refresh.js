@@ -0,0 +1,96 @@
+/*
+ * refresh() brings the results of an earlier read() up to date in place,
+ * changing the array only where kstats have come or gone.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+process.env.KSSIM_CHURN = 'call';
+process.env.KSSIM_CHURN_SIZE = '2';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var spec = { module: 'cpu', name: 'sys' };
+var results, objects, data, raw, buf, vnics, names;
+
+results = reader.read(spec);
+objects = results.slice();
+data = results.map(function (k) { return (k.data); });
+
+process.env.KSSIM_TIME = '2';
+assert.strictEqual(reader.refresh(results, spec), results);
+assert.strictEqual(results.length, 4);
+
+results.forEach(function (k, i) {
+	assert.strictEqual(k, objects[i], 'the same object');
+	assert.strictEqual(k.data, data[i], 'the same data');
+	assert.strictEqual(k.data.syscall, 10000 * (k.instance + 1));
+});
+
+/*
+ * A kstat that fails to read is left with its error and nothing that would
+ * look current; once it reads again, it has its data back.
+ */
+process.env.KSSIM_FAIL = 'cpu:1:sys';
+process.env.KSSIM_TIME = '3';
+reader.refresh(results, spec);
+assert.strictEqual(results[1], objects[1]);
+assert.strictEqual(results[1].error, 'Input/output error');
+assert.strictEqual(results[1].data, undefined);
+assert.strictEqual(results[1].snaptime, undefined);
+assert.strictEqual(results[0].data.syscall, 15000);
+
+/*
+ * (A new reader, so as not to wait for the first one's backoff.)
+ */
+delete process.env.KSSIM_FAIL;
+reader.close();
+reader = new kstat.Reader();
+reader.refresh(results, spec);
+assert.strictEqual(results[1].error, undefined);
+assert.strictEqual(results[1].data.syscall, 30000);
+assert.strictEqual(typeof (results[1].crtime), 'number');
+assert.strictEqual(typeof (results[1].snaptime), 'number');
+
+/*
+ * Raw data read as a Buffer is copied into the same Buffer, and keeps its
+ * schema.
+ */
+raw = reader.read({ module: 'cpu_stat' }, { buffer: true });
+buf = raw[0].data;
+assert.ok(Buffer.isBuffer(buf));
+assert.strictEqual(raw[0].schema, 'cpu_stat');
+
+process.env.KSSIM_TIME = '4';
+reader.refresh(raw, { module: 'cpu_stat' }, { buffer: true });
+assert.strictEqual(raw[0].data, buf);
+assert.strictEqual(raw[0].schema, 'cpu_stat');
+assert.strictEqual(buf.readUInt32LE(
+    kstat.schemas.cpu_stat.fields.syscall.offset), 4 * 5000);
+
+/*
+ * Decoded again without "buffer", it has no schema.
+ */
+reader.refresh(raw, { module: 'cpu_stat' });
+assert.ok(!Buffer.isBuffer(raw[0].data));
+assert.strictEqual(raw[0].schema, undefined);
+assert.strictEqual(raw[0].data.syscall, 4 * 5000);
+
+/*
+ * Every chain update replaces the VNICs; those that have gone are dropped
+ * from the array and the new ones added.
+ */
+results = reader.read({ module: 'vnic' });
+names = results.map(function (k) { return (k.name); });
+assert.strictEqual(results.length, 2);
+
+reader.refresh(results, { module: 'vnic' });
+assert.strictEqual(results.length, 2);
+results.forEach(function (k) {
+	assert.ok(names.indexOf(k.name) == -1, k.name + ' is new');
+	assert.strictEqual(typeof (k.data.ipackets64), 'number');
+});
+
+reader.close();
@@ -0,0 +1,103 @@
+/*
+ * sample() writes the kstats' values into an array at places that layout()
+ * describes, and that stay put until the kstats or their fields change.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+process.env.KSSIM_FAIL = 'cpu:3:sys';
+
+var kstat = common.kstat();
+var spec = { module: 'cpu', name: 'sys' };
+var reader = new kstat.Reader({ backoff: 0 });
+var values = new Float64Array(new SharedArrayBuffer(4096 * 8));
+var hdr = new Int32Array(values.buffer);
+var layout, gen, seq, snaptime, usage;
+
+function
+value(l, slot, field)
+{
+	var s = l.slots[slot];
+
+	return (values[s.offset + 1 + s.fields.indexOf(field)]);
+}
+
+/*
+ * A refused sample leaves the (empty) layout as it was.
+ */
+assert.throws(function () { reader.sample(new Float64Array(8), spec); },
+    /at least \d+ elements/);
+assert.deepStrictEqual(reader.layout(),
+    { generation: 0, length: 4, slots: [] });
+
+gen = reader.sample(values, spec);
+layout = reader.layout();
+assert.strictEqual(gen, 1);
+assert.strictEqual(layout.generation, 1);
+assert.strictEqual(layout.slots.length, 4);
+assert.strictEqual(hdr[0] % 2, 0);
+assert.strictEqual(hdr[1], 1);
+assert.strictEqual(hdr[2], 4);
+assert.strictEqual(hdr[3], layout.length);
+assert.ok(values[2] > 0);
+assert.strictEqual(values[3], reader.getkcid());
+
+layout.slots.forEach(function (s, i) {
+	assert.strictEqual(s.module, 'cpu');
+	assert.strictEqual(s.instance, i);
+	assert.strictEqual(s.offset, i == 0 ? 4 :
+	    layout.slots[i - 1].offset + 1 + layout.slots[i - 1].fields.length);
+});
+
+assert.strictEqual(value(layout, 2, 'syscall'), 15000);
+assert.strictEqual(values[layout.slots[3].offset], 0, 'failed to read');
+assert.deepStrictEqual(layout.slots[3].fields, []);
+
+/*
+ * Time moving on changes the values, but not where they are.
+ */
+seq = hdr[0];
+snaptime = values[layout.slots[2].offset];
+process.env.KSSIM_TIME = '2';
+assert.strictEqual(reader.sample(values, spec), 1);
+assert.strictEqual(hdr[0], seq + 2);
+assert.strictEqual(value(layout, 2, 'syscall'), 30000);
+assert.strictEqual(values[layout.slots[2].offset], snaptime + 1e9);
+
+/*
+ * Once the failed kstat can be read, it gets its fields, and the layout
+ * changes -- but only when the array is large enough to take it.
+ */
+delete process.env.KSSIM_FAIL;
+assert.throws(function () {
+	reader.sample(new Float64Array(layout.length), spec);
+});
+assert.deepStrictEqual(reader.layout(), layout);
+
+assert.strictEqual(reader.sample(values, spec), 2);
+layout = reader.layout();
+assert.ok(layout.slots[3].fields.length > 0);
+assert.strictEqual(value(layout, 3, 'syscall'), 40000);
+reader.close();
+
+/*
+ * A reader with a memory limit frees its data buffers once the sample has
+ * been written, not while it's being written.
+ */
+reader = new kstat.Reader();
+reader.sample(values, spec);
+usage = reader.memoryUsage();
+reader.close();
+
+reader = new kstat.Reader({
+    memoryLimit: usage.chain + usage.caches + usage.data / 2 });
+assert.strictEqual(reader.sample(values, spec), 1);
+layout = reader.layout();
+assert.strictEqual(reader.memoryUsage().data, 0);
+assert.strictEqual(value(layout, 1, 'syscall'), 20000);
+process.env.KSSIM_TIME = '3';
+assert.strictEqual(reader.sample(values, spec), 1);
+assert.strictEqual(value(layout, 1, 'syscall'), 30000);
+reader.close();
@@ -0,0 +1,67 @@
+/*
+ * Scheduled entries fall due at multiples of their intervals, those that fall
+ * due together are read together, with one chain update between them, and
+ * nothing more is read once the schedule is stopped.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var ticks = [], updates;
+
+updates = reader.stats().chainupdates;
+
+reader.schedule([
+	{ module: 'cpu', name: 'sys', interval: 100 },
+	{ 'class': 'disk', interval: 200, lazy: true }
+], function (err, results) {
+	assert.ifError(err);
+	ticks.push(results);
+});
+
+setTimeout(function () {
+	var n = ticks.length, s = reader.stats();
+
+	reader.unschedule();
+	assert.ok(n >= 4, 'only ' + n + ' ticks');
+	assert.ok(s.chainupdates - updates <= n, 'one update per tick');
+
+	ticks.forEach(function (results) {
+		var time = results[0].time;
+
+		assert.strictEqual(results[0].index, 0);
+		assert.strictEqual(results[0].interval, 100);
+		assert.strictEqual(time % 100, 0);
+		assert.strictEqual(results[0].kstats.length, 4);
+		results[0].kstats.forEach(function (ks) {
+			assert.strictEqual(ks.module, 'cpu');
+			assert.strictEqual(typeof (ks.data.syscall), 'number');
+		});
+
+		/*
+		 * The longer interval is due on every other tick, with the
+		 * shorter one.
+		 */
+		if (time % 200 != 0) {
+			assert.strictEqual(results.length, 1);
+			return;
+		}
+
+		assert.strictEqual(results.length, 2);
+		assert.strictEqual(results[1].index, 1);
+		assert.strictEqual(results[1].time, time);
+		assert.ok(results[1].kstats.length > 0);
+		results[1].kstats.forEach(function (ks) {
+			assert.strictEqual(ks['class'], 'disk');
+		});
+	});
+
+	assert.ok(ticks.some(function (r) { return (r.length == 2); }));
+
+	setTimeout(function () {
+		assert.strictEqual(ticks.length, n, 'read after unschedule()');
+		reader.close();
+	}, 300);
+}, 1000);
@@ -0,0 +1,90 @@
+/*
+ * Sparse reads:  "zero" leaves out statistics that are zero, and "changed"
+ * those that haven't changed since the kstat was last read so with the same
+ * specification.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var spec = { module: 'cpu', name: 'sys' };
+var one = { module: 'cpu', instance: 0, name: 'sys' };
+var full, sparse, changed, names;
+
+/*
+ * Rebuild the statistics of a sparse kstat as an object.
+ */
+function
+expand(results, k)
+{
+	var rval = {}, schema = results.schemas[k.schema];
+
+	assert.strictEqual(k.indexes.length, k.values.length);
+
+	k.indexes.forEach(function (i, n) { rval[schema[i]] = k.values[n]; });
+
+	return (rval);
+}
+
+full = reader.read(one)[0];
+sparse = reader.read(one, { sparse: 'zero' });
+assert.strictEqual(sparse.length, 1);
+assert.strictEqual(sparse[0].data, undefined);
+names = sparse.schemas[sparse[0].schema];
+assert.deepStrictEqual(names, Object.keys(full.data));
+
+Object.keys(full.data).forEach(function (s) {
+	var v = expand(sparse, sparse[0]);
+
+	if (full.data[s] === 0)
+		assert.ok(!v.hasOwnProperty(s), s + ' is zero');
+	else
+		assert.ok(v.hasOwnProperty(s), s + ' is nonzero');
+});
+
+/*
+ * The first read of changes gives every statistic; the next gives only the
+ * counters that have advanced since, and the zeros stay out.
+ */
+changed = reader.read(spec, { sparse: 'changed' });
+assert.strictEqual(changed.length, 4);
+assert.strictEqual(changed.schemas.length, 1, 'the CPUs share a schema');
+changed.forEach(function (k) {
+	assert.strictEqual(k.indexes.length, names.length);
+});
+
+process.env.KSSIM_TIME = '2';
+
+changed = reader.read(spec, { sparse: 'changed' });
+changed.forEach(function (k) {
+	var v = expand(changed, k);
+
+	assert.ok(v.hasOwnProperty('syscall'));
+	assert.ok(!v.hasOwnProperty('bawrite'));
+	assert.ok(k.indexes.length < names.length);
+});
+
+/*
+ * Another specification has a baseline of its own:  its first read of
+ * changes is complete, even though the kstat was just read so above.
+ */
+changed = reader.read(one, { sparse: 'changed' });
+assert.strictEqual(changed[0].indexes.length, names.length);
+
+assert.strictEqual(reader.read(one, { sparse: 'changed' })[0].indexes.length,
+    0, 'nothing has changed');
+
+process.env.KSSIM_TIME = '3';
+changed = reader.read(one, { sparse: 'changed' });
+assert.ok(changed[0].indexes.length < names.length);
+assert.strictEqual(expand(changed, changed[0]).syscall, 15000);
+
+assert.throws(function () {
+	reader.read(spec, { sparse: true, topN: 2, by: 'syscall' });
+});
+
+reader.close();
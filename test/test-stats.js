@@ -0,0 +1,89 @@
+/*
+ * stats() counts what the reader has done, and, for a reader created with
+ * "instrument", how long reading each module and class of kstat took.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_FAIL = 'sd:1:sd1';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader({ instrument: true });
+var plain = new kstat.Reader();
+var s, cpu, sd;
+
+function
+checkhist(h, count)
+{
+	var last = 0, n = 0;
+
+	assert.strictEqual(h.count, count);
+	assert.ok(h.max <= h.total);
+	assert.ok(h.buckets.length > 0);
+
+	h.buckets.forEach(function (b, i) {
+		if (b[0] === null) {
+			assert.strictEqual(i, h.buckets.length - 1);
+		} else {
+			assert.ok(b[0] > last, 'bounds ascend');
+			assert.strictEqual(b[0] & (b[0] - 1), 0, 'powers of two');
+			last = b[0];
+		}
+
+		assert.ok(b[1] > 0);
+		n += b[1];
+	});
+
+	assert.strictEqual(n, count);
+	assert.ok(h.buckets[h.buckets.length - 1][0] === null ||
+	    h.max < last);
+}
+
+reader.read({ module: 'cpu', name: 'sys' });
+reader.read({ module: 'sd', name: 'sd0' });
+reader.read({ module: 'sd', name: 'sd1' });
+reader.getkstat({ module: 'cpu', instance: 0, name: 'vm' });
+reader.prepare({ module: 'cpu', instance: 0, name: 'vm' }).read();
+
+s = reader.stats();
+assert.strictEqual(s.reads, 8);
+assert.strictEqual(s.coalesced, 0);
+assert.strictEqual(s.errors, 1);
+assert.strictEqual(s.lookups, 2);
+assert.ok(s.chainupdates > 0);
+assert.strictEqual(s.chainskips, 0);
+
+cpu = s.modules.filter(function (m) { return (m.module == 'cpu'); });
+sd = s.modules.filter(function (m) { return (m.module == 'sd'); });
+assert.strictEqual(cpu.length, 1);
+assert.strictEqual(cpu[0].class, 'misc');
+assert.strictEqual(cpu[0].errors, 0);
+checkhist(cpu[0].read, 6);
+checkhist(cpu[0].decode, 6);
+
+assert.strictEqual(sd.length, 1);
+assert.strictEqual(sd[0].class, 'disk');
+assert.strictEqual(sd[0].errors, 1);
+checkhist(sd[0].read, 1);
+
+/*
+ * A reset returns the counts, then clears them.
+ */
+assert.strictEqual(reader.stats({ reset: true }).reads, 8);
+s = reader.stats();
+assert.strictEqual(s.reads, 0);
+assert.strictEqual(s.errors, 0);
+assert.strictEqual(s.lookups, 0);
+assert.deepStrictEqual(s.modules, []);
+
+/*
+ * Without "instrument", the counts are kept, but no histograms.
+ */
+plain.read({ module: 'cpu', name: 'sys' });
+s = plain.stats();
+assert.strictEqual(s.reads, 4);
+assert.strictEqual(s.modules, undefined);
+
+reader.close();
+plain.close();
@@ -0,0 +1,70 @@
+/*
+ * A topN read returns the N kstats with the highest values (or rates) of a
+ * statistic, highest first.  The synthetic CPUs' counters advance at rates
+ * proportional to one more than their instance, so CPU 3 leads.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var spec = { module: 'cpu', name: 'sys' };
+var top, all;
+
+function
+instances(kstats)
+{
+	return (kstats.map(function (k) { return (k.instance); }));
+}
+
+top = reader.read(spec, { topN: 2, by: 'syscall' });
+assert.deepStrictEqual(instances(top), [ 3, 2 ]);
+top.forEach(function (k) {
+	assert.strictEqual(k.value, k.data.syscall);
+});
+assert.strictEqual(top[0].value, 20000);
+assert.strictEqual(top[1].value, 15000);
+
+top = reader.read(spec, { topN: 10, by: 'syscall' });
+assert.strictEqual(top.length, 4, 'no more than there are');
+
+assert.deepStrictEqual(reader.read(spec, { topN: 2, by: 'nosuchstat' }), []);
+
+/*
+ * By rate, nothing is ranked until a kstat has been seen by such a read.
+ */
+assert.deepStrictEqual(reader.read(spec, { topN: 2, by: 'rate(syscall)' }),
+    []);
+process.env.KSSIM_TIME = '3';
+top = reader.read(spec, { topN: 2, by: 'rate(syscall)' });
+assert.deepStrictEqual(instances(top), [ 3, 2 ]);
+assert.strictEqual(top[0].value, 20000);
+assert.strictEqual(top[1].value, 15000);
+
+/*
+ * A kstat that can't be read isn't ranked, nor is it while the reader is
+ * backing off from it, though it can be read by then.
+ */
+process.env.KSSIM_FAIL = 'cpu:3:sys';
+assert.deepStrictEqual(instances(reader.read(spec,
+    { topN: 2, by: 'syscall' })), [ 2, 1 ]);
+delete process.env.KSSIM_FAIL;
+assert.deepStrictEqual(instances(reader.read(spec,
+    { topN: 2, by: 'syscall' })), [ 2, 1 ]);
+assert.strictEqual(reader.failures().length, 1);
+assert.strictEqual(reader.stats().errors, 1);
+
+/*
+ * A plain read of the same specification still returns them all.
+ */
+all = reader.read(spec);
+assert.strictEqual(all.length, 3);
+
+assert.throws(function () {
+	reader.read(spec, { topN: 2, by: 'syscall', budgetUs: 100 });
+});
+
+reader.close();
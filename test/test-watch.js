@@ -0,0 +1,81 @@
+/*
+ * Watches report an event only when a rule starts or stops holding, and the
+ * state they keep for kstats that have left the chain is let go.
+ */
+
+var assert = require('assert');
+var common = require('./common');
+
+process.env.KSSIM_CHURN = 'call';
+process.env.KSSIM_TIME = '1';
+
+var kstat = common.kstat();
+var reader = new kstat.Reader();
+var id, events, caches;
+
+/*
+ * cpu 0's syscall counter advances at 5000 per second, so it's at 5000 one
+ * second in, and 10000 a second later.
+ */
+id = reader.watch({ module: 'cpu', instance: 0, name: 'sys',
+    statistic: 'syscall', op: '<', value: 7500 });
+
+events = reader.checkwatch();
+assert.strictEqual(events.length, 1);
+assert.strictEqual(events[0].id, id);
+assert.strictEqual(events[0].module, 'cpu');
+assert.strictEqual(events[0].instance, 0);
+assert.strictEqual(events[0].statistic, 'syscall');
+assert.strictEqual(events[0].active, true);
+assert.strictEqual(events[0].value, 5000);
+
+assert.deepStrictEqual(reader.checkwatch(), [], 'no change, no event');
+
+process.env.KSSIM_TIME = '2';
+events = reader.checkwatch();
+assert.strictEqual(events.length, 1);
+assert.strictEqual(events[0].active, false);
+assert.strictEqual(events[0].value, 10000);
+
+assert.deepStrictEqual(reader.checkwatch(), []);
+assert.strictEqual(reader.unwatch(id), true);
+assert.strictEqual(reader.unwatch(id), false);
+
+/*
+ * Rates:  CPU n's syscall rate is 5000 * (n + 1) per second, so all but CPU
+ * 0 become active on the second check (the first only sets the baseline).
+ */
+id = reader.watch({ module: 'cpu', name: 'sys', statistic: 'syscall',
+    rate: true, op: '>', value: 7500 });
+
+assert.deepStrictEqual(reader.checkwatch(), []);
+process.env.KSSIM_TIME = '3';
+events = reader.checkwatch();
+assert.deepStrictEqual(events.map(function (e) { return (e.instance); }),
+    [ 1, 2, 3 ]);
+events.forEach(function (e) {
+	assert.strictEqual(e.active, true);
+	assert.strictEqual(e.value, 5000 * (e.instance + 1));
+});
+reader.unwatch(id);
+
+/*
+ * Under churn, a watch on the VNICs sees a new set of them on every check;
+ * what it remembers about those that have gone must not accumulate.
+ */
+id = reader.watch({ module: 'vnic', statistic: 'link_up', op: '==',
+    value: 1 });
+
+for (var i = 0; i < 50; i++) {
+	events = reader.checkwatch();
+	assert.ok(events.length > 0, 'new VNICs are reported');
+
+	if (i == 10)
+		caches = reader.memoryUsage().caches;
+}
+
+assert.ok(reader.memoryUsage().caches <= caches,
+    'watch state grew under churn: ' + caches + ' to ' +
+    reader.memoryUsage().caches);
+
+reader.close();